@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "BakedOcean.h"
+#include "ButterflyTable.h"
+#include "CPUFFTCalculator.h"
+#include "CPUGenerator.h"
+#include "ThreadPool.h"
+
+// WaveBake simulates a loop of the demo's ocean ahead of time and writes it to a file, which the
+// demo plays back with --playback without doing any simulation work. Every wave is quantized to
+// the repeat period, so the last frame flows seamlessly back into the first.
+//
+// Usage: WaveBake --output file.bake [--period seconds] [--fps N] [--resolutions 512,256,128]
+//                 [--threads N]
+//
+// There is one cascade for each resolution, and the demo can play back up to four. The maps are
+// stored in half precision, so each frame takes 16 bytes per texel of every cascade. Low
+// resolutions and frame rates keep the files small.
+
+namespace
+{
+
+using namespace Waves;
+
+struct BakeOptions
+{
+  std::string output;
+  float period = 30.0f; // The repeat period, which should be longer than the longest swell.
+  float fps = 30.0f;
+  std::vector<std::size_t> resolutions = {512, 256, 128};
+  std::size_t threads = 0; // Zero uses every hardware thread.
+};
+
+std::vector<std::size_t> ParseList(const std::string& text)
+{
+  std::vector<std::size_t> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ','))
+    values.push_back(std::stoul(item));
+  return values;
+}
+
+bool ParseOptions(int argc, char** argv, BakeOptions& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (i + 1 >= argc)
+    {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+
+    std::string value = argv[++i];
+    if (arg == "--output")
+      options.output = value;
+    else if (arg == "--period")
+      options.period = std::stof(value);
+    else if (arg == "--fps")
+      options.fps = std::stof(value);
+    else if (arg == "--resolutions")
+      options.resolutions = ParseList(value);
+    else if (arg == "--threads")
+      options.threads = std::stoul(value);
+    else
+    {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+
+  if (options.output.empty() || options.period <= 0.0f || options.fps <= 0.0f ||
+      options.resolutions.empty())
+  {
+    std::cerr << "Usage: WaveBake --output file.bake [--period seconds] [--fps N] "
+                 "[--resolutions 512,256,128] [--threads N]"
+              << std::endl;
+    return false;
+  }
+
+  // The FFT only supports even sizes made of the radices 2, 3, 4, and 5. We bake on the CPU, but
+  // the demo plays back with the GPU's FFTs, which are also limited in size.
+  for (std::size_t resolution : options.resolutions)
+  {
+    if (!IsGPUFFTSizeSupported(resolution))
+    {
+      std::cerr << "Resolution " << resolution << " is not supported by the FFT, which needs an "
+                << "even size no larger than " << maxGPUFFTSize
+                << " with no prime factors other than 2, 3, and 5" << std::endl;
+      return false;
+    }
+  }
+
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  using Clock = std::chrono::steady_clock;
+
+  BakeOptions options;
+  if (!ParseOptions(argc, argv, options))
+    return 1;
+
+  ThreadPool threadPool(options.threads);
+
+  // Mirror the cascade setup in WaveApp, with every wave looping over the period.
+  std::vector<CPUFFTCalculator*> fftCalculators;
+  std::vector<CPUGenerator*> generators;
+  std::vector<BakedCascade> cascades;
+  for (std::size_t i = 0; i < options.resolutions.size(); i++)
+  {
+    fftCalculators.push_back(new CPUFFTCalculator(options.resolutions[i], &threadPool));
+    generators.push_back(new CPUGenerator(fftCalculators.back(), &threadPool));
+
+    GeneratorSettings& settings = generators.back()->GetOceanSettings();
+    ConfigureCascade(settings, i);
+    settings.repeatPeriod = options.period;
+
+    BakedCascade cascade;
+    cascade.textureSize = options.resolutions[i];
+    cascade.planeSize = settings.planeSize;
+    cascade.displacement = settings.displacement;
+    cascades.push_back(cascade);
+  }
+
+  std::size_t numFrames =
+      std::max<std::size_t>(1, static_cast<std::size_t>(std::round(options.period * options.fps)));
+
+  BakedOceanWriter writer;
+  if (!writer.Open(options.output, cascades, numFrames, options.period))
+  {
+    std::cerr << "Failed to open " << options.output << std::endl;
+    return 1;
+  }
+
+  // The frames are sampled across one period, which excludes its end since that's the first frame.
+  double simulationTime = 0.0;
+  for (std::size_t frame = 0; frame < numFrames; frame++)
+  {
+    float time = options.period * static_cast<float>(frame) / static_cast<float>(numFrames);
+    for (auto* generator : generators)
+      generator->GetOceanSettings().time = time;
+
+    Clock::time_point start = Clock::now();
+    CPUGenerator::CalculateOceans(generators, 0.0f);
+    simulationTime += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    for (auto* generator : generators)
+      writer.WriteCascade(generator->GetHeightMap(), generator->GetDisplacementMap());
+  }
+
+  if (!writer.Close())
+    return 1;
+
+  // Play the file back once, copying each frame out like the demo uploads it, so that we can see
+  // how playback compares with simulating.
+  Clock::time_point openStart = Clock::now();
+  BakedOcean bakedOcean;
+  if (!bakedOcean.Open(options.output))
+  {
+    std::cerr << "Failed to read back " << options.output << std::endl;
+    return 1;
+  }
+  double openTime = std::chrono::duration<double, std::milli>(Clock::now() - openStart).count();
+
+  std::vector<unsigned char> staging;
+  double playbackTime = 0.0;
+  for (std::size_t frame = 0; frame < numFrames; frame++)
+  {
+    Clock::time_point start = Clock::now();
+    for (std::size_t i = 0; i < cascades.size(); i++)
+    {
+      std::size_t numTexels = cascades[i].textureSize * cascades[i].textureSize;
+      std::size_t mapSize = numTexels * 4 * sizeof(uint16_t);
+      staging.resize(mapSize);
+
+      BakedFrame maps = bakedOcean.GetFrame(i, frame);
+      std::memcpy(staging.data(), maps.heightMap, mapSize);
+      std::memcpy(staging.data(), maps.displacementMap, mapSize);
+    }
+    bakedOcean.Prefetch((frame + 1) % numFrames);
+    playbackTime += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  }
+
+  double frames = static_cast<double>(numFrames);
+  std::cerr << "Baked " << numFrames << " frames of " << cascades.size() << " cascade(s) to "
+            << options.output << "\n"
+            << "  Opened in " << openTime << " ms\n"
+            << "  Simulation: " << simulationTime / frames << " ms per frame\n"
+            << "  Playback:   " << playbackTime / frames << " ms per frame" << std::endl;
+
+  for (auto* generator : generators)
+    delete generator;
+  for (auto* fftCalculator : fftCalculators)
+    delete fftCalculator;
+}
@@ -0,0 +1,765 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <glm/gtc/packing.hpp>
+#include <iostream>
+#include <random>
+#include <span>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ButterflyTable.h"
+#include "CascadeScheduler.h"
+#include "CPUFFTCalculator.h"
+#include "CPUGenerator.h"
+#include "OceanQuery.h"
+#include "ThreadPool.h"
+
+// WaveBench drives the full ocean simulation without a window, so that it can run on machines that
+// have no display. Each configuration is timed stage by stage, and the results are written as JSON.
+//
+// Usage: WaveBench [--resolutions 64,128,...] [--cascades 1,2,3] [--frames N] [--warmup N]
+//                  [--threads N] [--spectrum half|full] [--storage full|half]
+//                  [--schedule 1,2,4] [--queries 10000,100000,...] [--scaling 1,2,4,...]
+//                  [--output file.json]
+//
+// Only the CPU simulation is timed. Vision can only create a GPU context along with a visible
+// window, and exposes no timestamp queries or fences, so the GPU generators can't be run headless
+// here, or timed any better than by the intervals between frames. Time them in the demo, with its
+// profiler or a GPU profiler, instead.
+//
+// With --queries, each configuration also times batches of OceanQuery surface queries of the given
+// sizes against its final maps.
+//
+// With --storage half, each configuration also reports how far the surface moves when its final
+// maps are rounded to half precision, like the generators do when they store them that way.
+//
+// With --schedule, each cascade is only simulated at the given interval of frames, and blended in
+// between like the demo does. Each configuration also reports how far the blended surface is from
+// simulating every frame.
+//
+// With --scaling, each configuration is also timed with each of the given numbers of threads, both
+// stage by stage like the demo used to simulate, and as one task graph across every cascade.
+
+namespace
+{
+
+using namespace Waves;
+
+const char* usage =
+    "Usage: WaveBench [--resolutions 64,128,...] [--cascades 1,2,3] [--frames N] [--warmup N]\n"
+    "                 [--threads N] [--spectrum half|full] [--storage full|half]\n"
+    "                 [--schedule 1,2,4] [--queries 10000,100000,...] [--scaling 1,2,4,...]\n"
+    "                 [--output file.json]\n";
+
+struct BenchOptions
+{
+  bool help = false;
+  std::vector<std::size_t> resolutions = {64, 128, 256, 512, 1024, 2048};
+  std::vector<std::size_t> cascades = {1, 2, 3};
+  std::size_t frames = 30;
+  std::size_t warmup = 3;
+  std::size_t threads = 0;  // Zero uses every hardware thread.
+  bool halfSpectrum = true; // The layout of the initial spectrum.
+  bool halfStorage = false; // The precision of the sampled maps.
+  std::vector<std::size_t> schedule; // The interval of each cascade. Empty simulates every frame.
+  std::vector<std::size_t> queries;
+  std::vector<std::size_t> scaling; // The numbers of threads to time. Empty skips the scaling.
+  std::string output;       // Empty writes to stdout.
+};
+
+// The stages of Generator::CalculateOcean, plus the whole frame.
+enum Stage
+{
+  GenerateSpectrum,
+  PrepareFFT,
+  HeightIFFT,
+  DisplacementIFFT,
+  ComputeFoam,
+  Blend,
+  Frame,
+  NumStages
+};
+
+const char* stageNames[NumStages] = {"generateSpectrum", "prepareFFT",  "heightIFFT",
+                                     "displacementIFFT", "computeFoam", "blend", "frame"};
+
+struct Statistics
+{
+  double min = 0.0;
+  double median = 0.0;
+  double p99 = 0.0;
+};
+
+struct QueryResult
+{
+  std::size_t count = 0;
+  Statistics time;
+};
+
+// The frame times with one number of threads, when the cascades are simulated one stage at a time,
+// and when they're simulated together as a task graph.
+struct ScalingResult
+{
+  std::size_t threads = 0;
+  Statistics sequential;
+  Statistics graph;
+};
+
+// The largest differences between the surface sampled from the full and half precision maps.
+struct StorageError
+{
+  double heightMax = 0.0;       // In meters.
+  double heightRMS = 0.0;       // In meters.
+  double displacementMax = 0.0; // The horizontal distance in meters.
+  double normalMax = 0.0;       // The angle in degrees.
+  double jacobianMax = 0.0;
+};
+
+// The largest differences between the blended surface and the one simulated every frame.
+struct ScheduleError
+{
+  double heightMax = 0.0;       // In meters.
+  double heightRMS = 0.0;       // In meters.
+  double displacementMax = 0.0; // The horizontal distance in meters.
+};
+
+struct BenchResult
+{
+  std::size_t resolution = 0;
+  std::size_t cascades = 0;
+  Statistics stages[NumStages];
+  std::vector<QueryResult> queries;
+  std::vector<ScalingResult> scaling;
+  bool hasStorageError = false;
+  StorageError storageError;
+  bool hasScheduleError = false;
+  ScheduleError scheduleError;
+};
+
+// The last two results of a cascade, and the maps that are blended from them.
+struct BlendedMaps
+{
+  std::vector<glm::vec4> previousHeight;
+  std::vector<glm::vec4> previousDisplacement;
+  std::vector<glm::vec4> nextHeight;
+  std::vector<glm::vec4> nextDisplacement;
+  std::vector<glm::vec4> height;
+  std::vector<glm::vec4> displacement;
+};
+
+std::vector<std::size_t> ParseList(const std::string& text)
+{
+  std::vector<std::size_t> values;
+  std::stringstream stream(text);
+  std::string item;
+  while (std::getline(stream, item, ','))
+    values.push_back(std::stoul(item));
+  return values;
+}
+
+bool ParseOptions(int argc, char** argv, BenchOptions& options)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    // Help is the only option without a value.
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h")
+    {
+      options.help = true;
+      return true;
+    }
+
+    if (i + 1 >= argc)
+    {
+      std::cerr << "Missing value for " << arg << std::endl;
+      return false;
+    }
+
+    std::string value = argv[++i];
+    if (arg == "--resolutions")
+      options.resolutions = ParseList(value);
+    else if (arg == "--cascades")
+      options.cascades = ParseList(value);
+    else if (arg == "--frames")
+      options.frames = std::stoul(value);
+    else if (arg == "--warmup")
+      options.warmup = std::stoul(value);
+    else if (arg == "--threads")
+      options.threads = std::stoul(value);
+    else if (arg == "--spectrum" && (value == "half" || value == "full"))
+      options.halfSpectrum = value == "half";
+    else if (arg == "--storage" && (value == "half" || value == "full"))
+      options.halfStorage = value == "half";
+    else if (arg == "--schedule")
+      options.schedule = ParseList(value);
+    else if (arg == "--queries")
+      options.queries = ParseList(value);
+    else if (arg == "--scaling")
+      options.scaling = ParseList(value);
+    else if (arg == "--output")
+      options.output = value;
+    else
+    {
+      std::cerr << "Unknown option " << arg << std::endl;
+      return false;
+    }
+  }
+
+  // The FFT only supports even sizes made of the radices 2, 3, 4, and 5.
+  for (std::size_t resolution : options.resolutions)
+  {
+    if (!IsFFTSizeSupported(resolution))
+    {
+      std::cerr << "Resolution " << resolution << " is not supported by the FFT, which needs an "
+                << "even size with no prime factors other than 2, 3, and 5" << std::endl;
+      return false;
+    }
+  }
+
+  return options.frames > 0;
+}
+
+Statistics Summarize(std::vector<double> samples)
+{
+  std::sort(samples.begin(), samples.end());
+
+  // Use the nearest rank for our percentiles, which is exact for small numbers of samples.
+  auto percentile = [&samples](double p)
+  {
+    std::size_t rank = static_cast<std::size_t>(p * static_cast<double>(samples.size() - 1) + 0.5);
+    return samples[rank];
+  };
+
+  Statistics stats;
+  stats.min = samples.front();
+  stats.median = percentile(0.5);
+  stats.p99 = percentile(0.99);
+  return stats;
+}
+
+std::vector<OceanCascade> GetCascades(const std::vector<CPUGenerator*>& generators)
+{
+  std::vector<OceanCascade> cascades;
+  for (CPUGenerator* generator : generators)
+  {
+    OceanCascade cascade;
+    cascade.heightMap = generator->GetHeightMap();
+    cascade.displacementMap = generator->GetDisplacementMap();
+    cascade.textureSize = generator->GetTextureResolution();
+    cascade.planeSize = generator->GetOceanSettings().planeSize;
+    cascade.displacementScale = generator->GetOceanSettings().displacement;
+    cascades.push_back(cascade);
+  }
+
+  return cascades;
+}
+
+// Scatters points over a few tiles of the largest plane, so that they miss the caches like the
+// queries of a real scene would.
+std::vector<glm::vec2> ScatterPositions(std::span<const OceanCascade> cascades, std::size_t count,
+                                        std::mt19937& random)
+{
+  float extent = 0.0f;
+  for (const OceanCascade& cascade : cascades)
+    extent = std::max(extent, cascade.planeSize);
+
+  std::uniform_real_distribution<float> coordinate(-2.0f * extent, 2.0f * extent);
+  std::vector<glm::vec2> positions(count);
+  for (glm::vec2& position : positions)
+    position = glm::vec2(coordinate(random), coordinate(random));
+
+  return positions;
+}
+
+// Rounds a value to half precision, like storing it in a half precision texture does.
+float RoundToHalf(float value)
+{
+  return glm::unpackHalf1x16(glm::packHalf1x16(value));
+}
+
+StorageError MeasureStorageError(ThreadPool& threadPool,
+                                 const std::vector<CPUGenerator*>& generators)
+{
+  std::vector<OceanCascade> cascades = GetCascades(generators);
+  std::vector<OceanCascade> halfCascades = cascades;
+  std::vector<std::vector<glm::vec4>> halfMaps;
+
+  StorageError error;
+  for (std::size_t i = 0; i < generators.size(); i++)
+  {
+    std::size_t numTexels = cascades[i].textureSize * cascades[i].textureSize;
+    for (const glm::vec4* map : {cascades[i].heightMap, cascades[i].displacementMap})
+    {
+      std::vector<glm::vec4>& halfMap = halfMaps.emplace_back(numTexels);
+      for (std::size_t texel = 0; texel < numTexels; texel++)
+      {
+        for (int channel = 0; channel < 4; channel++)
+          halfMap[texel][channel] = RoundToHalf(map[texel][channel]);
+      }
+    }
+
+    halfCascades[i].heightMap = halfMaps[2 * i].data();
+    halfCascades[i].displacementMap = halfMaps[2 * i + 1].data();
+
+    const float* jacobian = generators[i]->GetJacobianMap();
+    for (std::size_t texel = 0; texel < numTexels; texel++)
+    {
+      double difference = std::abs(RoundToHalf(jacobian[texel]) - jacobian[texel]);
+      error.jacobianMax = std::max(error.jacobianMax, difference);
+    }
+  }
+
+  // Compare the surface that the renderer would draw from each set of maps.
+  constexpr std::size_t numPoints = 100000;
+  std::mt19937 random(1234);
+  std::vector<glm::vec2> positions = ScatterPositions(cascades, numPoints, random);
+  std::vector<OceanSample> samples(numPoints);
+  std::vector<OceanSample> halfSamples(numPoints);
+
+  OceanQuery query(&threadPool);
+  query.SetCascades(cascades);
+  query.Query(positions, samples);
+  query.SetCascades(halfCascades);
+  query.Query(positions, halfSamples);
+
+  double heightSquared = 0.0;
+  for (std::size_t i = 0; i < numPoints; i++)
+  {
+    double height = std::abs(halfSamples[i].height - samples[i].height);
+    double displacement = glm::length(halfSamples[i].displacement - samples[i].displacement);
+    double cosine = std::clamp(glm::dot(halfSamples[i].normal, samples[i].normal), -1.0f, 1.0f);
+
+    error.heightMax = std::max(error.heightMax, height);
+    error.displacementMax = std::max(error.displacementMax, displacement);
+    error.normalMax = std::max(error.normalMax, std::acos(cosine) * 180.0 / 3.14159265358979);
+    heightSquared += height * height;
+  }
+
+  error.heightRMS = std::sqrt(heightSquared / static_cast<double>(numPoints));
+  return error;
+}
+
+// Blends the maps of a cascade like the blendMaps kernel does.
+void BlendResults(BlendedMaps& maps, float blend)
+{
+  for (std::size_t texel = 0; texel < maps.height.size(); texel++)
+  {
+    maps.height[texel] = glm::mix(maps.previousHeight[texel], maps.nextHeight[texel], blend);
+    maps.displacement[texel] =
+        glm::mix(maps.previousDisplacement[texel], maps.nextDisplacement[texel], blend);
+  }
+}
+
+// Accumulates the differences between a blended cascade and its reference, which was simulated
+// for the time that's drawn. The sum of the squared height differences goes into heightRMS.
+void AccumulateScheduleError(const BlendedMaps& maps, CPUGenerator* reference, ScheduleError& error)
+{
+  const glm::vec4* height = reference->GetHeightMap();
+  const glm::vec4* displacement = reference->GetDisplacementMap();
+  float scale = reference->GetOceanSettings().displacement;
+  for (std::size_t texel = 0; texel < maps.height.size(); texel++)
+  {
+    double heightDifference = std::abs(maps.height[texel].x - height[texel].x);
+    glm::vec2 offset(maps.height[texel].w - height[texel].w,
+                     maps.displacement[texel].x - displacement[texel].x);
+
+    error.heightMax = std::max(error.heightMax, heightDifference);
+    error.heightRMS += heightDifference * heightDifference;
+    error.displacementMax = std::max(error.displacementMax,
+                                     static_cast<double>(scale * glm::length(offset)));
+  }
+}
+
+std::vector<QueryResult> RunQueries(ThreadPool& threadPool, const BenchOptions& options,
+                                    const std::vector<CPUGenerator*>& generators)
+{
+  using Clock = std::chrono::steady_clock;
+
+  std::vector<OceanCascade> cascades = GetCascades(generators);
+  OceanQuery query(&threadPool);
+  query.SetCascades(cascades);
+
+  std::mt19937 random(1234);
+  std::vector<QueryResult> results;
+  for (std::size_t count : options.queries)
+  {
+    std::vector<glm::vec2> positions = ScatterPositions(cascades, count, random);
+
+    std::vector<OceanSample> samples(count);
+    std::vector<double> times;
+    for (std::size_t frame = 0; frame < options.warmup + options.frames; frame++)
+    {
+      Clock::time_point start = Clock::now();
+      query.Query(positions, samples);
+      double time = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+      if (frame >= options.warmup)
+        times.push_back(time);
+    }
+
+    QueryResult result;
+    result.count = count;
+    result.time = Summarize(times);
+    results.push_back(result);
+  }
+
+  return results;
+}
+
+std::vector<ScalingResult> RunScaling(const BenchOptions& options, std::size_t resolution,
+                                      std::size_t numCascades)
+{
+  using Clock = std::chrono::steady_clock;
+
+  std::vector<ScalingResult> results;
+  for (std::size_t numThreads : options.scaling)
+  {
+    // Each count gets its own pool, since a pool's threads are fixed when it's created.
+    ThreadPool threadPool(numThreads);
+    CPUFFTCalculator fftCalc(resolution, &threadPool);
+    std::vector<CPUGenerator*> generators;
+    for (std::size_t i = 0; i < numCascades; i++)
+    {
+      generators.push_back(new CPUGenerator(&fftCalc, &threadPool));
+      generators.back()->SetHalfSpectrum(options.halfSpectrum);
+      ConfigureCascade(generators.back()->GetOceanSettings(), i);
+    }
+
+    // The spectra are generated on the first frame, which the warmup leaves out.
+    float timestep = 1.0f / 60.0f;
+    std::vector<double> sequential, graph;
+    for (std::size_t frame = 0; frame < options.warmup + options.frames; frame++)
+    {
+      Clock::time_point start = Clock::now();
+      for (auto* generator : generators)
+        generator->CalculateOcean(timestep);
+      Clock::time_point middle = Clock::now();
+      CPUGenerator::CalculateOceans(generators, timestep);
+      Clock::time_point end = Clock::now();
+
+      if (frame >= options.warmup)
+      {
+        sequential.push_back(std::chrono::duration<double, std::milli>(middle - start).count());
+        graph.push_back(std::chrono::duration<double, std::milli>(end - middle).count());
+      }
+    }
+
+    ScalingResult result;
+    result.threads = threadPool.GetNumThreads();
+    result.sequential = Summarize(sequential);
+    result.graph = Summarize(graph);
+    results.push_back(result);
+
+    for (auto* generator : generators)
+      delete generator;
+  }
+
+  return results;
+}
+
+BenchResult RunConfiguration(ThreadPool& threadPool, const BenchOptions& options,
+                             std::size_t resolution, std::size_t numCascades)
+{
+  using Clock = std::chrono::steady_clock;
+
+  CPUFFTCalculator fftCalc(resolution, &threadPool);
+  std::vector<CPUGenerator*> generators;
+  for (std::size_t i = 0; i < numCascades; i++)
+  {
+    generators.push_back(new CPUGenerator(&fftCalc, &threadPool));
+    generators.back()->SetHalfSpectrum(options.halfSpectrum);
+
+    // Mirror the cascade setup in WaveApp, so that the work matches what the demo simulates.
+    ConfigureCascade(generators.back()->GetOceanSettings(), i);
+  }
+
+  // Without a schedule, every cascade is simulated every frame. Otherwise, the cascades that are
+  // blended get a reference that's simulated every frame, untimed, to measure the blending against.
+  CascadeScheduler scheduler;
+  scheduler.SetNumCascades(numCascades);
+  std::vector<BlendedMaps> blendedMaps(numCascades);
+  std::vector<CPUGenerator*> references(numCascades, nullptr);
+  for (std::size_t i = 0; i < numCascades && !options.schedule.empty(); i++)
+  {
+    scheduler.SetInterval(i, options.schedule[std::min(i, options.schedule.size() - 1)]);
+    if (scheduler.GetInterval(i) == 1)
+      continue;
+
+    references[i] = new CPUGenerator(&fftCalc, &threadPool);
+    references[i]->GetOceanSettings() = generators[i]->GetOceanSettings();
+    references[i]->GenerateSpectrum();
+
+    std::size_t numTexels = resolution * resolution;
+    BlendedMaps& maps = blendedMaps[i];
+    for (auto* map : {&maps.previousHeight, &maps.previousDisplacement, &maps.nextHeight,
+                      &maps.nextDisplacement, &maps.height, &maps.displacement})
+    {
+      map->resize(numTexels);
+    }
+  }
+
+  // Each sample is the time spent in a stage across every cascade during one frame.
+  std::vector<double> samples[NumStages];
+  ScheduleError scheduleError;
+  float timestep = 1.0f / 60.0f;
+  for (std::size_t frame = 0; frame < options.warmup + options.frames; frame++)
+  {
+    double frameStages[NumStages] = {};
+    Clock::time_point frameStart = Clock::now();
+
+    // The demo only regenerates the spectrum when its settings change, but we regenerate it every
+    // frame so that its cost is still measured.
+    std::span<const CascadeStep> steps = scheduler.Advance(timestep);
+    for (std::size_t i = 0; i < numCascades; i++)
+    {
+      CPUGenerator* generator = generators[i];
+      const CascadeStep& step = steps[i];
+
+      Clock::time_point start = Clock::now();
+      auto lap = [&start](double& total)
+      {
+        Clock::time_point end = Clock::now();
+        total += std::chrono::duration<double, std::milli>(end - start).count();
+        start = end;
+      };
+
+      if (step.simulate)
+      {
+        generator->GetOceanSettings().time = step.time;
+        generator->GenerateSpectrum();
+        lap(frameStages[GenerateSpectrum]);
+        generator->PrepareFFT();
+        lap(frameStages[PrepareFFT]);
+        fftCalc.IFFT(generator->GetHeightMap());
+        lap(frameStages[HeightIFFT]);
+        fftCalc.IFFT(generator->GetDisplacementMap());
+        lap(frameStages[DisplacementIFFT]);
+        generator->ComputeFoam();
+        lap(frameStages[ComputeFoam]);
+      }
+
+      if (!step.interpolated)
+        continue;
+
+      // The GPU swaps its maps rather than copying them, so the copy isn't timed.
+      BlendedMaps& maps = blendedMaps[i];
+      if (step.simulate)
+      {
+        std::swap(maps.previousHeight, maps.nextHeight);
+        std::swap(maps.previousDisplacement, maps.nextDisplacement);
+        std::copy_n(generator->GetHeightMap(), maps.nextHeight.size(), maps.nextHeight.begin());
+        std::copy_n(generator->GetDisplacementMap(), maps.nextDisplacement.size(),
+                    maps.nextDisplacement.begin());
+      }
+
+      start = Clock::now();
+      BlendResults(maps, step.blend);
+      lap(frameStages[Blend]);
+    }
+
+    frameStages[Frame] =
+        std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count();
+
+    if (frame < options.warmup)
+      continue;
+
+    for (std::size_t i = 0; i < numCascades; i++)
+    {
+      if (!references[i])
+        continue;
+
+      references[i]->GetOceanSettings().time = static_cast<float>(scheduler.GetTime());
+      references[i]->PrepareFFT();
+      fftCalc.IFFT(references[i]->GetHeightMap());
+      fftCalc.IFFT(references[i]->GetDisplacementMap());
+      AccumulateScheduleError(blendedMaps[i], references[i], scheduleError);
+    }
+
+    for (int stage = 0; stage < NumStages; stage++)
+      samples[stage].push_back(frameStages[stage]);
+  }
+
+  BenchResult result;
+  result.resolution = resolution;
+  result.cascades = numCascades;
+  for (int stage = 0; stage < NumStages; stage++)
+    result.stages[stage] = Summarize(samples[stage]);
+
+  if (!options.queries.empty())
+    result.queries = RunQueries(threadPool, options, generators);
+
+  if (!options.scaling.empty())
+    result.scaling = RunScaling(options, resolution, numCascades);
+
+  if (options.halfStorage)
+  {
+    result.hasStorageError = true;
+    result.storageError = MeasureStorageError(threadPool, generators);
+  }
+
+  std::size_t numBlended = 0;
+  for (auto* reference : references)
+    numBlended += reference ? 1 : 0;
+
+  if (numBlended > 0)
+  {
+    double numSamples = static_cast<double>(numBlended * options.frames * resolution * resolution);
+    scheduleError.heightRMS = std::sqrt(scheduleError.heightRMS / numSamples);
+    result.hasScheduleError = true;
+    result.scheduleError = scheduleError;
+  }
+
+  for (auto* generator : generators)
+    delete generator;
+  for (auto* reference : references)
+    delete reference;
+
+  return result;
+}
+
+void WriteJSON(std::ostream& out, const BenchOptions& options, std::size_t numThreads,
+               const std::vector<BenchResult>& results)
+{
+  char buffer[256];
+  out << "{\n";
+  out << "  \"backend\": \"cpu\",\n";
+  out << "  \"threads\": " << numThreads << ",\n";
+  out << "  \"spectrum\": \"" << (options.halfSpectrum ? "half" : "full") << "\",\n";
+  out << "  \"storage\": \"" << (options.halfStorage ? "half" : "full") << "\",\n";
+  out << "  \"schedule\": [";
+  for (std::size_t i = 0; i < options.schedule.size(); i++)
+    out << (i > 0 ? ", " : "") << options.schedule[i];
+  out << "],\n";
+  out << "  \"frames\": " << options.frames << ",\n";
+  out << "  \"units\": \"ms\",\n";
+  out << "  \"results\": [\n";
+  for (std::size_t i = 0; i < results.size(); i++)
+  {
+    const BenchResult& result = results[i];
+
+    // Each field is written once they're all known, so that only the last goes without a comma.
+    std::vector<std::string> fields;
+    fields.push_back("\"resolution\": " + std::to_string(result.resolution));
+    fields.push_back("\"cascades\": " + std::to_string(result.cascades));
+    for (int stage = 0; stage < NumStages; stage++)
+    {
+      const Statistics& stats = result.stages[stage];
+      std::snprintf(buffer, sizeof(buffer), "{\"min\": %.4f, \"median\": %.4f, \"p99\": %.4f}",
+                    stats.min, stats.median, stats.p99);
+      fields.push_back("\"" + std::string(stageNames[stage]) + "\": " + buffer);
+    }
+
+    // The error is in meters, except for the normals which are in degrees.
+    if (result.hasStorageError)
+    {
+      const StorageError& error = result.storageError;
+      std::snprintf(buffer, sizeof(buffer),
+                    "{\"heightMax\": %.3g, \"heightRMS\": %.3g, \"displacementMax\": %.3g, "
+                    "\"normalMaxDegrees\": %.3g, \"jacobianMax\": %.3g}",
+                    error.heightMax, error.heightRMS, error.displacementMax, error.normalMax,
+                    error.jacobianMax);
+      fields.push_back("\"storageError\": " + std::string(buffer));
+    }
+
+    // The error is in meters.
+    if (result.hasScheduleError)
+    {
+      const ScheduleError& error = result.scheduleError;
+      std::snprintf(buffer, sizeof(buffer),
+                    "{\"heightMax\": %.3g, \"heightRMS\": %.3g, \"displacementMax\": %.3g}",
+                    error.heightMax, error.heightRMS, error.displacementMax);
+      fields.push_back("\"scheduleError\": " + std::string(buffer));
+    }
+
+    // Report each batch size along with the throughput at the median time.
+    if (!result.queries.empty())
+    {
+      std::string field = "\"queries\": [\n";
+      for (std::size_t j = 0; j < result.queries.size(); j++)
+      {
+        const QueryResult& query = result.queries[j];
+        double pointsPerSecond = static_cast<double>(query.count) / (query.time.median / 1000.0);
+        std::snprintf(buffer, sizeof(buffer),
+                      "{\"count\": %zu, \"min\": %.4f, \"median\": %.4f, \"p99\": %.4f, "
+                      "\"pointsPerSecond\": %.0f}",
+                      query.count, query.time.min, query.time.median, query.time.p99,
+                      pointsPerSecond);
+        field += "        " + std::string(buffer) + (j + 1 < result.queries.size() ? ",\n" : "\n");
+      }
+      fields.push_back(field + "      ]");
+    }
+
+    // Report each thread count along with the speedup of the task graph over the first count, and
+    // how close that is to linear. The first count is usually one thread.
+    if (!result.scaling.empty())
+    {
+      std::string field = "\"scaling\": [\n";
+      const ScalingResult& first = result.scaling[0];
+      for (std::size_t j = 0; j < result.scaling.size(); j++)
+      {
+        const ScalingResult& scaling = result.scaling[j];
+        double speedup = first.graph.median / scaling.graph.median;
+        double linear = static_cast<double>(scaling.threads) / static_cast<double>(first.threads);
+        std::snprintf(buffer, sizeof(buffer),
+                      "{\"threads\": %zu, \"sequentialMedian\": %.4f, \"graphMedian\": %.4f, "
+                      "\"speedup\": %.2f, \"efficiency\": %.2f}",
+                      scaling.threads, scaling.sequential.median, scaling.graph.median, speedup,
+                      speedup / linear);
+        field += "        " + std::string(buffer) + (j + 1 < result.scaling.size() ? ",\n" : "\n");
+      }
+      fields.push_back(field + "      ]");
+    }
+
+    out << "    {\n";
+    for (std::size_t j = 0; j < fields.size(); j++)
+      out << "      " << fields[j] << (j + 1 < fields.size() ? ",\n" : "\n");
+    out << "    }" << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  out << "  ]\n";
+  out << "}\n";
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+  BenchOptions options;
+  if (!ParseOptions(argc, argv, options))
+  {
+    std::cerr << usage;
+    return 1;
+  }
+
+  if (options.help)
+  {
+    std::cout << usage;
+    return 0;
+  }
+
+  ThreadPool threadPool(options.threads);
+
+  std::vector<BenchResult> results;
+  for (std::size_t resolution : options.resolutions)
+  {
+    for (std::size_t numCascades : options.cascades)
+    {
+      std::cerr << "Running " << resolution << "x" << resolution << " with " << numCascades
+                << " cascade(s)..." << std::endl;
+      results.push_back(RunConfiguration(threadPool, options, resolution, numCascades));
+    }
+  }
+
+  if (options.output.empty())
+  {
+    WriteJSON(std::cout, options, threadPool.GetNumThreads(), results);
+  }
+  else
+  {
+    std::ofstream file(options.output);
+    WriteJSON(file, options, threadPool.GetNumThreads(), results);
+  }
+}
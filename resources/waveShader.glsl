@@ -12,11 +12,19 @@ layout(std140, binding = 0) uniform rendererData
   float pushConstantsDummy; // Ensure 16-byte alignment
 };
 
+// The most cascades that we can combine. This must match maxCascades in Renderer.h.
+#define MAX_CASCADES 4
+
+struct Cascade
+{
+  float planeSize;         // The size of the plane that this cascade simulates
+  float displacementScale; // The displacement scale of this cascade
+};
+
 layout(std140, binding = 1) uniform wavesData
 {
   // Simulation Data
-  vec4 planeSize;         // The size of each simulation
-  vec4 displacementScale; // The scale of each simulation's displacement
+  Cascade cascades[MAX_CASCADES]; // The planes that make up our water
 
   // Rendering Data
   vec4 waveColor;        // The color of the water
@@ -29,12 +37,18 @@ layout(std140, binding = 1) uniform wavesData
   float fogBegin;        // The nearest position that the fog begins
   float near;            // The near camera clipping plane
   float far;             // The far camera clipping plane
+  int numCascades;       // The number of cascades in use
+  float gridResolution;  // The number of quads along the edge of each patch
+  float morphStart;      // The fraction of a patch's morph distance where it begins to morph
 };
 
 // Data is tightly packed. Here's how: H, dHdx, dHdz, Dx, Dz, dDxdx, dDzdz, dDxdz
-layout(binding = 0) uniform sampler2D heightMap[3];
-layout(binding = 3) uniform sampler2D displacementMap[3];
-layout(binding = 6) uniform sampler2D jacobianMap[3];
+layout(binding = 0) uniform sampler2D heightMap[MAX_CASCADES];
+layout(binding = MAX_CASCADES) uniform sampler2D displacementMap[MAX_CASCADES];
+
+// The slopes, the jacobian, and the squared length of the slopes, with mips for the distance. We
+// only shade with the slopes, and the jacobian is there for foam.
+layout(binding = 2 * MAX_CASCADES) uniform sampler2D slopeMap[MAX_CASCADES];
 
 #define DEGREE_TO_RADIANS 0.0174533
 
@@ -64,49 +78,57 @@ vec4 SampleSkybox(vec3 direction)
 
 #section type(vertex) name(waveVertex)
 
-layout(location = 0) in vec3 a_Pos;
+// The most patches in a draw. This must match maxOceanPatches in OceanLOD.h.
+#define MAX_PATCHES 1024
+
+// The patches chosen by OceanLOD. Each one is the XZ origin of the patch, its size, and the
+// distance at which it has fully morphed into the grid of its parent.
+layout(std140, binding = 2) uniform patchData
+{
+  vec4 patches[MAX_PATCHES];
+};
 
 out vec3 v_WorldPos;
 out vec3 v_CameraPos;
 
+// There are no vertex buffers, so the index buffer holds the ID of each vertex in the patch's grid,
+// which we turn back into its position within the patch, in quads.
+vec2 PatchGridPosition(int id)
+{
+  int numEdgeVertices = int(gridResolution) + 1;
+  return vec2(id % numEdgeVertices, id / numEdgeVertices);
+}
+
 void main()
 {
-  // Our approach to tesselation is to make the grid more sparse as we increase our distance.
-  // Since as distance increases, portion of eye spaces decrease inversely, we can invert our
-  // distances to transform our plane into a plane with a roughly constant eye-space density.
-  vec3 pos = a_Pos + vec3(15.0, 0.0, 15.0);
-
-  // This is a funky approach to rotate the plane around the camera. As long as our FOV is less than
-  // 90 degrees, we are good. However, this is pretty performance intensive and takes around 2ms on
-  // my GPU. Ideally, we could use tesselation; however, I like this approach since it works on
-  // metal. If we wanted to get really fancy, we could create a second camera matrix without this
-  // y-axis rotation, and apply the transform on the CPU at startup.
-  vec3 forward = -viewInverse[0].xyz;
-  vec2 turnDir = normalize(forward.xz);
-  float sqrtHalf = 0.70711;
-  turnDir = vec2(turnDir.x - turnDir.y, turnDir.x + turnDir.y);
-  turnDir *= sqrtHalf;
-  pos.xz = vec2(turnDir.x * pos.x - turnDir.y * pos.z, pos.x * turnDir.y + pos.z * turnDir.x);
-
-  // Scale and shift based on the position of the camera.
+  // Every instance is one of the patches, which are smaller the closer they are to the camera.
+  vec4 oceanPatch = patches[gl_InstanceID];
+  vec2 origin = oceanPatch.xy;
+  float quadSize = oceanPatch.z / gridResolution;
+  float morphEnd = oceanPatch.w;
+
+  // Morph the vertex into the grid of the parent patch as it approaches the end of its range. Odd
+  // vertices slide onto their even neighbors, so the seams match the coarser patches beside us.
   vec3 cameraPos = viewInverse[3].xyz;
+  vec2 grid = PatchGridPosition(gl_VertexID);
+  vec2 restPos = origin + grid * quadSize;
+  float cameraDistance = length(vec3(restPos.x, 0.0, restPos.y) - cameraPos);
+  float morph = clamp((cameraDistance / morphEnd - morphStart) / (1.0 - morphStart), 0.0, 1.0);
+  grid -= fract(grid * 0.5) * 2.0 * morph;
 
-  // We scale based on the depth to the camera.
-  pos.xz *= pow(max(length(pos.xz), 1.0), 1.2) * max(cameraPos.y, 10.0) * 0.04;
+  vec3 pos = vec3(0.0);
+  pos.xz = origin + grid * quadSize;
 
-  // Center around the camera.
-  pos.xz += cameraPos.xz;
-
-  // Now we can continue as before.
-  for (int i = 0; i < 3; i++)
+  // Displace the vertex by every cascade.
+  for (int i = 0; i < numCascades; i++)
   {
-    vec2 uv = pos.xz / planeSize[i];
+    vec2 uv = pos.xz / cascades[i].planeSize;
     vec4 data1 = texture(heightMap[i], uv);
     vec4 data2 = texture(displacementMap[i], uv);
 
-    pos.x += displacementScale[i] * data1.w;
+    pos.x += cascades[i].displacementScale * data1.w;
     pos.y += data1.x;
-    pos.z += displacementScale[i] * data2.x;
+    pos.z += cascades[i].displacementScale * data2.x;
   }
   gl_Position = viewProjection * vec4(pos, 1.0);
 
@@ -123,24 +145,17 @@ out vec4 FragColor;
 
 void main()
 {
-  // We calculate the slope of the wave surface at each point to get normal vectors for lighting.
-  vec4 d = vec4(0.0);
-  float jacobian = 0.0;
-  for (int i = 0; i < 3; i++)
+  // The slopes of the cascades add up to the slope of the surface, which gives us its normal. The
+  // mips average the slopes of distant pixels, so the variance of the slopes within the pixel is
+  // what's left of their squared length. The cascades are independent, so their variances add up.
+  vec2 slope = vec2(0.0);
+  float variance = 0.0;
+  for (int i = 0; i < numCascades; i++)
   {
-    vec2 uv = v_WorldPos.xz / planeSize[i];
-    vec4 data1 = texture(heightMap[i], uv);
-    vec4 data2 = texture(displacementMap[i], uv);
-
-    jacobian += texture(jacobianMap[i], uv).r / 3.0;
-
-    // The math for this is whacky.
-    float f = displacementScale[i];
-    d += vec4(data1.y, data2.y * f, data1.z, data2.z * f);
+    vec4 slopeData = texture(slopeMap[i], v_WorldPos.xz / cascades[i].planeSize);
+    slope += slopeData.xy;
+    variance += max(slopeData.w - dot(slopeData.xy, slopeData.xy), 0.0);
   }
-
-  // Calculate our normal vector by black magic.
-  vec2 slope = vec2(d.x / (1 + d.y), d.z / (1 + d.w));
   vec3 normal = normalize(vec3(-slope.x, 1, -slope.y));
 
   // Calculate the lighting information. This depends on the direction of the light (diffuse), the
@@ -152,7 +167,11 @@ void main()
   // Our intensity is the combination of these factors
   float ambient = 0.5;
   float diffuse = max(dot(normal, -lightDir), 0) * 0.3;
-  float specular = pow(max(dot(reflectionDir, -lightDir), 0), 32) * 0.5;
+  // Where the slopes vary within a pixel, the highlight is spread over all of them rather than
+  // flickering between them, which roughly keeps its energy and stops the horizon from shimmering.
+  float shininess = 32.0 / (1.0 + 32.0 * variance);
+  float specular = pow(max(dot(reflectionDir, -lightDir), 0), shininess) * 0.5;
+  specular *= (shininess + 2.0) / 34.0;
   float scatter = max(v_WorldPos.y * 0.1, 0.0);
   float light = diffuse + ambient + specular;
 
@@ -162,55 +181,22 @@ void main()
   FragColor = vec4(color, 1.0);
 }
 
-#section type(vertex) name(skyVertex)
-
-layout(location = 0) in vec3 a_Pos;
-
-out vec3 texCoord;
-
-void main()
-{
-  // Send the texture coordinate to the fragment shader to sample skybox.
-  texCoord = a_Pos;
-
-  // Remove the translation component from the view matrix.
-  mat4 noTranslateView = mat4(mat3(view));
-
-  // Project and place the depth in normalized coords as far as possible.
-  vec4 pos = projection * noTranslateView * vec4(a_Pos, 1.0);
-  gl_Position = pos.xyww;
-}
-
-#section type(fragment) name(skyFragment)
-
-in vec3 texCoord;
-
-out vec4 FragColor;
-
-void main()
-{
-  FragColor = SampleSkybox(texCoord);
-}
-
 #section type(vertex) name(postVertex)
 
-layout(location = 0) in vec3 a_Pos;
-layout(location = 3) in vec2 a_UV;
-
 out vec2 v_UV;
 
 void main()
 {
-  gl_Position = vec4(a_Pos, 1.0);
-  v_UV = a_UV;
+  // A single triangle covers the screen, with its corners at (0, 0), (2, 0) and (0, 2) in UVs.
+  v_UV = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  gl_Position = vec4(v_UV * 2.0 - 1.0, 0.0, 1.0);
 }
 
 #section type(fragment) name(postFragment)
 
 // We use a later binding so that we can still have the other textures declared in common section.
-layout(binding = 9) uniform sampler2D colorTexture;
-layout(binding = 10) uniform sampler2D depthTexture;
-layout(binding = 11) uniform sampler2D skyboxColor;
+layout(binding = 3 * MAX_CASCADES) uniform sampler2D colorTexture;
+layout(binding = 3 * MAX_CASCADES + 1) uniform sampler2D depthTexture;
 
 in vec2 v_UV;
 
@@ -218,17 +204,30 @@ out vec4 FragColor;
 
 void main()
 {
+  // Rebuild the ray from the camera through this pixel, so that we can evaluate the sky behind it.
+  // For a perspective projection, only the diagonal scales the ray.
+  vec2 ndc = v_UV * 2.0 - 1.0;
+  vec3 viewRay = vec3(ndc.x / projection[0][0], ndc.y / projection[1][1], -1.0);
+  vec4 skyboxColor = SampleSkybox(mat3(viewInverse) * viewRay);
+
+  // Nothing was drawn where the depth is still cleared, so we only see the sky there.
+  float depth = texture(depthTexture, v_UV).r;
+  if (depth >= 1.0)
+  {
+    FragColor = vec4(skyboxColor.rgb, 1.0);
+    return;
+  }
+
   // Compute the color of the fragment by blending sky and waves based on distance.
   vec4 color = vec4(texture(colorTexture, v_UV).rgb, 1.0);
-  float depth = texture(depthTexture, v_UV).r;
 
   // Use some math to undistort the depth buffer which is messed up by projection matrix.
-  float ndc = 2.0 * depth - 1.0;
-  float linearDepth = (2.0 * near * far) / (far + near - ndc * (far - near));
+  float ndcDepth = 2.0 * depth - 1.0;
+  float linearDepth = (2.0 * near * far) / (far + near - ndcDepth * (far - near));
 
   // We cull the fog if it is closer than the starting point.
   float fogDensity = 0.0025;
   float fogFactor = max(1.0 - exp(-(linearDepth - fogBegin) * fogDensity), 0.0);
 
-  FragColor = vec4(mix(color, texture(skyboxColor, v_UV), fogFactor).rgb, 1.0);
-}
\ No newline at end of file
+  FragColor = vec4(mix(color, skyboxColor, fogFactor).rgb, 1.0);
+}
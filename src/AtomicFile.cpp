@@ -0,0 +1,97 @@
+#include "AtomicFile.h"
+
+#include <iostream>
+#include <sstream>
+
+namespace Waves
+{
+
+AtomicFileWriter::~AtomicFileWriter()
+{
+  Abandon();
+}
+
+bool AtomicFileWriter::Open(const std::filesystem::path& filePath, const FileHeader& header)
+{
+  Abandon();
+
+  path = filePath;
+  tempPath = path;
+  tempPath += ".tmp";
+
+  std::error_code error;
+  if (path.has_parent_path())
+    std::filesystem::create_directories(path.parent_path(), error);
+
+  file.open(tempPath, std::ios::binary | std::ios::trunc);
+  if (!file)
+  {
+    std::cerr << "Failed to write " << tempPath.string() << std::endl;
+    return false;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(FileHeader));
+  return static_cast<bool>(file);
+}
+
+bool AtomicFileWriter::Commit()
+{
+  if (!file.is_open())
+    return false;
+
+  // Closing flushes the stream, which may fail too.
+  file.close();
+  std::error_code error;
+  if (!file.fail())
+    std::filesystem::rename(tempPath, path, error);
+
+  if (file.fail() || error)
+  {
+    std::cerr << "Failed to write " << path.string() << std::endl;
+    std::filesystem::remove(tempPath, error);
+    return false;
+  }
+
+  return true;
+}
+
+void AtomicFileWriter::Abandon()
+{
+  if (!file.is_open())
+    return;
+
+  file.close();
+  std::error_code error;
+  std::filesystem::remove(tempPath, error);
+}
+
+bool WriteFileAtomic(const std::filesystem::path& path, const FileHeader& header,
+                     std::string_view payload)
+{
+  AtomicFileWriter writer;
+  if (!writer.Open(path, header))
+    return false;
+
+  writer.GetStream().write(payload.data(), payload.size());
+  return writer.Commit();
+}
+
+bool ReadFileChecked(const std::filesystem::path& path, const FileHeader& header,
+                     std::string& payload)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+
+  FileHeader fileHeader;
+  file.read(reinterpret_cast<char*>(&fileHeader), sizeof(FileHeader));
+  if (!file || fileHeader != header)
+    return false;
+
+  std::stringstream contents;
+  contents << file.rdbuf();
+  payload = contents.str();
+  return true;
+}
+
+} // namespace Waves
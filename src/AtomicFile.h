@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+namespace Waves
+{
+
+// Every file that we write starts with a magic number, which tells our kinds of files apart, and a
+// version, which is bumped whenever what's in the file changes. Files with another header are
+// ignored like missing ones.
+struct FileHeader
+{
+  uint32_t magic = 0;
+  uint32_t version = 0;
+
+  bool operator==(const FileHeader&) const = default;
+};
+
+// Writes a file to path + ".tmp", then renames it over the path once it's complete, so that no
+// reader ever sees a partially written file. The header is written on opening, and the rest is
+// streamed after it. A file that isn't committed is removed.
+class AtomicFileWriter
+{
+public:
+  AtomicFileWriter() = default;
+  ~AtomicFileWriter();
+
+  AtomicFileWriter(const AtomicFileWriter&) = delete;
+  AtomicFileWriter& operator=(const AtomicFileWriter&) = delete;
+
+  bool Open(const std::filesystem::path& path, const FileHeader& header);
+  std::ofstream& GetStream() { return file; }
+
+  // Moves the file into place if all of it was written. Returns false, and removes it, otherwise.
+  bool Commit();
+  void Abandon();
+
+private:
+  std::filesystem::path path;
+  std::filesystem::path tempPath;
+  std::ofstream file;
+};
+
+// Writes the header followed by the payload in one go.
+bool WriteFileAtomic(const std::filesystem::path& path, const FileHeader& header,
+                     std::string_view payload);
+
+// Reads everything after the header of a file that was written with it. Returns false if the file
+// is missing, or starts with another header.
+bool ReadFileChecked(const std::filesystem::path& path, const FileHeader& header,
+                     std::string& payload);
+
+// Appends count values to a payload, byte for byte.
+template <typename T>
+void AppendBytes(std::string& payload, const T* values, std::size_t count = 1)
+{
+  payload.append(reinterpret_cast<const char*>(values), count * sizeof(T));
+}
+
+// Reads count values from the front of a payload, and removes them. Returns false without reading
+// anything if the payload is too short, like when the file was truncated.
+template <typename T>
+bool ConsumeBytes(std::string_view& payload, T* values, std::size_t count = 1)
+{
+  if (payload.size() / sizeof(T) < count)
+    return false;
+
+  std::memcpy(values, payload.data(), count * sizeof(T));
+  payload.remove_prefix(count * sizeof(T));
+  return true;
+}
+
+} // namespace Waves
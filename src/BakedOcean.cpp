@@ -0,0 +1,317 @@
+#include "BakedOcean.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/packing.hpp>
+#include <iostream>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Waves
+{
+
+namespace
+{
+
+// Bump the version whenever the layout of the file changes.
+constexpr FileHeader bakedFileHeader = {0x4B414257, 3}; // "WBAK"
+
+// The frames start on a page boundary, and every map within them on a cache line.
+constexpr std::size_t pageAlignment = 4096;
+constexpr std::size_t mapAlignment = 64;
+
+// Follows the file header.
+struct BakedHeader
+{
+  uint32_t numCascades = 0;
+  uint32_t numFrames = 0;
+  float repeatPeriod = 0.0f;
+  uint32_t padding = 0;
+  uint64_t dataOffset = 0; // The offset of the first frame from the start of the file.
+  uint64_t frameSize = 0;  // The size of a frame, including the maps of every cascade.
+};
+
+// Follows the header once for each cascade.
+struct BakedCascadeHeader
+{
+  uint32_t textureSize = 0;
+  float planeSize = 0.0f;
+  float displacement = 0.0f;
+  uint32_t padding = 0;
+  uint64_t offset = 0; // The offset of this cascade's maps within a frame.
+};
+
+std::size_t AlignUp(std::size_t value, std::size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Each texel holds four half floats.
+constexpr std::size_t texelSize = 4 * sizeof(uint16_t);
+
+// The height and displacement maps. The renderer resolves the jacobian from them into the slope
+// map, like it does when simulating, so we don't store it.
+std::size_t GetCascadeSize(std::size_t textureSize)
+{
+  std::size_t numTexels = textureSize * textureSize;
+  return AlignUp(numTexels * 2 * texelSize, mapAlignment);
+}
+
+} // namespace
+
+BakedOcean::~BakedOcean()
+{
+  Close();
+}
+
+bool BakedOcean::Open(const std::string& path)
+{
+  Close();
+
+#if defined(_WIN32)
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+    return false;
+
+  LARGE_INTEGER fileSize;
+  HANDLE mapping = nullptr;
+  if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0)
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+  // The view keeps the mapping alive, so we don't need the handles once it exists.
+  if (mapping)
+  {
+    data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    size = static_cast<std::size_t>(fileSize.QuadPart);
+    CloseHandle(mapping);
+  }
+  CloseHandle(file);
+#else
+  int file = open(path.c_str(), O_RDONLY);
+  if (file < 0)
+    return false;
+
+  // The mapping stays valid once the file is closed.
+  struct stat status;
+  if (fstat(file, &status) == 0 && status.st_size > 0)
+  {
+    void* view = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (view != MAP_FAILED)
+    {
+      data = static_cast<const unsigned char*>(view);
+      size = static_cast<std::size_t>(status.st_size);
+    }
+  }
+  close(file);
+#endif
+
+  if (!data)
+    return false;
+
+  // Only the headers are read here, and the frames stay on disk until they're played.
+  FileHeader fileHeader;
+  BakedHeader header;
+  std::size_t headerEnd = sizeof(FileHeader) + sizeof(BakedHeader);
+  if (size < headerEnd)
+  {
+    Close();
+    return false;
+  }
+
+  std::memcpy(&fileHeader, data, sizeof(FileHeader));
+  std::memcpy(&header, data + sizeof(FileHeader), sizeof(BakedHeader));
+  std::size_t tableEnd = headerEnd + header.numCascades * sizeof(BakedCascadeHeader);
+  if (fileHeader != bakedFileHeader || header.numCascades == 0 || header.numFrames == 0 ||
+      header.repeatPeriod <= 0.0f || header.dataOffset < tableEnd ||
+      header.dataOffset % pageAlignment != 0 || header.dataOffset > size ||
+      header.frameSize > (size - header.dataOffset) / header.numFrames)
+  {
+    Close();
+    return false;
+  }
+
+  for (uint32_t i = 0; i < header.numCascades; i++)
+  {
+    BakedCascadeHeader cascadeHeader;
+    std::memcpy(&cascadeHeader, data + headerEnd + i * sizeof(BakedCascadeHeader),
+                sizeof(BakedCascadeHeader));
+
+    std::size_t cascadeSize = GetCascadeSize(cascadeHeader.textureSize);
+    if (cascadeHeader.textureSize == 0 || cascadeHeader.offset % mapAlignment != 0 ||
+        cascadeHeader.offset + cascadeSize > header.frameSize)
+    {
+      Close();
+      return false;
+    }
+
+    BakedCascade cascade;
+    cascade.textureSize = cascadeHeader.textureSize;
+    cascade.planeSize = cascadeHeader.planeSize;
+    cascade.displacement = cascadeHeader.displacement;
+    cascades.push_back(cascade);
+    cascadeOffsets.push_back(cascadeHeader.offset);
+  }
+
+  numFrames = header.numFrames;
+  repeatPeriod = header.repeatPeriod;
+  dataOffset = header.dataOffset;
+  frameSize = header.frameSize;
+  return true;
+}
+
+void BakedOcean::Close()
+{
+  if (data)
+  {
+#if defined(_WIN32)
+    UnmapViewOfFile(data);
+#else
+    munmap(const_cast<unsigned char*>(data), size);
+#endif
+  }
+
+  data = nullptr;
+  size = 0;
+  cascades.clear();
+  cascadeOffsets.clear();
+  numFrames = 0;
+}
+
+BakedFrameBlend BakedOcean::GetFramesAtTime(float time) const
+{
+  float phase = std::fmod(time / repeatPeriod, 1.0f);
+  if (phase < 0.0f)
+    phase += 1.0f;
+
+  float position = phase * static_cast<float>(numFrames);
+  BakedFrameBlend frames;
+  frames.previous = std::min(static_cast<std::size_t>(position), numFrames - 1);
+  frames.next = (frames.previous + 1) % numFrames;
+  frames.blend = std::clamp(position - static_cast<float>(frames.previous), 0.0f, 1.0f);
+  return frames;
+}
+
+BakedFrame BakedOcean::GetFrame(std::size_t cascade, std::size_t frame) const
+{
+  std::size_t numTexels = cascades[cascade].textureSize * cascades[cascade].textureSize;
+  const unsigned char* maps = data + dataOffset + frame * frameSize + cascadeOffsets[cascade];
+
+  BakedFrame bakedFrame;
+  bakedFrame.heightMap = reinterpret_cast<const uint16_t*>(maps);
+  bakedFrame.displacementMap = bakedFrame.heightMap + numTexels * 4;
+  return bakedFrame;
+}
+
+void BakedOcean::Prefetch(std::size_t frame) const
+{
+#if !defined(_WIN32)
+  // Frames start on page boundaries, which madvise requires.
+  const unsigned char* start = data + dataOffset + frame * frameSize;
+  madvise(const_cast<unsigned char*>(start), frameSize, MADV_WILLNEED);
+#else
+  // Windows reads ahead of sequential page faults on its own, which is good enough since frames
+  // are stored in the order that they're played.
+  (void)frame;
+#endif
+}
+
+bool BakedOceanWriter::Open(const std::string& filePath,
+                            std::span<const BakedCascade> bakedCascades, std::size_t frameCount,
+                            float period)
+{
+  path = filePath;
+  cascades.assign(bakedCascades.begin(), bakedCascades.end());
+  numFrames = frameCount;
+  numWritten = 0;
+
+  // The file only replaces the path once it's complete, so a player never maps part of one.
+  if (!file.Open(path, bakedFileHeader))
+    return false;
+
+  std::vector<BakedCascadeHeader> cascadeHeaders;
+  std::size_t frameSize = 0;
+  for (const BakedCascade& cascade : cascades)
+  {
+    BakedCascadeHeader cascadeHeader;
+    cascadeHeader.textureSize = static_cast<uint32_t>(cascade.textureSize);
+    cascadeHeader.planeSize = cascade.planeSize;
+    cascadeHeader.displacement = cascade.displacement;
+    cascadeHeader.offset = frameSize;
+    cascadeHeaders.push_back(cascadeHeader);
+
+    frameSize += GetCascadeSize(cascade.textureSize);
+  }
+
+  // Frames are a multiple of the page size, so that each one can be prefetched on its own.
+  BakedHeader header;
+  header.numCascades = static_cast<uint32_t>(cascades.size());
+  header.numFrames = static_cast<uint32_t>(numFrames);
+  header.repeatPeriod = period;
+  header.dataOffset = AlignUp(sizeof(FileHeader) + sizeof(BakedHeader) +
+                              cascadeHeaders.size() * sizeof(BakedCascadeHeader), pageAlignment);
+  header.frameSize = AlignUp(frameSize, pageAlignment);
+
+  std::ofstream& stream = file.GetStream();
+  stream.write(reinterpret_cast<const char*>(&header), sizeof(BakedHeader));
+  stream.write(reinterpret_cast<const char*>(cascadeHeaders.data()),
+               cascadeHeaders.size() * sizeof(BakedCascadeHeader));
+  stream.seekp(header.dataOffset);
+  return static_cast<bool>(stream);
+}
+
+void BakedOceanWriter::WriteCascade(const glm::vec4* heightMap, const glm::vec4* displacementMap)
+{
+  const BakedCascade& cascade = cascades[numWritten % cascades.size()];
+  std::size_t numTexels = cascade.textureSize * cascade.textureSize;
+  std::ofstream& stream = file.GetStream();
+  halfMap.resize(numTexels * 4);
+  for (const glm::vec4* map : {heightMap, displacementMap})
+  {
+    for (std::size_t texel = 0; texel < numTexels; texel++)
+    {
+      for (int channel = 0; channel < 4; channel++)
+        halfMap[texel * 4 + channel] = glm::packHalf1x16(map[texel][channel]);
+    }
+    stream.write(reinterpret_cast<const char*>(halfMap.data()), numTexels * texelSize);
+  }
+
+  // Pad the maps out to the next cascade, and the last cascade out to the next frame.
+  std::size_t padding = GetCascadeSize(cascade.textureSize) - numTexels * 2 * texelSize;
+  numWritten++;
+  if (numWritten % cascades.size() == 0)
+  {
+    std::size_t frameSize = 0;
+    for (const BakedCascade& bakedCascade : cascades)
+      frameSize += GetCascadeSize(bakedCascade.textureSize);
+
+    padding += AlignUp(frameSize, pageAlignment) - frameSize;
+  }
+
+  static const char zeros[pageAlignment + mapAlignment] = {};
+  stream.write(zeros, padding);
+}
+
+bool BakedOceanWriter::Close()
+{
+  if (numWritten != numFrames * cascades.size())
+  {
+    std::cerr << "Failed to write baked ocean " << path << std::endl;
+    file.Abandon();
+    return false;
+  }
+
+  return file.Commit();
+}
+
+} // namespace Waves
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "AtomicFile.h"
+
+namespace Waves
+{
+
+// How one cascade of a baked ocean was simulated. The renderer needs the plane size and the
+// displacement to draw the maps like it would draw the live simulation.
+struct BakedCascade
+{
+  std::size_t textureSize = 0;
+  float planeSize = 0.0f;
+  float displacement = 0.0f;
+};
+
+// The maps of one cascade at one frame, laid out like the generator's textures but with four half
+// floats to a texel, which is how playback uploads them.
+struct BakedFrame
+{
+  const uint16_t* heightMap = nullptr;       // h, dh/dx, dh/dz, Dx
+  const uint16_t* displacementMap = nullptr; // Dz, dDx/dx, dDz/dz, dDx/dz
+};
+
+// The two frames either side of a time, and how far the time is from the first to the second.
+struct BakedFrameBlend
+{
+  std::size_t previous = 0;
+  std::size_t next = 0;
+  float blend = 0.0f;
+};
+
+// A baked ocean is a loop of frames that were simulated ahead of time with a repeat period, so
+// that the last frame flows back into the first. The file is a small header followed by the
+// frames in the order that they're played, where each frame holds the maps of every cascade back
+// to back. The maps are stored in half precision, which halves the size of the file and of every
+// upload. That's also the format of the textures that they're uploaded to, so playback never
+// decodes anything.
+//
+// The file is memory mapped rather than read, so opening it is instant regardless of its size, and
+// the OS only reads each frame from disk when it's first played.
+class BakedOcean
+{
+public:
+  BakedOcean() = default;
+  ~BakedOcean();
+
+  BakedOcean(const BakedOcean&) = delete;
+  BakedOcean& operator=(const BakedOcean&) = delete;
+
+  // Maps a baked ocean file. Returns false if it can't be read or was written by another version.
+  bool Open(const std::string& path);
+  void Close();
+  bool IsOpen() const { return data != nullptr; }
+
+  std::size_t GetNumCascades() const { return cascades.size(); }
+  const BakedCascade& GetCascade(std::size_t index) const { return cascades[index]; }
+  std::size_t GetNumFrames() const { return numFrames; }
+  float GetRepeatPeriod() const { return repeatPeriod; }
+
+  // The frames that are blended at a time, which wraps around the repeat period. The last frame
+  // blends back into the first.
+  BakedFrameBlend GetFramesAtTime(float time) const;
+
+  // The maps of a cascade at a frame. These point directly into the mapped file.
+  BakedFrame GetFrame(std::size_t cascade, std::size_t frame) const;
+
+  // Asks the OS to start reading a frame from disk, so that it's resident by the time we play it.
+  void Prefetch(std::size_t frame) const;
+
+private:
+  const unsigned char* data = nullptr;
+  std::size_t size = 0;
+
+  std::vector<BakedCascade> cascades;
+  std::vector<std::size_t> cascadeOffsets; // The offset of each cascade within a frame.
+  std::size_t numFrames = 0;
+  float repeatPeriod = 0.0f;
+  std::size_t dataOffset = 0;
+  std::size_t frameSize = 0;
+};
+
+// Writes the files that BakedOcean plays. Frames must be written in order, and each frame must
+// write every cascade in order.
+class BakedOceanWriter
+{
+public:
+  bool Open(const std::string& path, std::span<const BakedCascade> cascades, std::size_t numFrames,
+            float repeatPeriod);
+
+  // Appends the maps of the next cascade, which are laid out like the generator's textures. They're
+  // rounded to half precision as they're written.
+  void WriteCascade(const glm::vec4* heightMap, const glm::vec4* displacementMap);
+
+  // Finishes the file. Returns false if any of it couldn't be written, in which case the file
+  // isn't created.
+  bool Close();
+
+private:
+  std::string path;
+  AtomicFileWriter file;
+
+  std::vector<BakedCascade> cascades;
+  std::size_t numFrames = 0;
+  std::size_t numWritten = 0; // The number of cascades written across every frame.
+  std::vector<uint16_t> halfMap;
+};
+
+} // namespace Waves
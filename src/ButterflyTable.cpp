@@ -0,0 +1,73 @@
+#include "ButterflyTable.h"
+
+#include <bit>
+#include <cmath>
+
+#include <glm/gtc/constants.hpp>
+
+namespace Waves
+{
+
+std::vector<std::size_t> GetFFTRadices(std::size_t textureSize)
+{
+  // The low frequencies are swapped to the edges by half of the size, so it must be even.
+  if (textureSize < 2 || textureSize % 2 != 0)
+    return {};
+
+  std::vector<std::size_t> radices;
+  std::size_t remaining = textureSize;
+  if (std::has_single_bit(textureSize))
+  {
+    for (; remaining > 1; remaining /= 2)
+      radices.push_back(2);
+    return radices;
+  }
+
+  for (std::size_t radix : {4, 2, 3, 5})
+  {
+    for (; remaining % radix == 0; remaining /= radix)
+      radices.push_back(radix);
+  }
+
+  if (remaining != 1)
+    return {};
+
+  return radices;
+}
+
+std::vector<glm::vec4> BuildButterflyTable(std::size_t textureSize)
+{
+  std::vector<std::size_t> radices = GetFFTRadices(textureSize);
+  std::size_t numColumns = textureSize / 2;
+
+  std::vector<glm::vec4> table(numColumns * radices.size());
+  std::size_t stride = 1; // The length of the DFTs that each stage combines.
+  for (std::size_t stage = 0; stage < radices.size(); stage++)
+  {
+    std::size_t radix = radices[stage];
+    std::size_t numButterflies = textureSize / radix;
+    for (std::size_t thread = 0; thread < numButterflies; thread++)
+    {
+      // Each DFT in this stage requires stride threads, and each thread combines one element from
+      // each of the radix DFTs of the previous stage.
+      std::size_t dftNum = thread / stride;
+      std::size_t dftElement = thread % stride;
+      std::size_t firstIndex = dftNum * stride * radix + dftElement;
+
+      // Compute the twiddle in double precision since this only happens once. The angle is
+      // positive because we compute inverse transforms.
+      double angle = 2.0 * glm::pi<double>() * static_cast<double>(dftElement) /
+                     static_cast<double>(stride * radix);
+
+      table[stage * numColumns + thread] =
+          glm::vec4(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)),
+                    static_cast<float>(firstIndex), static_cast<float>(stride));
+    }
+
+    stride *= radix;
+  }
+
+  return table;
+}
+
+} // namespace Waves
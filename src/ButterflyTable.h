@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace Waves
+{
+
+// The radix of each stage of our FFTs for a size, which must be even with no prime factors other
+// than 2, 3, and 5, like 384 = 2^7 * 3 or 640 = 2^7 * 5. Powers of two keep to radix-2 stages,
+// which the multi-pass mode relies on after bit-reversing. Other sizes take radix-4 stages wherever
+// they can, since every stage costs a barrier or a dispatch. Returns nothing for any other size.
+std::vector<std::size_t> GetFFTRadices(std::size_t textureSize);
+
+inline bool IsFFTSizeSupported(std::size_t textureSize)
+{
+  return !GetFFTRadices(textureSize).empty();
+}
+
+// The radix-2 kernel of the GPU's multi-pass mode runs a workgroup of textureSize / 2 threads for
+// each line, and OpenGL only guarantees 1024 of them, so FFTCalculator stops at twice that. The CPU
+// has no such limit, so anything that's played back on the GPU, like a bake, must check this too.
+constexpr std::size_t maxGPUFFTSize = 2048;
+
+inline bool IsGPUFFTSizeSupported(std::size_t textureSize)
+{
+  return textureSize <= maxGPUFFTSize && IsFFTSizeSupported(textureSize);
+}
+
+// Builds the table of butterflies that our FFTs perform, so that no twiddle factors or indices need
+// to be computed while transforming. The table has textureSize / 2 columns, one for each butterfly
+// in a radix-2 stage, and one row for each stage. A stage of radix r only uses the first
+// textureSize / r columns. Each entry is laid out as:
+//   xy = twiddle factor (cos, sin), z = first output index, w = distance between the outputs
+// Butterfly j of a radix-r stage reads the r elements textureSize / r apart starting at j,
+// multiplies each by the twiddle to the power of its position, performs an inverse DFT of length r
+// on them, and writes the results from z onwards. This is the Stockham formulation, which sorts the
+// output into natural order as it goes. For radix-2 stages, z and z + w are also the even and odd
+// indices of the Cooley-Tukey passes after bit-reversal. The GPU uploads this as a texture and the
+// CPU reads it directly, so both use exactly the same factors.
+std::vector<glm::vec4> BuildButterflyTable(std::size_t textureSize);
+
+} // namespace Waves
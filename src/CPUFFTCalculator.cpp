@@ -0,0 +1,423 @@
+#include "CPUFFTCalculator.h"
+
+#include "ButterflyTable.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#if defined(__AVX__) || defined(__SSE3__)
+#include <immintrin.h>
+#endif
+
+namespace Waves
+{
+
+namespace
+{
+
+// Multiplies both complex numbers in the odd texel by the twiddle factor, then combines it with the
+// even texel. This is exactly the butterfly from the fft kernel.
+inline void Butterfly(glm::vec4* even, glm::vec4* odd, glm::vec2 twiddle)
+{
+#if defined(__SSE3__) || defined(__AVX__)
+  __m128 e = _mm_loadu_ps(&even->x);
+  __m128 o = _mm_loadu_ps(&odd->x);
+
+  // (x + iy)(a + ib) = (xa - yb) + i(ya + xb), which addsub gives us from (x, y) and (y, x).
+  __m128 swapped = _mm_shuffle_ps(o, o, _MM_SHUFFLE(2, 3, 0, 1));
+  __m128 product = _mm_addsub_ps(_mm_mul_ps(o, _mm_set1_ps(twiddle.x)),
+                                 _mm_mul_ps(swapped, _mm_set1_ps(twiddle.y)));
+
+  _mm_storeu_ps(&even->x, _mm_add_ps(e, product));
+  _mm_storeu_ps(&odd->x, _mm_sub_ps(e, product));
+#else
+  glm::vec4 o = *odd;
+  glm::vec4 product =
+      glm::vec4(o.x * twiddle.x - o.y * twiddle.y, o.x * twiddle.y + o.y * twiddle.x,
+                o.z * twiddle.x - o.w * twiddle.y, o.z * twiddle.y + o.w * twiddle.x);
+
+  *odd = *even - product;
+  *even = *even + product;
+#endif
+}
+
+// Performs the butterflies for two adjacent texels, which each have their own twiddle factor.
+inline void ButterflyPair(glm::vec4* even, glm::vec4* odd, glm::vec2 twiddle0, glm::vec2 twiddle1)
+{
+#if defined(__AVX__)
+  __m256 e = _mm256_loadu_ps(&even->x);
+  __m256 o = _mm256_loadu_ps(&odd->x);
+
+  __m256 real = _mm256_setr_m128(_mm_set1_ps(twiddle0.x), _mm_set1_ps(twiddle1.x));
+  __m256 imag = _mm256_setr_m128(_mm_set1_ps(twiddle0.y), _mm_set1_ps(twiddle1.y));
+
+  __m256 swapped = _mm256_permute_ps(o, _MM_SHUFFLE(2, 3, 0, 1));
+  __m256 product = _mm256_addsub_ps(_mm256_mul_ps(o, real), _mm256_mul_ps(swapped, imag));
+
+  _mm256_storeu_ps(&even->x, _mm256_add_ps(e, product));
+  _mm256_storeu_ps(&odd->x, _mm256_sub_ps(e, product));
+#else
+  Butterfly(even, odd, twiddle0);
+  Butterfly(even + 1, odd + 1, twiddle1);
+#endif
+}
+
+// Performs the butterflies for a run of texels which all share one twiddle factor. This is the case
+// for every column in a vertical pass.
+inline void ButterflySpan(glm::vec4* even, glm::vec4* odd, std::size_t count, glm::vec2 twiddle)
+{
+  std::size_t i = 0;
+
+#if defined(__AVX__)
+  __m256 real = _mm256_set1_ps(twiddle.x);
+  __m256 imag = _mm256_set1_ps(twiddle.y);
+  for (; i + 2 <= count; i += 2)
+  {
+    __m256 e = _mm256_loadu_ps(&even[i].x);
+    __m256 o = _mm256_loadu_ps(&odd[i].x);
+
+    __m256 swapped = _mm256_permute_ps(o, _MM_SHUFFLE(2, 3, 0, 1));
+    __m256 product = _mm256_addsub_ps(_mm256_mul_ps(o, real), _mm256_mul_ps(swapped, imag));
+
+    _mm256_storeu_ps(&even[i].x, _mm256_add_ps(e, product));
+    _mm256_storeu_ps(&odd[i].x, _mm256_sub_ps(e, product));
+  }
+#endif
+
+  for (; i < count; i++)
+    Butterfly(even + i, odd + i, twiddle);
+}
+
+// The cosines and sines of 2 pi / 3, 2 pi / 5, and 4 pi / 5, for the radix-3 and radix-5 DFTs.
+constexpr float sin120 = 0.8660254037844386f;
+constexpr float cos72 = 0.30901699437494745f;
+constexpr float sin72 = 0.9510565162951535f;
+constexpr float cos144 = -0.8090169943749475f;
+constexpr float sin144 = 0.5877852522924731f;
+
+// A texel for the mixed radix stages, kept in a vector register where we have one.
+#if defined(__SSE3__) || defined(__AVX__)
+struct Texel
+{
+  __m128 v;
+};
+
+inline Texel Load(const glm::vec4* texel) { return {_mm_loadu_ps(&texel->x)}; }
+inline void Store(glm::vec4* texel, Texel value) { _mm_storeu_ps(&texel->x, value.v); }
+inline Texel operator+(Texel a, Texel b) { return {_mm_add_ps(a.v, b.v)}; }
+inline Texel operator-(Texel a, Texel b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline Texel operator*(Texel a, float b) { return {_mm_mul_ps(a.v, _mm_set1_ps(b))}; }
+
+// Multiplies both complex numbers in the texel by the factor, like Butterfly does.
+inline Texel ComplexMultiply(Texel value, glm::vec2 factor)
+{
+  __m128 swapped = _mm_shuffle_ps(value.v, value.v, _MM_SHUFFLE(2, 3, 0, 1));
+  return {_mm_addsub_ps(_mm_mul_ps(value.v, _mm_set1_ps(factor.x)),
+                        _mm_mul_ps(swapped, _mm_set1_ps(factor.y)))};
+}
+
+// Multiplies both complex numbers in the texel by i, which swaps their parts and negates the
+// new real parts.
+inline Texel MultiplyByI(Texel value)
+{
+  __m128 swapped = _mm_shuffle_ps(value.v, value.v, _MM_SHUFFLE(2, 3, 0, 1));
+  return {_mm_xor_ps(swapped, _mm_setr_ps(-0.0f, 0.0f, -0.0f, 0.0f))};
+}
+#else
+struct Texel
+{
+  glm::vec4 v;
+};
+
+inline Texel Load(const glm::vec4* texel) { return {*texel}; }
+inline void Store(glm::vec4* texel, Texel value) { *texel = value.v; }
+inline Texel operator+(Texel a, Texel b) { return {a.v + b.v}; }
+inline Texel operator-(Texel a, Texel b) { return {a.v - b.v}; }
+inline Texel operator*(Texel a, float b) { return {a.v * b}; }
+
+inline Texel ComplexMultiply(Texel value, glm::vec2 factor)
+{
+  glm::vec4 v = value.v;
+  return {glm::vec4(v.x * factor.x - v.y * factor.y, v.y * factor.x + v.x * factor.y,
+                    v.z * factor.x - v.w * factor.y, v.w * factor.x + v.z * factor.y)};
+}
+
+inline Texel MultiplyByI(Texel value)
+{
+  return {glm::vec4(-value.v.y, value.v.x, -value.v.w, value.v.z)};
+}
+#endif
+
+// Performs an inverse DFT of length Radix on the texels in place. Each radix is written out so that
+// nothing is multiplied by the trivial roots of unity, exactly like mixedButterfly in the fft
+// kernels.
+template <std::size_t Radix>
+inline void SmallDFT(Texel* v)
+{
+  if constexpr (Radix == 2)
+  {
+    Texel sum = v[0] + v[1];
+    v[1] = v[0] - v[1];
+    v[0] = sum;
+  }
+  else if constexpr (Radix == 3)
+  {
+    Texel sum = v[1] + v[2];
+    Texel difference = MultiplyByI(v[1] - v[2]) * sin120;
+    Texel middle = v[0] - sum * 0.5f;
+    v[0] = v[0] + sum;
+    v[1] = middle + difference;
+    v[2] = middle - difference;
+  }
+  else if constexpr (Radix == 4)
+  {
+    Texel sum02 = v[0] + v[2];
+    Texel difference02 = v[0] - v[2];
+    Texel sum13 = v[1] + v[3];
+    Texel difference13 = MultiplyByI(v[1] - v[3]);
+    v[0] = sum02 + sum13;
+    v[1] = difference02 + difference13;
+    v[2] = sum02 - sum13;
+    v[3] = difference02 - difference13;
+  }
+  else
+  {
+    static_assert(Radix == 5);
+    Texel sum14 = v[1] + v[4];
+    Texel difference14 = MultiplyByI(v[1] - v[4]);
+    Texel sum23 = v[2] + v[3];
+    Texel difference23 = MultiplyByI(v[2] - v[3]);
+    Texel real1 = v[0] + sum14 * cos72 + sum23 * cos144;
+    Texel imag1 = difference14 * sin72 + difference23 * sin144;
+    Texel real2 = v[0] + sum14 * cos144 + sum23 * cos72;
+    Texel imag2 = difference14 * sin144 - difference23 * sin72;
+    v[0] = v[0] + sum14 + sum23;
+    v[1] = real1 + imag1;
+    v[2] = real2 + imag2;
+    v[3] = real2 - imag2;
+    v[4] = real1 - imag1;
+  }
+}
+
+// Performs one mixed radix stage on count interleaved lines of textureSize elements, reading from
+// input and writing to output. Each butterfly multiplies its texels by the twiddle factor to the
+// power of their position before their DFT, which is exactly the butterfly from the fft kernels.
+template <std::size_t Radix>
+void MixedRadixStage(const glm::vec4* input, glm::vec4* output, std::size_t textureSize,
+                     std::size_t count, const glm::vec4* butterflies)
+{
+  std::size_t numButterflies = textureSize / Radix;
+  for (std::size_t j = 0; j < numButterflies; j++)
+  {
+    glm::vec4 butterfly = butterflies[j];
+    std::size_t firstIndex = std::size_t(butterfly.z);
+    std::size_t stride = std::size_t(butterfly.w);
+
+    glm::vec2 twiddle(butterfly.x, butterfly.y);
+    glm::vec2 factors[Radix];
+    factors[1] = twiddle;
+    for (std::size_t i = 2; i < Radix; i++)
+    {
+      factors[i] = glm::vec2(factors[i - 1].x * twiddle.x - factors[i - 1].y * twiddle.y,
+                             factors[i - 1].x * twiddle.y + factors[i - 1].y * twiddle.x);
+    }
+
+    // Every line shares the butterfly, so we go through them together.
+    for (std::size_t c = 0; c < count; c++)
+    {
+      Texel values[Radix];
+      values[0] = Load(input + j * count + c);
+      for (std::size_t i = 1; i < Radix; i++)
+        values[i] = ComplexMultiply(Load(input + (j + i * numButterflies) * count + c), factors[i]);
+
+      SmallDFT<Radix>(values);
+
+      for (std::size_t i = 0; i < Radix; i++)
+        Store(output + (firstIndex + i * stride) * count + c, values[i]);
+    }
+  }
+}
+
+uint32_t ReverseBits(uint32_t num, uint32_t numBits)
+{
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < numBits; i++)
+  {
+    result = (result << 1) | (num & 1);
+    num >>= 1;
+  }
+  return result;
+}
+
+} // namespace
+
+CPUFFTCalculator::CPUFFTCalculator(std::size_t size, ThreadPool* pool)
+  : textureSize(size), threadPool(pool)
+{
+  radices = GetFFTRadices(textureSize);
+  assert(!radices.empty());
+  numStages = radices.size();
+  powerOfTwo = std::has_single_bit(textureSize);
+
+  // Our GPU version swaps the low frequencies to the edges, then reverses the bits of each index.
+  // Since both are permutations, we just gather from the composition of them.
+  sourceIndex.resize(textureSize);
+  for (std::size_t i = 0; i < textureSize; i++)
+  {
+    std::size_t source = powerOfTwo ? ReverseBits(i, numStages) : i;
+    sourceIndex[i] = (source + textureSize / 2) % textureSize;
+  }
+
+  // This has the same layout as the table that the GPU uses.
+  butterflyTable = BuildButterflyTable(textureSize);
+}
+
+void CPUFFTCalculator::IFFT(glm::vec4* image) const
+{
+  // Each row is independent during the horizontal passes, and each column is independent during
+  // the vertical passes, so we only need to synchronize once between the two.
+  std::size_t numColumnBlocks = (textureSize + columnBlockSize - 1) / columnBlockSize;
+  if (threadPool)
+  {
+    threadPool->ParallelFor(textureSize, [this, image](std::size_t begin, std::size_t end)
+                            { TransformRows(image, begin, end); });
+
+    threadPool->ParallelFor(numColumnBlocks, [this, image](std::size_t begin, std::size_t end)
+    {
+      TransformColumns(image, begin * columnBlockSize,
+                       std::min(end * columnBlockSize, textureSize));
+    });
+  }
+  else
+  {
+    TransformRows(image, 0, textureSize);
+    TransformColumns(image, 0, textureSize);
+  }
+}
+
+void CPUFFTCalculator::TransformRows(glm::vec4* image, std::size_t begin, std::size_t end) const
+{
+  // Unlike the GPU, we don't need to ping-pong between radix-2 passes. However, the gather that
+  // performs the bit-reversal cannot be done in place, so each row is transformed in a scratch row.
+  // The Stockham stages ping-pong with a second one.
+  thread_local std::vector<glm::vec4> scratch;
+  scratch.resize(textureSize * 2);
+  glm::vec4* row = scratch.data();
+
+  for (std::size_t y = begin; y < end; y++)
+  {
+    glm::vec4* imageRow = image + y * textureSize;
+    for (std::size_t x = 0; x < textureSize; x++)
+      row[x] = imageRow[sourceIndex[x]];
+
+    if (!powerOfTwo)
+    {
+      glm::vec4* result = TransformMixed(row, row + textureSize, 1);
+      std::memcpy(imageRow, result, textureSize * sizeof(glm::vec4));
+      continue;
+    }
+
+    // The pairs in the first stage aren't adjacent, so we have to go one butterfly at a time.
+    std::size_t numButterflies = textureSize / 2;
+    for (std::size_t j = 0; j < numButterflies; j++)
+    {
+      glm::vec4 butterfly = butterflyTable[j];
+      std::size_t even = std::size_t(butterfly.z);
+      Butterfly(row + even, row + even + std::size_t(butterfly.w),
+                glm::vec2(butterfly.x, butterfly.y));
+    }
+
+    // Every other stage has an even number of elements in each half, so neighbouring butterflies
+    // operate on neighbouring elements, and we can go two at a time.
+    for (std::size_t stage = 1; stage < numStages; stage++)
+    {
+      const glm::vec4* butterflies = butterflyTable.data() + stage * numButterflies;
+      for (std::size_t j = 0; j < numButterflies; j += 2)
+      {
+        glm::vec4 first = butterflies[j];
+        glm::vec4 second = butterflies[j + 1];
+        std::size_t even = std::size_t(first.z);
+        ButterflyPair(row + even, row + even + std::size_t(first.w), glm::vec2(first.x, first.y),
+                      glm::vec2(second.x, second.y));
+      }
+    }
+
+    std::memcpy(imageRow, row, textureSize * sizeof(glm::vec4));
+  }
+}
+
+void CPUFFTCalculator::TransformColumns(glm::vec4* image, std::size_t begin, std::size_t end) const
+{
+  thread_local std::vector<glm::vec4> scratch;
+  scratch.resize(textureSize * columnBlockSize * 2);
+
+  for (std::size_t blockBegin = begin; blockBegin < end; blockBegin += columnBlockSize)
+  {
+    // Permuting the rows commutes with the horizontal passes, so we do it as we gather the block.
+    std::size_t count = std::min(columnBlockSize, end - blockBegin);
+    glm::vec4* block = scratch.data();
+    for (std::size_t y = 0; y < textureSize; y++)
+    {
+      std::memcpy(block + y * count, image + sourceIndex[y] * textureSize + blockBegin,
+                  count * sizeof(glm::vec4));
+    }
+
+    // Rather than walking down each column, we process a row segment of the block at a time,
+    // since every column in a pass uses the same twiddle for the same pair of rows.
+    const glm::vec4* result = block;
+    if (powerOfTwo)
+    {
+      for (const glm::vec4& butterfly : butterflyTable)
+      {
+        std::size_t evenRow = std::size_t(butterfly.z);
+        std::size_t oddRow = evenRow + std::size_t(butterfly.w);
+        ButterflySpan(block + evenRow * count, block + oddRow * count, count,
+                      glm::vec2(butterfly.x, butterfly.y));
+      }
+    }
+    else
+    {
+      result = TransformMixed(block, block + textureSize * count, count);
+    }
+
+    // Copy our finished columns back into the image.
+    for (std::size_t y = 0; y < textureSize; y++)
+    {
+      std::memcpy(image + y * textureSize + blockBegin, result + y * count,
+                  count * sizeof(glm::vec4));
+    }
+  }
+}
+
+glm::vec4* CPUFFTCalculator::TransformMixed(glm::vec4* lines, glm::vec4* scratch,
+                                            std::size_t count) const
+{
+  std::size_t numColumns = textureSize / 2;
+  for (std::size_t stage = 0; stage < numStages; stage++)
+  {
+    const glm::vec4* butterflies = butterflyTable.data() + stage * numColumns;
+    switch (radices[stage])
+    {
+      case 2:
+        MixedRadixStage<2>(lines, scratch, textureSize, count, butterflies);
+        break;
+      case 3:
+        MixedRadixStage<3>(lines, scratch, textureSize, count, butterflies);
+        break;
+      case 4:
+        MixedRadixStage<4>(lines, scratch, textureSize, count, butterflies);
+        break;
+      case 5:
+        MixedRadixStage<5>(lines, scratch, textureSize, count, butterflies);
+        break;
+    }
+    std::swap(lines, scratch);
+  }
+
+  return lines;
+}
+
+} // namespace Waves
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace Waves
+{
+
+// This class performs the same inverse FFT as the FFTCalculator, but on the CPU so that the ocean
+// can be simulated on machines without a usable GPU. Power of two sizes use radix-2 Cooley-Tukey
+// passes, and other sizes use the mixed radix Stockham stages from ButterflyTable. Images are
+// tightly packed RGBA32F texels, where each texel holds two complex values that are transformed
+// together. Rows are transformed in parallel, then columns, using the given thread pool.
+//
+// The transforms work in place with scratch space on each thread, so one calculator can transform
+// any number of images at the same time.
+class CPUFFTCalculator
+{
+public:
+  // The number of columns that a thread transforms at once. This keeps each row segment within a
+  // few cache lines while still giving the vector units enough contiguous texels.
+  static constexpr std::size_t columnBlockSize = 16;
+
+  // Precomputes the index and twiddle tables for a specific size, which must be supported by
+  // GetFFTRadices. The thread pool is optional, and the transform runs on the calling thread
+  // without one.
+  CPUFFTCalculator(std::size_t textureSize = 512, ThreadPool* threadPool = nullptr);
+
+  // Performs an inverse FFT in place on an image of textureSize * textureSize texels. The result
+  // matches FFTCalculator::EncodeIFFT, including the shift of low frequencies to the edges.
+  void IFFT(glm::vec4* image) const;
+
+  // The two halves of IFFT, so that they can be split across tasks and interleaved with other
+  // work. Every row of an image must be transformed before any of its columns.
+  //
+  // TransformRows performs every horizontal pass on the rows [begin, end), gathering each in
+  // shifted order, which is also bit-reversed for power of two sizes. TransformColumns gathers the
+  // columns [begin, end) from the rows in that same order, then performs every vertical pass on
+  // them.
+  void TransformRows(glm::vec4* image, std::size_t begin, std::size_t end) const;
+  void TransformColumns(glm::vec4* image, std::size_t begin, std::size_t end) const;
+
+  std::size_t GetTextureResolution() const { return textureSize; }
+
+private:
+  // Performs every mixed radix stage on count interleaved lines, where element i of line c is at
+  // lines[i * count + c], ping-ponging with the same amount of scratch space. Returns whichever of
+  // the two holds the result.
+  glm::vec4* TransformMixed(glm::vec4* lines, glm::vec4* scratch, std::size_t count) const;
+
+private:
+  std::size_t textureSize = 0;
+  std::size_t numStages = 0;
+  ThreadPool* threadPool = nullptr;
+
+  // Power of two sizes use the radix-2 passes, and every other size the mixed radix stages.
+  bool powerOfTwo = false;
+  std::vector<std::size_t> radices;
+
+  // Maps each output index to its input index, combining the fftShift and the bit-reversal of the
+  // radix-2 passes. The Stockham stages don't need the bit-reversal.
+  std::vector<uint32_t> sourceIndex;
+
+  // The twiddles and indices of every butterfly, shared in layout with the GPU's table.
+  std::vector<glm::vec4> butterflyTable;
+};
+
+} // namespace Waves
@@ -0,0 +1,264 @@
+#include "CPUGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+
+#include "Spectrum.h"
+
+namespace Waves
+{
+
+namespace
+{
+
+glm::vec2 ComplexMultiply(glm::vec2 lhs, glm::vec2 rhs)
+{
+  return glm::vec2(lhs.x * rhs.x - lhs.y * rhs.y, lhs.x * rhs.y + lhs.y * rhs.x);
+}
+
+// Each task covers about this many texels, which is enough work to hide the cost of scheduling it,
+// while still leaving plenty of tasks in each stage to spread across the threads.
+constexpr std::size_t texelsPerTask = 16384;
+
+// Computes the slopes, displacements, and partial derivatives of a wave with the given amplitude
+// and wave vector, and packs two FFTs into each map by multiplying the second by i.
+void PackWave(glm::vec2 heightAmp, glm::vec2 kVec, glm::vec2 kDir, glm::vec4& height,
+              glm::vec4& displacement)
+{
+  glm::vec2 heightAmpTimesi = glm::vec2(-heightAmp.y, heightAmp.x);
+
+  glm::vec2 dhdx = kVec.x * heightAmpTimesi;
+  glm::vec2 dhdz = kVec.y * heightAmpTimesi;
+  glm::vec2 disX = kDir.x * heightAmpTimesi;
+  glm::vec2 disZ = kDir.y * heightAmpTimesi;
+  glm::vec2 dDXdx = -kVec.x * kDir.x * heightAmp;
+  glm::vec2 dDZdz = -kVec.y * kDir.y * heightAmp;
+  glm::vec2 dDXdz = -kVec.y * kDir.x * heightAmp;
+
+  height = glm::vec4(heightAmp.x - dhdx.y, heightAmp.y + dhdx.x, dhdz.x - disX.y, dhdz.y + disX.x);
+  displacement = glm::vec4(disZ.x - dDXdx.y, disZ.y + dDXdx.x, dDZdz.x - dDXdz.y,
+                           dDZdz.y + dDXdz.x);
+}
+
+} // namespace
+
+CPUGenerator::CPUGenerator(CPUFFTCalculator* calc, ThreadPool* pool)
+  : fftCalc(calc), threadPool(pool), textureSize(calc->GetTextureResolution())
+{
+  std::size_t numTexels = textureSize * textureSize;
+  heightMap.resize(numTexels);
+  displacementMap.resize(numTexels);
+  jacobian.resize(numTexels);
+  SetHalfSpectrum(halfSpectrum);
+}
+
+void CPUGenerator::SetHalfSpectrum(bool half)
+{
+  // The layouts differ, so the spectrum has to be regenerated.
+  halfSpectrum = half;
+  spectrumValid = false;
+  if (halfSpectrum)
+    initialSpectrum.resize(GetHalfSpectrumWidth(textureSize) * GetHalfSpectrumHeight(textureSize));
+  else
+    initialSpectrum.resize(textureSize * textureSize);
+}
+
+void CPUGenerator::CalculateOcean(float timestep, bool userUpdatedSpectrum)
+{
+  UpdateSpectrum(timestep, userUpdatedSpectrum);
+
+  PrepareFFT();
+
+  fftCalc->IFFT(heightMap.data());
+  fftCalc->IFFT(displacementMap.data());
+
+  ComputeFoam();
+}
+
+void CPUGenerator::CalculateOceans(std::span<CPUGenerator* const> generators, float timestep,
+                                   bool userUpdatedSpectrum)
+{
+  if (generators.empty())
+    return;
+
+  // The spectra are only regenerated when the settings change, so they're left out of the graph
+  // and spread across the threads one at a time.
+  for (auto* generator : generators)
+    generator->UpdateSpectrum(timestep, userUpdatedSpectrum);
+
+  ThreadPool* threadPool = generators[0]->threadPool;
+  if (!threadPool)
+  {
+    for (auto* generator : generators)
+    {
+      generator->PrepareFFT();
+      generator->fftCalc->IFFT(generator->heightMap.data());
+      generator->fftCalc->IFFT(generator->displacementMap.data());
+      generator->ComputeFoam();
+    }
+    return;
+  }
+
+  TaskGraph graph;
+  for (auto* generator : generators)
+    generator->AddTasks(graph);
+
+  threadPool->Run(graph);
+}
+
+void CPUGenerator::AddTasks(TaskGraph& graph)
+{
+  using TaskID = TaskGraph::TaskID;
+
+  // Each row of the half spectrum also writes the opposite row of the maps, so every row has to
+  // be prepared before the maps can be transformed. After that, the maps are independent.
+  std::size_t rowsPerTask = std::max<std::size_t>(texelsPerTask / textureSize, 1);
+  auto prepareRows = [this](std::size_t begin, std::size_t end) { PrepareFFTRows(begin, end); };
+  TaskID prepare = graph.AddParallelFor(GetSpectrumHeight(), rowsPerTask, prepareRows);
+
+  // The columns are transformed a block at a time, so each task covers whole blocks.
+  std::size_t blockSize = CPUFFTCalculator::columnBlockSize;
+  std::size_t columnsPerTask = std::max<std::size_t>(rowsPerTask / blockSize, 1) * blockSize;
+
+  TaskID transformed[2];
+  glm::vec4* maps[2] = {heightMap.data(), displacementMap.data()};
+  for (int i = 0; i < 2; i++)
+  {
+    glm::vec4* map = maps[i];
+    auto rows = [this, map](std::size_t begin, std::size_t end)
+    { fftCalc->TransformRows(map, begin, end); };
+    auto columns = [this, map](std::size_t begin, std::size_t end)
+    { fftCalc->TransformColumns(map, begin, end); };
+
+    TaskID rowsDone = graph.AddParallelFor(textureSize, rowsPerTask, rows, {prepare});
+    transformed[i] = graph.AddParallelFor(textureSize, columnsPerTask, columns, {rowsDone});
+  }
+
+  // The foam only needs the displacement map.
+  auto foamRows = [this](std::size_t begin, std::size_t end) { ComputeFoamRows(begin, end); };
+  graph.AddParallelFor(textureSize, rowsPerTask, foamRows, {transformed[1]});
+}
+
+void CPUGenerator::UpdateSpectrum(float timestep, bool force)
+{
+  // Update our ocean's settings
+  oceanSettings.time += timestep;
+
+  // Only regenerate the spectrum when the settings that it depends on have changed.
+  uint64_t hash = HashSpectrumSettings(oceanSettings);
+  if (!spectrumValid || hash != spectrumHash || force)
+  {
+    spectrumValid = true;
+    spectrumHash = hash;
+    GenerateSpectrum();
+  }
+}
+
+std::size_t CPUGenerator::GetSpectrumHeight() const
+{
+  return halfSpectrum ? GetHalfSpectrumHeight(textureSize) : textureSize;
+}
+
+template <typename Func>
+void CPUGenerator::ForEachRow(std::size_t height, Func func)
+{
+  if (threadPool)
+    threadPool->ParallelFor(height, func);
+  else
+    func(0, height);
+}
+
+template <typename Func>
+void CPUGenerator::ForEachTexel(std::size_t width, std::size_t begin, std::size_t end, Func func)
+{
+  for (std::size_t y = begin; y < end; y++)
+    for (std::size_t x = 0; x < width; x++)
+      func(x, y);
+}
+
+void CPUGenerator::GenerateSpectrum()
+{
+  if (halfSpectrum)
+    GenerateHalfSpectrum(oceanSettings, textureSize, initialSpectrum.data(), threadPool);
+  else
+    GenerateInitialSpectrum(oceanSettings, textureSize, initialSpectrum.data(), threadPool);
+}
+
+void CPUGenerator::PrepareFFT()
+{
+  ForEachRow(GetSpectrumHeight(),
+             [this](std::size_t begin, std::size_t end) { PrepareFFTRows(begin, end); });
+}
+
+void CPUGenerator::PrepareFFTRows(std::size_t begin, std::size_t end)
+{
+  glm::vec2 dimensions = glm::vec2(static_cast<float>(textureSize));
+  float dk = 2.0f * glm::pi<float>() / oceanSettings.planeSize;
+
+  // The full spectrum has one texel per output, while the half spectrum writes each output along
+  // with its opposite, which has the conjugate amplitude and the negated wave vector.
+  std::size_t width = halfSpectrum ? GetHalfSpectrumWidth(textureSize) : textureSize;
+  std::size_t size = textureSize;
+
+  ForEachTexel(width, begin, end, [this, dimensions, dk, width, size](std::size_t x, std::size_t y)
+  {
+    // In the middle row of the half spectrum, the texels on the right pair with those on the left.
+    if (halfSpectrum && y == size / 2 && x > size / 2)
+      return;
+
+    glm::vec2 thread = glm::vec2(static_cast<float>(x), static_cast<float>(y));
+    glm::vec2 kVec = (thread - dimensions / 2.0f) * dk;
+    glm::vec2 kDir = (kVec == glm::vec2(0.0f)) ? glm::vec2(0.0f) : glm::normalize(kVec);
+    float k = glm::length(kVec) + 1e-6f;
+
+    // Propogate this wave and the opposite wave's conjugate using the dispersion relation.
+    glm::vec4 amplitudes = initialSpectrum[y * width + x];
+    float phase = QuantizedDispersion(oceanSettings, k) * oceanSettings.time;
+    glm::vec2 wave = glm::vec2(std::cos(phase), std::sin(phase));
+    glm::vec2 amplitude = ComplexMultiply(glm::vec2(amplitudes.x, amplitudes.y), wave);
+    glm::vec2 oppAmplitude = ComplexMultiply(glm::vec2(amplitudes.z, amplitudes.w),
+                                             glm::vec2(wave.x, -wave.y));
+    glm::vec2 heightAmp = amplitude + oppAmplitude;
+
+    if (x < size && y < size)
+    {
+      std::size_t index = y * size + x;
+      PackWave(heightAmp, kVec, kDir, heightMap[index], displacementMap[index]);
+    }
+
+    // The opposites of the first row and column lie outside of the maps.
+    std::size_t oppX = size - x, oppY = size - y;
+    if (halfSpectrum && oppX < size && oppY < size && (oppX != x || oppY != y))
+    {
+      std::size_t index = oppY * size + oppX;
+      PackWave(glm::vec2(heightAmp.x, -heightAmp.y), -kVec, -kDir, heightMap[index],
+               displacementMap[index]);
+    }
+  });
+}
+
+void CPUGenerator::ComputeFoam()
+{
+  ForEachRow(textureSize,
+             [this](std::size_t begin, std::size_t end) { ComputeFoamRows(begin, end); });
+}
+
+void CPUGenerator::ComputeFoamRows(std::size_t begin, std::size_t end)
+{
+  float displacement = oceanSettings.displacement;
+  ForEachTexel(textureSize, begin, end, [this, displacement](std::size_t x, std::size_t y)
+  {
+    // Jacobian determinant is equal to JxxJyy - Jxy^2
+    std::size_t index = y * textureSize + x;
+    glm::vec4 data = displacementMap[index];
+    float dDxdx = data.y;
+    float dDzdz = data.z;
+    float dDxdz = data.w;
+
+    jacobian[index] = (1.0f + displacement * dDxdx) * (1.0f + displacement * dDzdz) -
+                      displacement * displacement * dDxdz * dDxdz;
+  });
+}
+
+} // namespace Waves
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+#include "CPUFFTCalculator.h"
+#include "GeneratorSettings.h"
+#include "TaskGraph.h"
+#include "ThreadPool.h"
+
+namespace Waves
+{
+
+// A port of the Generator to the CPU. Each stage performs the same math as its kernel in
+// spectrum.compute, and the maps that it produces have the same layout as the textures that the
+// GPU version writes. This lets us simulate without a window or a GPU.
+class CPUGenerator
+{
+public:
+  CPUGenerator(CPUFFTCalculator* calc, ThreadPool* threadPool = nullptr);
+
+  // Access the settings behind this ocean. The spectrum is regenerated whenever the settings that
+  // it depends on change.
+  GeneratorSettings& GetOceanSettings() { return oceanSettings; }
+
+  // Perform the necessary FFTs to calculate the change the ocean given a timestep since the last
+  // call. Setting updateOcean forces the spectrum to be regenerated.
+  void CalculateOcean(float timestep, bool updateOcean = false);
+
+  // Calculates several oceans at once, like the GPU's Generator::CalculateOceans. The stages of
+  // every ocean are split into tasks over blocks of rows and columns, which run on the thread pool
+  // of the first ocean with work stealing. Independent oceans and maps interleave, so the threads
+  // stay busy through the serial points of each ocean, such as between its row and column passes.
+  static void CalculateOceans(std::span<CPUGenerator* const> generators, float timestep,
+                              bool updateOcean = false);
+
+  // Adds the tasks that calculate this ocean's maps from its current spectrum to a graph.
+  void AddTasks(TaskGraph& graph);
+
+  // The stages of CalculateOcean, in the order they are run. These are exposed so that they can be
+  // driven and timed individually.
+  void GenerateSpectrum();
+  void PrepareFFT();
+  void ComputeFoam();
+
+  // Choose whether the initial spectrum is stored as the half spectrum, which only keeps the rows
+  // that aren't implied by Hermitian symmetry. Both produce the same maps.
+  void SetHalfSpectrum(bool half);
+  bool UsesHalfSpectrum() const { return halfSpectrum; }
+
+  // The maps are tightly packed rows of textureSize texels, laid out like their textures.
+  glm::vec4* GetHeightMap() { return heightMap.data(); }
+  glm::vec4* GetDisplacementMap() { return displacementMap.data(); }
+  float* GetJacobianMap() { return jacobian.data(); }
+
+  std::size_t GetTextureResolution() const { return textureSize; }
+
+private:
+  // Run func(begin, end) over every row of an image, spread across the thread pool.
+  template <typename Func>
+  void ForEachRow(std::size_t height, Func func);
+
+  // Run func(x, y) for every texel in the rows [begin, end) of an image.
+  template <typename Func>
+  static void ForEachTexel(std::size_t width, std::size_t begin, std::size_t end, Func func);
+
+  // Advance the time, and regenerate the spectrum if the settings that it depends on changed.
+  void UpdateSpectrum(float timestep, bool force);
+
+  // The stages for the rows [begin, end) of the spectrum and of the maps respectively.
+  void PrepareFFTRows(std::size_t begin, std::size_t end);
+  void ComputeFoamRows(std::size_t begin, std::size_t end);
+
+  // The number of rows that PrepareFFT iterates over.
+  std::size_t GetSpectrumHeight() const;
+
+private:
+  CPUFFTCalculator* fftCalc = nullptr;
+  ThreadPool* threadPool = nullptr;
+
+  // The size of all maps owned by this generator.
+  std::size_t textureSize;
+
+  // Store the settings for our ocean, and the hash of those that our spectrum was generated with.
+  GeneratorSettings oceanSettings;
+  bool spectrumValid = false;
+  uint64_t spectrumHash = 0;
+
+  // h, dh/dx, dh/dz, Dx
+  std::vector<glm::vec4> heightMap;
+
+  // Dz, dDx/dx, dDz/dz, dDx/dz
+  std::vector<glm::vec4> displacementMap;
+
+  // Store our generated spectrum which we propogate each frame.
+  bool halfSpectrum = true;
+  std::vector<glm::vec4> initialSpectrum;
+
+  // The jacobian determinant of the displacement, which is used for foam.
+  std::vector<float> jacobian;
+};
+
+} // namespace Waves
@@ -0,0 +1,155 @@
+#include "CascadeScheduler.h"
+
+#include <algorithm>
+#include <bit>
+#include <numeric>
+
+namespace Waves
+{
+
+void CascadeScheduler::SetNumCascades(std::size_t numCascades)
+{
+  cascades.assign(numCascades, Cascade());
+  steps.assign(numCascades, CascadeStep());
+  Reset();
+}
+
+void CascadeScheduler::SetInterval(std::size_t cascade, std::size_t interval)
+{
+  interval = std::bit_floor(std::clamp<std::size_t>(interval, 1, maxInterval));
+  if (interval == cascades[cascade].interval)
+    return;
+
+  // The cascade's results were simulated for the old interval, so we start it over.
+  cascades[cascade].interval = interval;
+  cascades[cascade].currentInterval = interval;
+  cascades[cascade].numResults = 0;
+  AssignPhases();
+}
+
+void CascadeScheduler::SetCost(std::size_t cascade, float cost)
+{
+  cascades[cascade].cost = cost;
+  AssignPhases();
+}
+
+std::span<const CascadeStep> CascadeScheduler::Advance(float timestep)
+{
+  double step = fixedStep > 0.0f && timestep > 0.0f ? fixedStep : timestep;
+  time += step;
+
+  for (std::size_t i = 0; i < cascades.size(); i++)
+  {
+    Cascade& cascade = cascades[i];
+    CascadeStep& cascadeStep = steps[i];
+
+    // Cascades that are simulated every frame are simulated for the time that's drawn.
+    cascadeStep.time = static_cast<float>(time);
+    if (cascade.interval == 1)
+    {
+      cascadeStep.simulate = true;
+      cascadeStep.interpolated = false;
+      cascadeStep.blend = 1.0f;
+      continue;
+    }
+
+    // Otherwise, a new result is simulated for the time when the cascade is next due, assuming
+    // that the timestep stays the same until then. The first result is for the current time, so
+    // that there's something to draw while the second is simulated on the next frame. The interval
+    // only changes when a result is due, so that the results that we blend stay in order.
+    std::size_t interval = cascade.currentInterval;
+    cascadeStep.interpolated = true;
+    cascadeStep.simulate =
+        cascade.numResults < 2 || frame % interval == cascade.phase % interval;
+    if (cascadeStep.simulate)
+    {
+      cascade.currentInterval = GetCurrentInterval(cascade, step);
+      cascade.previousTime = cascade.nextTime;
+      cascade.nextTime = time;
+      if (cascade.numResults > 0)
+        cascade.nextTime += step * static_cast<double>(GetFramesUntilDue(cascade));
+      else
+        cascade.previousTime = time;
+
+      cascade.numResults = std::min(cascade.numResults + 1, 2);
+      cascadeStep.time = static_cast<float>(cascade.nextTime);
+    }
+
+    // When the timestep changes, the time drawn can fall outside of the results. We hold the
+    // closest result until the next one is simulated rather than extrapolate.
+    double range = cascade.nextTime - cascade.previousTime;
+    double blend = range > 0.0 ? (time - cascade.previousTime) / range : 1.0;
+    cascadeStep.blend = static_cast<float>(std::clamp(blend, 0.0, 1.0));
+  }
+
+  frame++;
+  return steps;
+}
+
+std::size_t CascadeScheduler::GetNumSimulated() const
+{
+  return std::count_if(steps.begin(), steps.end(),
+                       [](const CascadeStep& step) { return step.simulate; });
+}
+
+void CascadeScheduler::Reset()
+{
+  time = 0.0;
+  frame = 0;
+  for (Cascade& cascade : cascades)
+    cascade.numResults = 0;
+}
+
+void CascadeScheduler::AssignPhases()
+{
+  // Every interval divides the longest, so the schedule repeats every maxInterval frames. We place
+  // the most expensive cascades first, each in the phase that keeps the busiest frame cheapest.
+  std::vector<std::size_t> order(cascades.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [this](std::size_t lhs, std::size_t rhs)
+                   { return cascades[lhs].cost > cascades[rhs].cost; });
+
+  float load[maxInterval] = {};
+  for (std::size_t index : order)
+  {
+    Cascade& cascade = cascades[index];
+
+    float bestPeak = 0.0f;
+    for (std::size_t phase = 0; phase < cascade.interval; phase++)
+    {
+      float peak = 0.0f;
+      for (std::size_t frame = phase; frame < maxInterval; frame += cascade.interval)
+        peak = std::max(peak, load[frame] + cascade.cost);
+
+      if (phase == 0 || peak < bestPeak)
+      {
+        bestPeak = peak;
+        cascade.phase = phase;
+      }
+    }
+
+    for (std::size_t frame = cascade.phase; frame < maxInterval; frame += cascade.interval)
+      load[frame] += cascade.cost;
+  }
+}
+
+std::size_t CascadeScheduler::GetCurrentInterval(const Cascade& cascade, double step)
+{
+  if (cascade.maxFrequency <= 0.0f || step <= 0.0)
+    return cascade.interval;
+
+  // Halving the interval keeps the frames of the longer one, so it stays spread from the others.
+  std::size_t interval = cascade.interval;
+  while (interval > 1 && cascade.maxFrequency * step * static_cast<double>(interval) > maxPhaseStep)
+    interval /= 2;
+  return interval;
+}
+
+std::size_t CascadeScheduler::GetFramesUntilDue(const Cascade& cascade) const
+{
+  std::size_t interval = cascade.currentInterval;
+  std::size_t nextPhase = (frame + 1) % interval;
+  return (cascade.phase % interval + interval - nextPhase) % interval + 1;
+}
+
+} // namespace Waves
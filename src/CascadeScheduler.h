@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace Waves
+{
+
+// How a cascade is updated during one frame.
+struct CascadeStep
+{
+  bool simulate = true; // Whether the cascade is simulated this frame.
+  float time = 0.0f;    // The time that the cascade is simulated at, when it is.
+
+  // Cascades that aren't simulated every frame are drawn by blending their last two results, from
+  // 0 at the previous result to 1 at the latest.
+  bool interpolated = false;
+  float blend = 1.0f;
+};
+
+// Decides which cascades are simulated each frame. Each cascade is simulated at its own interval of
+// frames, so that the large cascades, which only hold slow swells, don't cost a simulation every
+// frame. In between, a cascade is drawn by blending its last two results, so its results are always
+// simulated ahead of the time that's drawn. This way the swells keep moving smoothly, without any
+// steps.
+//
+// Cascades whose intervals allow it are simulated on different frames, weighted by their costs, so
+// that the work is spread evenly rather than landing on the same frames.
+//
+// Blending two results only looks right while their waves are close in phase. Otherwise the waves
+// fade out and back in between the results, so they seem to pulse. Intervals are counted in frames,
+// so at low frame rates the time between results grows. A cascade's interval is therefore halved
+// while its fastest waves would turn by more than maxPhaseStep between two results.
+//
+// With a fixed step, every frame advances the time by that step rather than by its timestep, so the
+// same number of frames always simulates the same oceans. That makes replays deterministic.
+class CascadeScheduler
+{
+public:
+  // The longest interval that a cascade can have, in frames.
+  static constexpr std::size_t maxInterval = 8;
+
+  // The furthest that a wave may turn between two results, in radians. Blending results this far
+  // apart dims the wave by at most 5% halfway between them.
+  static constexpr double maxPhaseStep = 0.6;
+
+  // Changing the cascades restarts all of them.
+  void SetNumCascades(std::size_t numCascades);
+  std::size_t GetNumCascades() const { return cascades.size(); }
+
+  // The number of frames between simulations of a cascade, which is rounded down to a power of two
+  // no larger than maxInterval. An interval of one simulates the cascade every frame.
+  void SetInterval(std::size_t cascade, std::size_t interval);
+  std::size_t GetInterval(std::size_t cascade) const { return cascades[cascade].interval; }
+
+  // The relative cost of simulating a cascade, which is used to spread the work across frames.
+  void SetCost(std::size_t cascade, float cost);
+
+  // The angular frequency of the fastest wave in a cascade, in radians per second, which bounds the
+  // time between its results. Zero leaves its interval as it is, however long the frames take.
+  void SetMaxFrequency(std::size_t cascade, float frequency)
+  {
+    cascades[cascade].maxFrequency = frequency;
+  }
+
+  // A positive step is used for every frame instead of its timestep. Zero follows the timesteps.
+  // Frames with a timestep of zero still pause the ocean.
+  void SetFixedStep(float step) { fixedStep = step; }
+  float GetFixedStep() const { return fixedStep; }
+
+  // Moves to the next frame, and returns how each cascade is updated during it.
+  std::span<const CascadeStep> Advance(float timestep);
+
+  // The time of the last frame, and the steps chosen for it.
+  double GetTime() const { return time; }
+  std::span<const CascadeStep> GetSteps() const { return steps; }
+  std::size_t GetNumSimulated() const;
+
+  // Starts over from time zero.
+  void Reset();
+
+  // Discards the results of one cascade, like when its resolution changes, so that it's simulated
+  // again from the current time.
+  void Restart(std::size_t cascade) { cascades[cascade].numResults = 0; }
+
+private:
+  struct Cascade
+  {
+    std::size_t interval = 1;
+    std::size_t phase = 0; // The frames where frame % interval == phase are simulated.
+    float cost = 1.0f;
+    float maxFrequency = 0.0f;
+
+    // The interval that the cascade is currently simulated at, which may be shorter than its own
+    // when the frames are long. It's chosen each time that the cascade is simulated.
+    std::size_t currentInterval = 1;
+
+    // A cascade needs two results before it can be blended.
+    int numResults = 0;
+    double previousTime = 0.0;
+    double nextTime = 0.0;
+  };
+
+  // Chooses the phase of every cascade, so that the most expensive frame is as cheap as possible.
+  void AssignPhases();
+
+  // The longest interval, up to the cascade's own, that keeps its phase step small at this step.
+  static std::size_t GetCurrentInterval(const Cascade& cascade, double step);
+
+  // The number of frames after the current one until a cascade is due again.
+  std::size_t GetFramesUntilDue(const Cascade& cascade) const;
+
+private:
+  std::vector<Cascade> cascades;
+  std::vector<CascadeStep> steps;
+
+  // The time is kept in double precision so that it doesn't drift over long sessions.
+  double time = 0.0;
+  std::size_t frame = 0;
+  float fixedStep = 0.0f;
+};
+
+} // namespace Waves
@@ -1,25 +1,42 @@
 #include "FFTCalculator.h"
 
-#include <glm/gtc/integer.hpp>
+#include <algorithm>
+#include <bit>
+#include <cassert>
 
-#include "renderer/shader/ShaderCompiler.h"
+#include "ButterflyTable.h"
+#include "Profiler.h"
+#include "ShaderCache.h"
 
 namespace Waves
 {
 
-FFTCalculator::FFTCalculator(Vision::RenderDevice* renderDevice, std::size_t size)
-  : device(renderDevice), textureSize(size)
+FFTCalculator::FFTCalculator(Vision::RenderDevice* renderDevice, ResourcePool* resourcePool,
+                             std::size_t size)
+  : device(renderDevice), pool(resourcePool), textureSize(size)
 {
-  // Create an array to populate our FFT UBO.
-  numPasses = glm::log2(textureSize) * 2; // horizontal and vertical
+  SetMode(mode);
+
+  radices = GetFFTRadices(textureSize);
+  assert(IsGPUFFTSizeSupported(textureSize));
+
+  // Create an array to populate our FFT UBO, with every stage horizontally, then vertically.
+  numPasses = radices.size() * 2;
   std::vector<FFTPass> passes;
-  for (int i = 0; i < numPasses; i++)
+  for (int vertical = 0; vertical < 2; vertical++)
   {
-    FFTPass pass;
-    pass.passNumber = i % (numPasses / 2);
-    pass.vertical = i >= (numPasses / 2) ? 1 : 0;
-    pass.totalSize = textureSize;
-    passes.push_back(pass);
+    int stride = 1;
+    for (std::size_t stage = 0; stage < radices.size(); stage++)
+    {
+      FFTPass pass;
+      pass.passNumber = static_cast<int>(stage);
+      pass.vertical = vertical;
+      pass.radix = static_cast<int>(radices[stage]);
+      pass.stride = stride;
+      passes.push_back(pass);
+
+      stride *= pass.radix;
+    }
   }
 
   // Allocate and populate our GPU memory with the pass information.
@@ -29,7 +46,7 @@ FFTCalculator::FFTCalculator(Vision::RenderDevice* renderDevice, std::size_t siz
   fftDesc.Usage = Vision::BufferUsage::Static;
   fftDesc.Size = sizeof(FFTPass) * numPasses;
   fftDesc.Data = passes.data();
-  fftUBO = device->CreateBuffer(fftDesc);
+  fftUBO = pool->AcquireBuffer(fftDesc);
 
   // Create our work image
   Vision::Texture2DDesc imgDesc;
@@ -42,36 +59,126 @@ FFTCalculator::FFTCalculator(Vision::RenderDevice* renderDevice, std::size_t siz
   imgDesc.AddressModeT = Vision::EdgeAddressMode::Repeat;
   imgDesc.WriteOnly = false;
   imgDesc.Data = nullptr;
-  workImage = device->CreateTexture2D(imgDesc);
+  workImage = pool->AcquireTexture2D(imgDesc);
 
-  // Don't recompile these shaders if we've done it once.
-  if (!generatedPS)
-  {
-    // Load and compile our FFT compute shaders to create the compute pipeline.
-    Vision::ShaderCompiler shaderCompiler;
-    Vision::ComputePipelineDesc pipelineDesc;
-    pipelineDesc.ComputeKernels = shaderCompiler.CompileFile("resources/fft.compute", true);
-    fftPS = device->CreateComputePipeline(pipelineDesc);
+  // Upload our butterflies, with one row for each stage. The kernels fetch individual texels.
+  std::vector<glm::vec4> butterflies = BuildButterflyTable(textureSize);
+  Vision::Texture2DDesc tableDesc;
+  tableDesc.Width = textureSize / 2;
+  tableDesc.Height = radices.size();
+  tableDesc.PixelType = Vision::PixelType::RGBA32Float;
+  tableDesc.MinFilter = Vision::MinMagFilter::Nearest;
+  tableDesc.MagFilter = Vision::MinMagFilter::Nearest;
+  tableDesc.AddressModeS = Vision::EdgeAddressMode::ClampToEdge;
+  tableDesc.AddressModeT = Vision::EdgeAddressMode::ClampToEdge;
+  tableDesc.WriteOnly = false;
+  tableDesc.Data = butterflies.data();
+  butterflyTexture = pool->AcquireTexture2D(tableDesc);
 
-    generatedPS = true;
-  }
+  // Don't recompile these shaders if we've already done it for this size.
+  sharedPipeline = &pipelineCache[textureSize];
+  if (sharedPipeline->numUsers++ == 0)
+    LoadShaders();
 }
 
-
 FFTCalculator::~FFTCalculator()
 {
-  device->DestroyBuffer(fftUBO);
-  device->DestroyTexture2D(workImage);
+  pool->ReleaseBuffer(fftUBO);
+  pool->ReleaseTexture2D(workImage);
+  pool->ReleaseTexture2D(butterflyTexture);
 
-  if (generatedPS)
+  SharedPipeline& shared = pipelineCache[textureSize];
+  if (--shared.numUsers == 0)
   {
-    device->DestroyPipeline(fftPS);
-    generatedPS = false;
+    pool->ReleaseComputePipeline(shared.pipeline);
+    pipelineCache.erase(textureSize);
   }
 }
 
+std::vector<ShaderDefine> FFTCalculator::GetShaderDefines() const
+{
+  // The kernels size their workgroups and shared memory by SIZE, and unroll their stages by
+  // RADICES, so each size needs its own copy.
+  std::string radixList;
+  for (std::size_t radix : radices)
+    radixList += (radixList.empty() ? "" : ", ") + std::to_string(radix);
+
+  return {{"SIZE", std::to_string(textureSize)},
+          {"NUM_STAGES", std::to_string(radices.size())},
+          {"RADICES", radixList}};
+}
+
+void FFTCalculator::LoadShaders(bool reload)
+{
+  // The copy for our size also has the workgroups that were tuned for it.
+  std::string path = WorkgroupTuner::Get().WriteVariant("resources/fft.compute", tiledKernels,
+                                                        textureSize, GetShaderDefines());
+
+  // Calculators of the same size share the pipeline, so only the first to reload it recreates it.
+  Vision::ID& pipeline = sharedPipeline->pipeline;
+  if (pipeline && !(reload && ShaderCache::Get().HasChanged(path, true)))
+    return;
+
+  // The old pipeline may still be in flight, so the pool destroys it once it's done.
+  pool->ReleaseComputePipeline(pipeline);
+
+  // Load and compile our FFT compute shaders to create the compute pipeline.
+  Vision::ComputePipelineDesc pipelineDesc;
+  pipelineDesc.ComputeKernels = ShaderCache::Get().CompileFile(path, true);
+  pipeline = device->CreateComputePipeline(pipelineDesc);
+}
+
 void FFTCalculator::EncodeIFFT(Vision::ID image)
 {
+  if (mode == FFTMode::Stockham)
+    EncodeIFFTBatch({&image, 1});
+  else
+    EncodeMultiPass(image);
+}
+
+void FFTCalculator::EncodeIFFTBatch(std::span<const Vision::ID> images)
+{
+  ProfileScope scope("ifft");
+
+  // The multi-pass mode ping-pongs through our single work image, so it can't be batched.
+  if (mode == FFTMode::MultiPass)
+  {
+    for (Vision::ID image : images)
+      EncodeMultiPass(image);
+    return;
+  }
+
+  device->BindTexture2D(butterflyTexture, 0);
+  for (std::size_t first = 0; first < images.size(); first += maxBatchSize)
+  {
+    std::size_t count = std::min(images.size() - first, maxBatchSize);
+
+    // Each image in the batch gets its own unit, and the kernel selects one using the z axis.
+    for (std::size_t i = 0; i < count; i++)
+      device->BindImage2D(images[first + i], i);
+
+    // The shift and the stages are folded into the kernel, so each axis is one dispatch. The first
+    // half of our passes are horizontal, and the second half are vertical.
+    {
+      ProfileScope passScope("horizontalPass");
+      device->BindBuffer(fftUBO, 0, 0, sizeof(FFTPass));
+      device->DispatchCompute(sharedPipeline->pipeline, "fftStockham", {textureSize, 1, count});
+      device->ImageBarrier();
+    }
+
+    {
+      ProfileScope passScope("verticalPass");
+      device->BindBuffer(fftUBO, 0, (numPasses / 2) * sizeof(FFTPass), sizeof(FFTPass));
+      device->DispatchCompute(sharedPipeline->pipeline, "fftStockham", {textureSize, 1, count});
+      device->ImageBarrier();
+    }
+  }
+}
+
+void FFTCalculator::EncodeMultiPass(Vision::ID image)
+{
+  ProfileScope scope("multiPass");
+
   // Lamdba to bind appropriate image as we ping-pong.
   bool workImgAsInput = false;
   auto bindImages = [&]()
@@ -90,27 +197,91 @@ void FFTCalculator::EncodeIFFT(Vision::ID image)
     workImgAsInput = !workImgAsInput;
   };
 
+  // Other sizes shift as they read their first stage along each axis, and their passes sort the
+  // output into natural order. There's an even number of passes, so the last writes to the image.
+  if (!std::has_single_bit(textureSize))
+  {
+    device->BindTexture2D(butterflyTexture, 0);
+    for (std::size_t i = 0; i < numPasses; i++)
+    {
+      ProfileScope passScope("pass");
+      device->BindBuffer(fftUBO, 0, i * sizeof(FFTPass), sizeof(FFTPass));
+
+      std::size_t numButterflies = textureSize / radices[i % radices.size()];
+      bindImages();
+      device->DispatchCompute(sharedPipeline->pipeline, "fftPass",
+                              {GetNumWorkgroups(numButterflies, passGroupSize), textureSize, 1});
+      device->ImageBarrier();
+    }
+    return;
+  }
+
   // Swap low frequencies to edges.
+  device->BindTexture2D(butterflyTexture, 0);
   bindImages();
-  device->DispatchCompute(fftPS, "fftShift", {textureSize, textureSize, 1});
+  DispatchTiled("fftShift");
 
   // We must make sure our modifications to the image are coherent and visible after each command.
   device->ImageBarrier();
 
   // Perform our index bit-reversal to prepare for cooley-tukey FFT.
   bindImages();
-  device->DispatchCompute(fftPS, "imageReversal", {textureSize, textureSize, 1});
+  DispatchTiled("imageReversal");
   device->ImageBarrier();
 
   // Encode our iterative passes.
   for (int i = 0; i < numPasses; i++)
   {
+    ProfileScope passScope("pass");
     device->BindBuffer(fftUBO, 0, i * sizeof(FFTPass), sizeof(FFTPass));
 
     bindImages();
-    device->DispatchCompute(fftPS, "fft", {textureSize, 1, 1});
+    device->DispatchCompute(sharedPipeline->pipeline, "fft", {textureSize, 1, 1});
     device->ImageBarrier();
   }
 }
 
-} // namespace Waves
\ No newline at end of file
+void FFTCalculator::AddTuningJobs(WorkgroupTuner& tuner, Vision::ID image)
+{
+  // Only power of two sizes dispatch our tiled kernels.
+  if (!std::has_single_bit(textureSize))
+    return;
+
+  for (const char* kernel : tiledKernels)
+  {
+    if (tuner.IsTuned(kernel, textureSize))
+      continue;
+
+    TuningJob job;
+    job.kernel = kernel;
+    job.resolution = textureSize;
+    job.writeVariant = [this](WorkgroupSize size)
+    {
+      return WorkgroupTuner::WriteCandidateVariant("resources/fft.compute", tiledKernels,
+                                                   textureSize, size, GetShaderDefines());
+    };
+    job.encode = [this, kernel, image](Vision::ID pipeline, WorkgroupSize size)
+    {
+      device->BindImage2D(image, 0, Vision::ImageAccess::ReadOnly);
+      device->BindImage2D(workImage, 1, Vision::ImageAccess::WriteOnly);
+
+      tuningPipeline = pipeline;
+      tuningSize = size;
+      DispatchTiled(kernel);
+      tuningPipeline = 0;
+    };
+    tuner.AddJob(std::move(job));
+  }
+}
+
+void FFTCalculator::DispatchTiled(const char* kernel)
+{
+  Vision::ID pipeline = tuningPipeline ? tuningPipeline : sharedPipeline->pipeline;
+  WorkgroupSize size =
+      tuningPipeline ? tuningSize : WorkgroupTuner::Get().GetSize(kernel, textureSize);
+  device->DispatchCompute(pipeline, kernel,
+                          {GetNumWorkgroups(textureSize, size.x),
+                           GetNumWorkgroups(textureSize, size.y), 1});
+}
+
+} // namespace Waves
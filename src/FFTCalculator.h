@@ -1,60 +1,146 @@
 #pragma once
 
+#include <span>
+#include <unordered_map>
+#include <vector>
+
 #include "renderer/RenderDevice.h"
 
+#include "ResourcePool.h"
+#include "WorkgroupTuner.h"
+
 namespace Waves
 {
 
-// This class builds the necessary GPU data structures to perform a radix-2 Cooley-Tukey FFT on the
-// GPU using compute shaders. It must be configured with a texture size upon initialization, which
-// cannot be changed during the lifetime of the object.
+// The algorithms that the FFTCalculator can use to encode a transform.
+enum class FFTMode
+{
+  // One dispatch for each stage along each axis. Power of two sizes shift and bit-reverse first,
+  // then perform radix-2 Cooley-Tukey passes, and other sizes perform mixed radix Stockham passes.
+  MultiPass,
+  Stockham // One dispatch for each axis, with every row or column transformed in shared memory.
+};
+
+// This class builds the necessary GPU data structures to perform an FFT on the GPU using compute
+// shaders. It must be configured with a texture size upon initialization, which cannot be changed
+// during the lifetime of the object. The kernels are compiled for that size, so calculators of
+// different sizes may be used side by side. Sizes that aren't powers of two are split into stages
+// of radix 2, 3, 4, and 5 by GetFFTRadices, like 384 = 4 * 4 * 4 * 2 * 3.
 class FFTCalculator
 {
 public:
-  // Creates the necessary buffers and pipelines to configure and FFT for a specific size.
-  FFTCalculator(Vision::RenderDevice* device, std::size_t textureSize = 512);
+  // Creates the necessary buffers and pipelines to configure and FFT for a specific size, which
+  // must be supported by GetFFTRadices. The buffers and textures come from the pool.
+  FFTCalculator(Vision::RenderDevice* device, ResourcePool* pool, std::size_t textureSize = 512);
 
-  // Cleans up and frees all of the objects allocated by this class.
+  // Cleans up and returns all of the objects allocated by this class.
   ~FFTCalculator();
 
   // Encodes the compute pass commands necessary to encode an inverse FFT. Requires that a compute
   // command encoder is already active.
   void EncodeIFFT(Vision::ID image);
 
+  // Encodes inverse FFTs for several images at once. In Stockham mode, each axis of every image is
+  // covered by a single dispatch, so the number of dispatches and barriers doesn't depend on how
+  // many images there are. All of the images must have this calculator's texture size.
+  void EncodeIFFTBatch(std::span<const Vision::ID> images);
+
+  // The number of images that fit in a single Stockham dispatch. Larger batches are split.
+  static constexpr std::size_t maxBatchSize = 8;
+
+  // The Stockham kernel keeps two lines in shared memory, and OpenGL only guarantees 32KB of it,
+  // so larger sizes always use the multi-pass mode.
+  static constexpr std::size_t maxStockhamSize = 1024;
+
+  // Choose which algorithm is used to encode the transforms. Both produce the same results.
+  void SetMode(FFTMode fftMode)
+  {
+    mode = textureSize > maxStockhamSize ? FFTMode::MultiPass : fftMode;
+  }
+  FFTMode GetMode() const { return mode; }
+
   std::size_t GetTextureResolution() const { return textureSize; }
 
+  // Recompiles the kernels for our size, which are shared with every calculator of that size.
+  // Reloading only recreates them when the shader has changed, or their workgroups were tuned.
+  void LoadShaders(bool reload = false);
+
+  // Queues the kernels that cover the image, and haven't been tuned for our size, to be tuned on
+  // the given image. The jobs also write to our work image, and we must outlive them.
+  void AddTuningJobs(WorkgroupTuner& tuner, Vision::ID image);
+
 private:
-  // Structure for informing GPU where in the iterative process the algorithm is.
+  // The defines that specialize the kernels for our size, which the tuned variants share.
+  std::vector<ShaderDefine> GetShaderDefines() const;
+
+  void EncodeMultiPass(Vision::ID image);
+
+  // Dispatches a kernel that covers the image, in the workgroups that were tuned for it. While
+  // tuning, the candidate's pipeline and size are used instead.
+  void DispatchTiled(const char* kernel);
+
+  // The kernels whose workgroups are tuned.
+  static constexpr const char* tiledKernels[] = {"fftShift", "imageReversal"};
+
+private:
+  // Structure for informing GPU where in the iterative process the algorithm is. Each pass is one
+  // stage of the transform along one axis. Uniform data has to be 16-byte aligned.
   struct FFTPass
   {
-    int passNumber = 0;
+    int passNumber = 0; // The stage, which is also the row of the butterfly table.
     uint32_t vertical = false;
-    int totalSize = 0;
-    int dummy = 0; // Uniform data has to be 16-byte aligned.
+    int radix = 2;
+    int stride = 1; // The length of the DFTs that the stage combines.
   };
 
+  // The fftPass kernel's workgroups, which each cover a run of butterflies along one line.
+  static constexpr std::size_t passGroupSize = 64;
+
 private:
   // Maintain a pointer to the render device to encode the compute commands.
   Vision::RenderDevice* device;
+  ResourcePool* pool;
 
   // Store the size of the texture as it determines the number of threagroups that we dispatch.
   std::size_t textureSize = 0;
 
-  // Also track the number of passes since there is no need to recompute each time we encode.
+  // Also track the radix of each stage and the number of passes since there is no need to recompute
+  // them each time we encode.
+  std::vector<std::size_t> radices;
   std::size_t numPasses = 0;
 
-  // The pipeline state which holds the compute kernels needed to encode the FFT.
-  static inline bool generatedPS = false;
-  static inline Vision::ID fftPS = 0;
+  // The Stockham kernel only needs a fraction of the dispatches and barriers.
+  FFTMode mode = FFTMode::Stockham;
+
+  // The candidate that is being timed, if any.
+  Vision::ID tuningPipeline = 0;
+  WorkgroupSize tuningSize;
+
+  // The kernels are specialized for a size, so we keep one pipeline for each size in use, and share
+  // them between every calculator of that size. The last calculator of a size destroys it.
+  struct SharedPipeline
+  {
+    Vision::ID pipeline = 0;
+    std::size_t numUsers = 0;
+  };
+  static inline std::unordered_map<std::size_t, SharedPipeline> pipelineCache;
+
+  // The pipeline state which holds the compute kernels needed to encode the FFT, specialized for
+  // our texture size. The map's elements don't move, and the pipeline may be recreated by a reload.
+  SharedPipeline* sharedPipeline = nullptr;
 
   // This is persistent memory within any given render/compute pass. To use different settings,
   // we can allocate this as an array and changed the offset between GPU calls.
   Vision::ID fftUBO = 0;
 
+  // The twiddle factors and indices for every butterfly, so that the kernels don't compute them.
+  Vision::ID butterflyTexture = 0;
+
   // GPU drivers are finicky, and although we should be able to read and write to the same image
   // using threadgroup synchronization, it seems to fail to driver bugs. This approach ping-pongs
   // data between our given image and this workspace image, which sits better with the GPU, but
-  // still requires GPU synchronization.
+  // still requires GPU synchronization. The Stockham kernel works in place, since each workgroup
+  // reads its whole line into shared memory before writing, so only the multi-pass mode uses this.
   Vision::ID workImage = 0;
 };
 
@@ -1,20 +1,30 @@
 #include "Generator.h"
 
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
 #include <glm/gtc/integer.hpp>
-#include <glm/gtc/random.hpp>
 #include <iostream>
-
-#include "renderer/shader/ShaderCompiler.h"
+#include <utility>
 
 #include "core/Input.h"
 
+#include "Profiler.h"
+#include "ShaderCache.h"
+#include "Spectrum.h"
+#include "SpectrumCache.h"
+
 namespace Waves
 {
 
-Generator::Generator(Vision::RenderDevice* device, FFTCalculator* calc)
-  : renderDevice(device), fftCalc(calc), textureSize(calc->GetTextureResolution())
+Generator::Generator(Vision::RenderDevice* device, ResourcePool* resourcePool, FFTCalculator* calc)
+  : renderDevice(device),
+    pool(resourcePool),
+    fftCalc(calc),
+    textureSize(calc->GetTextureResolution())
 {
-  LoadShaders();
+  AcquirePipeline();
   GenerateTextures();
 
   Vision::BufferDesc oceanDesc;
@@ -23,91 +33,480 @@ Generator::Generator(Vision::RenderDevice* device, FFTCalculator* calc)
   oceanDesc.Usage = Vision::BufferUsage::Dynamic;
   oceanDesc.Size = sizeof(GeneratorSettings);
   oceanDesc.Data = &oceanSettings;
-  oceanUBO = renderDevice->CreateBuffer(oceanDesc);
+  oceanUBO = pool->AcquireBuffer(oceanDesc);
 }
 
 Generator::~Generator()
 {
-  if (generatedPS)
-  {
-    renderDevice->DestroyComputePipeline(computePS);
-    generatedPS = false;
-  }
+  // Let any spectrum that's being saved finish, since it refers to our settings.
+  if (spectrumSave.valid())
+    spectrumSave.wait();
 
-  renderDevice->DestroyTexture2D(heightMap);
-  renderDevice->DestroyTexture2D(displacementMap);
-  renderDevice->DestroyTexture2D(gaussianImage);
-  renderDevice->DestroyTexture2D(initialSpectrum);
+  ReleasePipeline();
 
-  renderDevice->DestroyBuffer(oceanUBO);
+  ReleaseTextures();
+
+  pool->ReleaseBuffer(oceanUBO);
 }
 
 void Generator::CalculateOcean(float timestep, bool userUpdatedSpectrum)
 {
+  Generator* self = this;
+  CalculateOceans({&self, 1}, timestep, userUpdatedSpectrum);
+}
+
+void Generator::CalculateOceans(std::span<Generator* const> generators, float timestep,
+                                bool userUpdatedSpectrum)
+{
+  // Every ocean is simulated for the time that's drawn.
+  std::vector<CascadeStep> steps(generators.size());
+  for (std::size_t i = 0; i < generators.size(); i++)
+    steps[i].time = generators[i]->oceanSettings.time + timestep;
+
+  CalculateOceans(generators, steps, userUpdatedSpectrum);
+}
+
+void Generator::CalculateOceans(std::span<Generator* const> generators,
+                                std::span<const CascadeStep> steps, bool userUpdatedSpectrum)
+{
+  ProfileScope scope("calculateOceans");
+
+  // Baked oceans only need their frames uploaded, so they stay out of the FFTs. Their sampled maps
+  // and slope maps are still blended from those frames every frame. Oceans that are interpolated
+  // have their maps blended every frame too, even when they aren't simulated.
+  std::vector<Generator*> simulated;
+  std::vector<Generator*> resolved;
+  for (std::size_t i = 0; i < generators.size(); i++)
+  {
+    Generator* generator = generators[i];
+    const CascadeStep& step = steps[i];
+    if (generator->bakedOcean)
+    {
+      generator->UploadBakedFrames(step.time);
+      resolved.push_back(generator);
+      continue;
+    }
+
+    // The previous maps of an ocean are only blended in once it has been simulated into them.
+    generator->SetInterpolated(step.interpolated);
+    if (step.simulate)
+      generator->numResults = std::min(generator->numResults + 1, 2);
+    generator->oceanSettings.blend = generator->numResults < 2 ? 1.0f : step.blend;
+
+    if (step.simulate)
+    {
+      generator->oceanSettings.time = step.time;
+      simulated.push_back(generator);
+    }
+    else if (generator->interpolated)
+    {
+      resolved.push_back(generator);
+    }
+  }
+
+  generators = simulated;
+  if (generators.empty() && resolved.empty())
+    return;
+
+  Vision::RenderDevice* renderDevice = (generators.empty() ? resolved : simulated)[0]->renderDevice;
   renderDevice->BeginComputePass();
 
-  // Update our ocean's settings
-  oceanSettings.time += timestep;
+  // Each ocean's settings are uploaded once, since every stage of the frame shares them.
+  for (auto* generator : generators)
+    generator->UploadSettings();
+  for (auto* generator : resolved)
+    generator->UploadSettings();
+
+  for (auto* generator : generators)
+    generator->EncodePrepareFFT(userUpdatedSpectrum);
+
+  // Ensure that none of our FFTs operate before we are ready.
+  renderDevice->ImageBarrier();
+
+  // Batch the images of all of the generators that share a calculator, which is every generator
+  // of the same texture size.
+  std::vector<Vision::ID> images;
+  for (std::size_t i = 0; i < generators.size(); i++)
+  {
+    FFTCalculator* fftCalc = generators[i]->fftCalc;
+
+    // Skip any calculators that we've already handled.
+    bool encoded = false;
+    for (std::size_t j = 0; j < i; j++)
+      encoded |= generators[j]->fftCalc == fftCalc;
+
+    if (encoded)
+      continue;
+
+    images.clear();
+    for (std::size_t j = i; j < generators.size(); j++)
+    {
+      if (generators[j]->fftCalc != fftCalc)
+        continue;
+
+      images.push_back(generators[j]->heightMap);
+      images.push_back(generators[j]->displacementMap);
+    }
+
+    fftCalc->EncodeIFFTBatch(images);
+  }
+
+  renderDevice->ImageBarrier();
+
+  for (auto* generator : generators)
+    generator->EncodeComputeFoam();
+  for (auto* generator : resolved)
+    generator->EncodeComputeFoam();
+
+  // Each mip of the slope maps is built from the one above it, so we build a level of every ocean
+  // at a time, and the oceans share the barriers between levels.
+  ProfileScope mipScope("downsampleSlopes");
+  resolved.insert(resolved.end(), generators.begin(), generators.end());
+  std::size_t numMips = 0;
+  for (auto* generator : resolved)
+    numMips = std::max(numMips, generator->GetNumSlopeMips());
+
+  for (std::size_t mip = 1; mip < numMips; mip++)
+  {
+    renderDevice->ImageBarrier();
+    for (auto* generator : resolved)
+    {
+      if (mip < generator->GetNumSlopeMips())
+        generator->EncodeDownsampleSlopes(mip);
+    }
+  }
+
+  renderDevice->EndComputePass();
+}
+
+void Generator::UploadSettings()
+{
   renderDevice->SetBufferData(oceanUBO, &oceanSettings, sizeof(GeneratorSettings));
+}
+
+void Generator::EncodePrepareFFT(bool userUpdatedSpectrum)
+{
+  ProfileScope scope("prepareFFT");
+
   renderDevice->BindBuffer(oceanUBO);
 
-  // Update the spectrum if needed
-  if (updateSpectrum || userUpdatedSpectrum)
+  // Interpolated oceans simulate into their oldest result, so the latest becomes the previous.
+  if (interpolated)
   {
-    updateSpectrum = false;
-    GenerateSpectrum();
+    std::swap(heightMap, previousHeightMap);
+    std::swap(displacementMap, previousDisplacementMap);
+  }
+
+  // Only update the spectrum when the settings that it depends on have changed.
+  uint64_t hash = HashSpectrumSettings(oceanSettings);
+  if (!spectrumValid || hash != spectrumHash || userUpdatedSpectrum)
+  {
+    ProfileScope spectrumScope("generateSpectrum");
+    spectrumValid = true;
+    spectrumHash = hash;
+    UpdateSpectrum(userUpdatedSpectrum);
+  }
+  else if (spectrumUnsaved && ++framesSinceChange >= framesBeforeSave)
+  {
+    SaveSpectrum();
+  }
+  else
+  {
+    UploadSavedSpectrum();
   }
 
+  DispatchPrepareFFT();
+}
+
+void Generator::DispatchPrepareFFT()
+{
   // Generate the phillips spectrum based on the given time, then prepare the necessary fourier
   // transforms to also calculate the displacement and slopes.
   renderDevice->BindImage2D(initialSpectrum, 0);
   renderDevice->BindImage2D(heightMap, 1);
   renderDevice->BindImage2D(displacementMap, 2);
-  renderDevice->DispatchCompute(computePS, "prepareFFT", {textureSize, textureSize, 1});
+  if (halfSpectrum)
+    DispatchTiled("prepareHalfFFT", GetSpectrumWidth(), GetSpectrumHeight());
+  else
+    DispatchTiled("prepareFFT", textureSize, textureSize);
+}
 
-  // Ensure that none of our FFTs operate before we are ready.
-  renderDevice->ImageBarrier();
+void Generator::UploadBakedFrames(float time)
+{
+  ProfileScope scope("uploadBakedFrame");
 
-  fftCalc->EncodeIFFT(heightMap);
-  fftCalc->EncodeIFFT(displacementMap);
+  // Keep the time within the loop, so that it never loses precision.
+  oceanSettings.time = std::fmod(time, bakedOcean->GetRepeatPeriod());
+  BakedFrameBlend frames = bakedOcean->GetFramesAtTime(oceanSettings.time);
+  oceanSettings.blend = frames.blend;
 
-  renderDevice->ImageBarrier();
+  // A frame that isn't uploaded yet replaces the one that's no longer in use. The slope map and
+  // its jacobian are resolved from the blended maps, like when simulating.
+  for (std::size_t frame : {frames.previous, frames.next})
+  {
+    if (bakedFrames[0] == frame || bakedFrames[1] == frame)
+      continue;
+
+    std::size_t slot = bakedFrames[0] == frames.previous || bakedFrames[0] == frames.next ? 1 : 0;
+    BakedFrame maps = bakedOcean->GetFrame(bakedCascade, frame);
+    renderDevice->SetTexture2DDataRaw(bakedHeightMaps[slot], maps.heightMap);
+    renderDevice->SetTexture2DDataRaw(bakedDisplacementMaps[slot], maps.displacementMap);
+    bakedFrames[slot] = frame;
+
+    // Start reading the frame after it now, so that we don't wait on the disk when it's due.
+    // Every cascade shares the frame, so the first one is enough.
+    if (bakedCascade == 0)
+      bakedOcean->Prefetch((frame + 1) % bakedOcean->GetNumFrames());
+  }
+
+  // Like the results of interpolated oceans, the maps are swapped rather than copied, so that the
+  // first holds the previous frame.
+  if (bakedFrames[0] != frames.previous)
+  {
+    std::swap(bakedHeightMaps[0], bakedHeightMaps[1]);
+    std::swap(bakedDisplacementMaps[0], bakedDisplacementMaps[1]);
+    std::swap(bakedFrames[0], bakedFrames[1]);
+  }
+}
+
+void Generator::SetPlayback(const BakedOcean* ocean, std::size_t cascade)
+{
+  bakedOcean = ocean;
+  bakedCascade = cascade;
+  bakedFrames[0] = noBakedFrame;
+  bakedFrames[1] = noBakedFrame;
+
+  // The renderer samples the blended maps while we play back.
+  ReleaseBakedTextures();
+  GenerateBakedTextures();
+  GenerateSampledTextures();
+  if (!bakedOcean)
+    return;
+
+  // The renderer reads the plane size and the displacement from our settings, so they must match
+  // the settings that the ocean was baked with.
+  const BakedCascade& baked = bakedOcean->GetCascade(cascade);
+  assert(baked.textureSize == textureSize);
+  oceanSettings.planeSize = baked.planeSize;
+  oceanSettings.displacement = baked.displacement;
+  oceanSettings.repeatPeriod = bakedOcean->GetRepeatPeriod();
+  oceanSettings.time = 0.0f;
+}
 
-  // Once this is done, we compute the jacobian determinant to get the foam texture
+void Generator::EncodeComputeFoam()
+{
+  ProfileScope scope("computeFoam");
+
+  // Once the FFTs are done, we compute the slopes and the jacobian determinant into the top of the
+  // slope map. Its mips are built once every ocean has done so.
   renderDevice->BindBuffer(oceanUBO);
+  bool half = storagePrecision == StoragePrecision::Float16;
+  if (bakedOcean)
+  {
+    // Baked frames are uploaded rather than written by our kernels, so they're read through
+    // samplers, which also convert them from half precision.
+    renderDevice->BindTexture2D(bakedHeightMaps[0], 0);
+    renderDevice->BindTexture2D(bakedDisplacementMaps[0], 1);
+    renderDevice->BindTexture2D(bakedHeightMaps[1], 2);
+    renderDevice->BindTexture2D(bakedDisplacementMaps[1], 3);
+    renderDevice->BindImage2D(sampledHeightMap, 3);
+    renderDevice->BindImage2D(sampledDisplacementMap, 4);
+    renderDevice->BindImage2D(slopeMap, 5);
+    DispatchTiled("blendBakedMaps", textureSize, textureSize);
+    return;
+  }
+
+  if (interpolated)
+  {
+    // Interpolated oceans blend their last two results into the sampled maps, in any precision.
+    renderDevice->BindImage2D(displacementMap, 0);
+    renderDevice->BindImage2D(previousHeightMap, 1);
+    renderDevice->BindImage2D(previousDisplacementMap, 2);
+    renderDevice->BindImage2D(heightMap, 6);
+    renderDevice->BindImage2D(sampledHeightMap, 3);
+    renderDevice->BindImage2D(sampledDisplacementMap, 4);
+    renderDevice->BindImage2D(slopeMap, 5);
+    DispatchTiled(half ? "blendHalfMaps" : "blendMaps", textureSize, textureSize);
+    return;
+  }
+
   renderDevice->BindImage2D(displacementMap, 0);
-  renderDevice->BindImage2D(jacobian, 3);
-  renderDevice->DispatchCompute(computePS, "computeFoam", {textureSize, textureSize, 1});
+  renderDevice->BindImage2D(heightMap, 6);
+  renderDevice->BindImage2D(slopeMap, 5);
+  if (!half)
+  {
+    DispatchTiled("computeFoam", textureSize, textureSize);
+    return;
+  }
 
-  renderDevice->EndComputePass();
+  // Half precision maps are copied out of the FFT's results in the same pass.
+  renderDevice->BindImage2D(sampledHeightMap, 3);
+  renderDevice->BindImage2D(sampledDisplacementMap, 4);
+  DispatchTiled("resolveHalf", textureSize, textureSize);
+}
+
+void Generator::EncodeDownsampleSlopes(std::size_t mip)
+{
+  // Every mip is half the size of the one above it, rounded down.
+  std::size_t size = std::max<std::size_t>(textureSize >> mip, 1);
+  renderDevice->BindImage2D(slopeMap, 3, Vision::ImageAccess::ReadOnly, mip - 1);
+  renderDevice->BindImage2D(slopeMap, 4, Vision::ImageAccess::WriteOnly, mip);
+  DispatchTiled("downsampleSlopes", size, size);
 }
 
 void Generator::LoadShaders(bool reload)
 {
-  if (!generatedPS || reload)
+  // Each size gets its own copy of the kernels, with the workgroups that were tuned for it.
+  std::string path =
+      WorkgroupTuner::Get().WriteVariant("resources/spectrum.compute", tiledKernels, textureSize);
+
+  // Generators of the same size share the pipeline, so only the first to reload it recreates it.
+  Vision::ID& pipeline = sharedPipeline->pipeline;
+  if (pipeline && !(reload && ShaderCache::Get().HasChanged(path, true)))
+    return;
+
+  // The old pipeline may still be in flight, so the pool destroys it once it's done.
+  pool->ReleaseComputePipeline(pipeline);
+
+  Vision::ComputePipelineDesc desc;
+  desc.ComputeKernels = ShaderCache::Get().CompileFile(path, true);
+  pipeline = renderDevice->CreateComputePipeline(desc);
+}
+
+void Generator::AcquirePipeline()
+{
+  sharedPipeline = &pipelineCache[textureSize];
+  if (sharedPipeline->numUsers++ == 0)
+    LoadShaders();
+}
+
+void Generator::ReleasePipeline()
+{
+  if (--sharedPipeline->numUsers == 0)
   {
-    if (computePS)
-      renderDevice->DestroyComputePipeline(computePS);
+    pool->ReleaseComputePipeline(sharedPipeline->pipeline);
+    pipelineCache.erase(textureSize);
+  }
+  sharedPipeline = nullptr;
+}
+
+void Generator::DispatchTiled(const char* kernel, std::size_t width, std::size_t height)
+{
+  Vision::ID pipeline = tuningPipeline ? tuningPipeline : sharedPipeline->pipeline;
+  WorkgroupSize size =
+      tuningPipeline ? tuningSize : WorkgroupTuner::Get().GetSize(kernel, textureSize);
+  renderDevice->DispatchCompute(pipeline, kernel,
+                                {GetNumWorkgroups(width, size.x), GetNumWorkgroups(height, size.y),
+                                 1});
+}
 
-    Vision::ShaderCompiler compiler;
-    Vision::ComputePipelineDesc desc;
-    compiler.CompileFile("resources/spectrum.compute", desc.ComputeKernels, true);
-    computePS = renderDevice->CreateComputePipeline(desc);
+void Generator::AddTuningJobs(WorkgroupTuner& tuner)
+{
+  // The FFT's jobs run on our height map, so they're queued before ours can switch it.
+  fftCalc->AddTuningJobs(tuner, heightMap);
+
+  for (const char* kernel : tiledKernels)
+  {
+    if (tuner.IsTuned(kernel, textureSize))
+      continue;
+
+    TuningJob job;
+    job.kernel = kernel;
+    job.resolution = textureSize;
+    job.writeVariant = [this](WorkgroupSize size)
+    {
+      return WorkgroupTuner::WriteCandidateVariant("resources/spectrum.compute", tiledKernels,
+                                                   textureSize, size);
+    };
+    job.encode = [this, kernel](Vision::ID pipeline, WorkgroupSize size)
+    {
+      tuningPipeline = pipeline;
+      tuningSize = size;
+      EncodeTuningKernel(kernel);
+      tuningPipeline = 0;
+    };
+    tuner.AddJob(std::move(job));
   }
 }
 
-void Generator::GenerateTextures()
+void Generator::EncodeTuningKernel(const std::string& kernel)
 {
-  // Delete any textures in case we are regenerating
-  if (heightMap)
+  UploadSettings();
+  renderDevice->BindBuffer(oceanUBO);
+
+  // Each kernel only runs in some of our configurations, so we switch to one that runs it. The
+  // textures come from the pool, so switching back and forth between jobs is cheap.
+  if (kernel == "generateSpectrum" || kernel == "generateHalfSpectrum")
+  {
+    SetHalfSpectrum(kernel == "generateHalfSpectrum");
+    GenerateSpectrum();
+  }
+  else if (kernel == "prepareFFT" || kernel == "prepareHalfFFT")
+  {
+    SetHalfSpectrum(kernel == "prepareHalfFFT");
+    DispatchPrepareFFT();
+  }
+  else if (kernel == "downsampleSlopes")
+  {
+    EncodeDownsampleSlopes(1);
+  }
+  else
   {
-    renderDevice->DestroyTexture2D(heightMap);
-    renderDevice->DestroyTexture2D(displacementMap);
-    renderDevice->DestroyTexture2D(gaussianImage);
-    renderDevice->DestroyTexture2D(initialSpectrum);
-    renderDevice->DestroyTexture2D(jacobian);
+    bool half = kernel == "resolveHalf" || kernel == "blendHalfMaps";
+    SetStoragePrecision(half ? StoragePrecision::Float16 : StoragePrecision::Float32);
+    SetInterpolated(kernel == "blendMaps" || kernel == "blendHalfMaps");
+    EncodeComputeFoam();
   }
+}
+
+void Generator::SetFFTCalculator(FFTCalculator* calc)
+{
+  if (calc == fftCalc)
+    return;
+
+  // Playback uploads frames of a fixed size, so it has to be stopped first.
+  assert(!bakedOcean);
+
+  // The pipeline is specialized for the size too.
+  ReleasePipeline();
+  fftCalc = calc;
+  textureSize = calc->GetTextureResolution();
+  AcquirePipeline();
+
+  // Every texture depends on the size. The old ones go back to the pool, so switching back later
+  // reuses them. The new ones hold whatever was last written to them until the spectrum is
+  // regenerated and the ocean simulated again.
+  ReleaseTextures();
+  GenerateTextures();
+  GeneratePreviousTextures();
+  spectrumValid = false;
+  numResults = 0;
+}
+
+void Generator::ReleaseTextures()
+{
+  pool->ReleaseTexture2D(heightMap);
+  pool->ReleaseTexture2D(displacementMap);
+  pool->ReleaseTexture2D(initialSpectrum);
+  pool->ReleaseTexture2D(slopeMap);
+  pool->ReleaseTexture2D(sampledHeightMap);
+  pool->ReleaseTexture2D(sampledDisplacementMap);
+  pool->ReleaseTexture2D(previousHeightMap);
+  pool->ReleaseTexture2D(previousDisplacementMap);
+  ReleaseBakedTextures();
 
+  heightMap = 0;
+  displacementMap = 0;
+  initialSpectrum = 0;
+  slopeMap = 0;
+  sampledHeightMap = 0;
+  sampledDisplacementMap = 0;
+  previousHeightMap = 0;
+  previousDisplacementMap = 0;
+}
+
+void Generator::GenerateTextures()
+{
   // Create our blank textures
   Vision::Texture2DDesc desc;
   desc.Width = textureSize;
@@ -120,36 +519,227 @@ void Generator::GenerateTextures()
   desc.WriteOnly = false;
   desc.Data = nullptr;
 
-  heightMap = renderDevice->CreateTexture2D(desc);
-  displacementMap = renderDevice->CreateTexture2D(desc);
-  gaussianImage = renderDevice->CreateTexture2D(desc);
-  initialSpectrum = renderDevice->CreateTexture2D(desc);
+  heightMap = pool->AcquireTexture2D(desc);
+  displacementMap = pool->AcquireTexture2D(desc);
 
-  // The jacobian only has one channel.
-  desc.PixelType = Vision::PixelType::R32Float;
-  jacobian = renderDevice->CreateTexture2D(desc);
+  // The slope map is filtered between its mips, which are written by our kernels.
+  desc.PixelType = Vision::PixelType::RGBA16Float;
+  desc.MipFilter = Vision::MipFilter::Linear;
+  desc.MipLevels = GetNumSlopeMips();
+  slopeMap = pool->AcquireTexture2D(desc);
 
-  GenerateNoise();
+  GenerateSampledTextures();
+  GenerateSpectrumTexture();
 }
 
-void Generator::GenerateNoise()
+void Generator::SetStoragePrecision(StoragePrecision precision)
 {
-  // Create data for our gaussian image on CPU.
-  std::vector<glm::vec4> randomValues(textureSize * textureSize, glm::vec4(0.0f));
+  if (precision == storagePrecision)
+    return;
+
+  storagePrecision = precision;
+  GenerateSampledTextures();
+}
 
-  // Our random pairs of values have std dev of 1 for mag by pythagorean thm.
-  float scale = 1.0 / glm::sqrt(2.0);
-  for (int i = 0; i < textureSize * textureSize; i++)
-    randomValues[i] = glm::gaussRand(glm::vec4(0.0f), glm::vec4(scale));
+void Generator::GenerateSampledTextures()
+{
+  // Release any textures in case we are changing precision
+  pool->ReleaseTexture2D(sampledHeightMap);
+  pool->ReleaseTexture2D(sampledDisplacementMap);
+
+  sampledHeightMap = 0;
+  sampledDisplacementMap = 0;
+
+  Vision::Texture2DDesc desc;
+  desc.Width = textureSize;
+  desc.Height = textureSize;
+  desc.MinFilter = Vision::MinMagFilter::Linear;
+  desc.MagFilter = Vision::MinMagFilter::Linear;
+  desc.AddressModeS = Vision::EdgeAddressMode::Repeat;
+  desc.AddressModeT = Vision::EdgeAddressMode::Repeat;
+  desc.WriteOnly = false;
+  desc.Data = nullptr;
+
+  // In full precision, the renderer samples the FFT's results directly unless they're blended.
+  bool half = storagePrecision == StoragePrecision::Float16;
+  if (half || interpolated || bakedOcean)
+  {
+    desc.PixelType = half ? Vision::PixelType::RGBA16Float : Vision::PixelType::RGBA32Float;
+    sampledHeightMap = pool->AcquireTexture2D(desc);
+    sampledDisplacementMap = pool->AcquireTexture2D(desc);
+  }
+}
+
+void Generator::SetInterpolated(bool interpolate)
+{
+  if (interpolate == interpolated)
+    return;
+
+  interpolated = interpolate;
+  numResults = 0;
+  pool->ReleaseTexture2D(previousHeightMap);
+  pool->ReleaseTexture2D(previousDisplacementMap);
+  previousHeightMap = 0;
+  previousDisplacementMap = 0;
+
+  GeneratePreviousTextures();
+  GenerateSampledTextures();
+}
+
+void Generator::GeneratePreviousTextures()
+{
+  if (!interpolated)
+    return;
+
+  // The previous result is written by the FFTs, so it has the same format as their maps.
+  Vision::Texture2DDesc desc;
+  desc.Width = textureSize;
+  desc.Height = textureSize;
+  desc.PixelType = Vision::PixelType::RGBA32Float;
+  desc.MinFilter = Vision::MinMagFilter::Linear;
+  desc.MagFilter = Vision::MinMagFilter::Linear;
+  desc.AddressModeS = Vision::EdgeAddressMode::Repeat;
+  desc.AddressModeT = Vision::EdgeAddressMode::Repeat;
+  desc.WriteOnly = false;
+  desc.Data = nullptr;
+  previousHeightMap = pool->AcquireTexture2D(desc);
+  previousDisplacementMap = pool->AcquireTexture2D(desc);
+}
+
+void Generator::GenerateBakedTextures()
+{
+  if (!bakedOcean)
+    return;
+
+  // The frames are uploaded in the half precision that they're stored in.
+  Vision::Texture2DDesc desc;
+  desc.Width = textureSize;
+  desc.Height = textureSize;
+  desc.PixelType = Vision::PixelType::RGBA16Float;
+  desc.MinFilter = Vision::MinMagFilter::Nearest;
+  desc.MagFilter = Vision::MinMagFilter::Nearest;
+  desc.AddressModeS = Vision::EdgeAddressMode::Repeat;
+  desc.AddressModeT = Vision::EdgeAddressMode::Repeat;
+  desc.WriteOnly = false;
+  desc.Data = nullptr;
+  for (std::size_t slot = 0; slot < 2; slot++)
+  {
+    bakedHeightMaps[slot] = pool->AcquireTexture2D(desc);
+    bakedDisplacementMaps[slot] = pool->AcquireTexture2D(desc);
+  }
+}
+
+void Generator::ReleaseBakedTextures()
+{
+  for (std::size_t slot = 0; slot < 2; slot++)
+  {
+    pool->ReleaseTexture2D(bakedHeightMaps[slot]);
+    pool->ReleaseTexture2D(bakedDisplacementMaps[slot]);
+    bakedHeightMaps[slot] = 0;
+    bakedDisplacementMaps[slot] = 0;
+  }
+}
+
+void Generator::SetHalfSpectrum(bool half)
+{
+  if (half == halfSpectrum)
+    return;
+
+  // The layouts differ, so the spectrum has to be regenerated.
+  halfSpectrum = half;
+  spectrumValid = false;
+  pool->ReleaseTexture2D(initialSpectrum);
+  GenerateSpectrumTexture();
+}
+
+void Generator::GenerateSpectrumTexture()
+{
+  Vision::Texture2DDesc desc;
+  desc.Width = GetSpectrumWidth();
+  desc.Height = GetSpectrumHeight();
+  desc.PixelType = Vision::PixelType::RGBA32Float;
+  desc.MinFilter = Vision::MinMagFilter::Nearest;
+  desc.MagFilter = Vision::MinMagFilter::Nearest;
+  desc.AddressModeS = Vision::EdgeAddressMode::ClampToEdge;
+  desc.AddressModeT = Vision::EdgeAddressMode::ClampToEdge;
+  desc.WriteOnly = false;
+  desc.Data = nullptr;
+  initialSpectrum = pool->AcquireTexture2D(desc);
+}
+
+std::size_t Generator::GetSpectrumWidth() const
+{
+  return halfSpectrum ? GetHalfSpectrumWidth(textureSize) : textureSize;
+}
+
+std::size_t Generator::GetSpectrumHeight() const
+{
+  return halfSpectrum ? GetHalfSpectrumHeight(textureSize) : textureSize;
+}
+
+void Generator::UpdateSpectrum(bool force)
+{
+  std::vector<glm::vec4> spectrum;
+  if (!force && LoadSpectrum(spectrumHash, GetSpectrumWidth(), GetSpectrumHeight(), spectrum))
+  {
+    renderDevice->SetTexture2DDataRaw(initialSpectrum, spectrum.data());
+    spectrumUnsaved = false;
+    return;
+  }
+
+  GenerateSpectrum();
+  spectrumUnsaved = true;
+  framesSinceChange = 0;
+}
+
+void Generator::SaveSpectrum()
+{
+  spectrumUnsaved = false;
+
+  // Only one save is in flight at a time, which is plenty since the settings had to settle first.
+  if (spectrumSave.valid())
+    spectrumSave.wait();
+
+  // The CPU evaluation performs the same math as generateSpectrum. We copy everything it needs so
+  // that the settings may keep changing while it runs.
+  spectrumSave = std::async(std::launch::async,
+                            [settings = oceanSettings, hash = spectrumHash, size = textureSize,
+                             half = halfSpectrum, width = GetSpectrumWidth(),
+                             height = GetSpectrumHeight()]()
+  {
+    SavedSpectrum saved = {hash, width, height, std::vector<glm::vec4>(width * height)};
+    if (half)
+      GenerateHalfSpectrum(settings, size, saved.texels.data());
+    else
+      GenerateInitialSpectrum(settings, size, saved.texels.data());
+
+    Waves::SaveSpectrum(hash, width, height, saved.texels);
+    return saved;
+  });
+}
+
+void Generator::UploadSavedSpectrum()
+{
+  if (!spectrumSave.valid() ||
+      spectrumSave.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    return;
 
-  renderDevice->SetTexture2DDataRaw(gaussianImage, randomValues.data());
+  // The settings, the size, or the layout may have changed while it was evaluated, in which case
+  // the GPU's spectrum is newer.
+  SavedSpectrum saved = spectrumSave.get();
+  if (saved.hash == spectrumHash && saved.width == GetSpectrumWidth() &&
+      saved.height == GetSpectrumHeight())
+    renderDevice->SetTexture2DDataRaw(initialSpectrum, saved.texels.data());
 }
 
 void Generator::GenerateSpectrum()
 {
-  renderDevice->BindImage2D(gaussianImage, 0, Vision::ImageAccess::ReadOnly);
+  // The kernels draw their own random numbers, so they only need somewhere to write.
   renderDevice->BindImage2D(initialSpectrum, 1, Vision::ImageAccess::WriteOnly);
-  renderDevice->DispatchCompute(computePS, "generateSpectrum", {textureSize, textureSize, 1});
+  if (halfSpectrum)
+    DispatchTiled("generateHalfSpectrum", GetSpectrumWidth(), GetSpectrumHeight());
+  else
+    DispatchTiled("generateSpectrum", textureSize, textureSize);
   renderDevice->ImageBarrier();
 }
 
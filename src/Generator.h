@@ -1,95 +1,257 @@
 #pragma once
 
+#include <bit>
+#include <cstdint>
+#include <future>
 #include <glm/glm.hpp>
+#include <span>
+#include <unordered_map>
+#include <vector>
 
 #include "renderer/RenderDevice.h"
 
+#include "BakedOcean.h"
+#include "CascadeScheduler.h"
 #include "FFTCalculator.h"
+#include "GeneratorSettings.h"
+#include "ResourcePool.h"
+#include "WorkgroupTuner.h"
 
 namespace Waves
 {
 
-struct GeneratorSettings
+// The precision of the maps that the renderer samples. The FFTs always work in full precision, and
+// half precision maps are rounded from their results once they're done.
+enum class StoragePrecision
 {
-  glm::ivec2 seed = glm::ivec2(12342, 8934); // The seed for random generation.
-
-  float U_10 = 40.0f;         // The speed of the wind.
-  float theta_0 = 25.0f;      // The CCW direction of the wind rel. to +x-axis.
-  float F = 800000.0f;        // The distance to a downwind shore (fetch).
-  float g = 9.8f;             // The acceleration due to gravity.
-  float swell = 0.5f;         // The factor of non-wind based waves.
-  float h = 100.0f;           // The depth of the ocean.
-  float displacement = 0.4f;  // The scalar used in displacing the vertices.
-  float time = 0.0f;          // The time in seconds since the program began.
-  float planeSize = 40.0f;    // The size of the plane in meters that this plane is simulating.
-  float scale = 1.0f;         // The global heightmap scalar.
-  float spread = 0.2f;        // The intensity of waves perp. to wind.
-  int boundWavelength = 0;    // Whether or not we bound the wavelength (1 = bound, 0 = unbound)
-  float wavelengthMin = 0.0f; // The minimum wavelength that is allowed
-  float wavelengthMax = 0.0f; // The maximum wavelength that is allowed
+  Float32,
+  Float16
 };
 
 // Manages the compute shaders for our wave generation
 class Generator
 {
 public:
-  Generator(Vision::RenderDevice* device, FFTCalculator* calc);
+  // The textures and buffers of the ocean come from the pool, at the size of the calculator.
+  Generator(Vision::RenderDevice* device, ResourcePool* pool, FFTCalculator* calc);
   ~Generator();
 
-  // Access the settings behind this ocean. If the spectrum is modified, then the next call to
-  // calculate ocean should set updateOcean to true.
+  // Switch to a calculator of another size, which changes the resolution of the ocean. The
+  // textures are swapped for ones of the new size from the pool, and the spectrum is regenerated
+  // the next time that the ocean is calculated. Can't be used during playback.
+  void SetFFTCalculator(FFTCalculator* calc);
+  FFTCalculator* GetFFTCalculator() const { return fftCalc; }
+
+  // Access the settings behind this ocean. The spectrum is regenerated whenever the settings that
+  // it depends on change.
   GeneratorSettings& GetOceanSettings() { return oceanSettings; }
 
   // Perform the necessary FFTs to calculate the change the ocean given a timestep since the last
-  // call.
+  // call. Setting updateOcean forces the spectrum to be regenerated on the GPU.
   void CalculateOcean(float timestep, bool updateOcean = false);
 
+  // Calculates several oceans in a single compute pass. The FFTs of every ocean that shares an
+  // FFTCalculator are batched together, so the number of dispatches and barriers for the FFTs
+  // doesn't grow with the number of oceans.
+  static void CalculateOceans(std::span<Generator* const> generators, float timestep,
+                              bool updateOcean = false);
+
+  // Calculates several oceans like above, with each updated as a scheduler chose for this frame.
+  // Oceans that are interpolated keep their previous result, and their sampled maps are blended
+  // between it and the latest every frame, whether or not they were simulated.
+  static void CalculateOceans(std::span<Generator* const> generators,
+                              std::span<const CascadeStep> steps, bool updateOcean = false);
+
   // Getter for the two textures used by wave shader to render.
-  Vision::ID GetHeightMap() const { return heightMap; }
-  Vision::ID GetDisplacementMap() const { return displacementMap; }
-  Vision::ID GetJacobianMap() const { return jacobian; }
+  Vision::ID GetHeightMap() const { return sampledHeightMap ? sampledHeightMap : heightMap; }
+  Vision::ID GetDisplacementMap() const
+  {
+    return sampledDisplacementMap ? sampledDisplacementMap : displacementMap;
+  }
+
+  // The slopes and the jacobian that the renderer shades the surface with, and their mips.
+  Vision::ID GetSlopeMap() const { return slopeMap; }
+  std::size_t GetNumSlopeMips() const { return std::bit_width(textureSize); }
+
+  // Choose the precision of the maps that the renderer samples. Half precision halves the memory
+  // and bandwidth of sampling them, at the cost of an extra copy after the FFTs.
+  void SetStoragePrecision(StoragePrecision precision);
+  StoragePrecision GetStoragePrecision() const { return storagePrecision; }
+
+  // Choose whether the initial spectrum is stored as the half spectrum, which only keeps the rows
+  // that aren't implied by Hermitian symmetry. Both produce the same maps.
+  void SetHalfSpectrum(bool half);
+  bool UsesHalfSpectrum() const { return halfSpectrum; }
+
+  // Play this ocean back from a cascade of a baked ocean instead of simulating it. Frames are
+  // uploaded straight from the file into textures of their own, without any spectrum or FFT work,
+  // and the two either side of the time are blended. The baked ocean must outlive the generator,
+  // and its cascade must match our texture size. Passing null returns to the simulation.
+  void SetPlayback(const BakedOcean* ocean, std::size_t cascade = 0);
+  bool IsPlayingBack() const { return bakedOcean != nullptr; }
 
-  // Reload the shaders that are used by this class.
+  // Reload the shaders that are used by this class, which are shared with every generator of our
+  // size. Reloading only recreates them when the shader or the tuned workgroups have changed.
   void LoadShaders(bool reload = false);
 
+  // Queues our kernels and those of our FFT calculator that haven't been tuned for our size. The
+  // jobs switch our settings and overwrite our textures, so they're meant for a generator that's
+  // only used for tuning, which must outlive them.
+  void AddTuningJobs(WorkgroupTuner& tuner);
+
 private:
-  void GenerateNoise();
+  // Upload our settings for the stages of this frame.
+  void UploadSettings();
+
+  // The stages that come before and after the FFTs. These must be encoded in a compute pass.
+  void EncodePrepareFFT(bool updateOcean);
+  void EncodeComputeFoam();
+  void DispatchPrepareFFT();
+
+  // Builds a mip of the slope map from the one above it.
+  void EncodeDownsampleSlopes(std::size_t mip);
+
+  // Dispatches a kernel over an image of the given size, in the workgroups that were tuned for it.
+  // While tuning, the candidate's pipeline and size are used instead.
+  void DispatchTiled(const char* kernel, std::size_t width, std::size_t height);
+
+  // Switches to a configuration that runs a kernel, and encodes it once.
+  void EncodeTuningKernel(const std::string& kernel);
+
+  // Share the pipeline of our size with the other generators of that size.
+  void AcquirePipeline();
+  void ReleasePipeline();
+
+  // Upload the baked frames either side of a time that aren't already in our textures, and set the
+  // blend between them.
+  void UploadBakedFrames(float time);
+
+  // Keep the previous result alongside the latest, so that the sampled maps can be blended.
+  void SetInterpolated(bool interpolate);
+
   void GenerateTextures();
+  void GenerateSampledTextures();
+  void GeneratePreviousTextures();
+  void GenerateBakedTextures();
+  void ReleaseBakedTextures();
+  void ReleaseTextures();
+  void GenerateSpectrumTexture();
   void GenerateSpectrum();
 
+  // The dimensions of the initial spectrum, which depend on its layout.
+  std::size_t GetSpectrumWidth() const;
+  std::size_t GetSpectrumHeight() const;
+
+  // Fill the initial spectrum for the current settings, from the cache unless forced.
+  void UpdateSpectrum(bool force);
+
+  // Evaluate the spectrum on the CPU in the background, and write it to the cache.
+  void SaveSpectrum();
+
+  // Replace the spectrum that the GPU generated with the one that was saved, once it's ready.
+  void UploadSavedSpectrum();
+
 private:
   Vision::RenderDevice* renderDevice = nullptr;
+  ResourcePool* pool = nullptr;
   FFTCalculator* fftCalc = nullptr;
 
   // The size of all textures owned by this generator.
   std::size_t textureSize;
 
-  // Store a static pipeline state so we don't have to recreate pipelines for all.
-  static inline bool generatedPS = false;
-  static inline Vision::ID computePS = 0;
+  // The kernels are specialized for a size by their workgroups, so we keep one pipeline for each
+  // size in use, and share it between every generator of that size. The last generator of a size
+  // destroys it.
+  struct SharedPipeline
+  {
+    Vision::ID pipeline = 0;
+    std::size_t numUsers = 0;
+  };
+  static inline std::unordered_map<std::size_t, SharedPipeline> pipelineCache;
+  SharedPipeline* sharedPipeline = nullptr;
+
+  // The kernels whose workgroups are tuned, and the candidate that is being timed, if any.
+  static constexpr const char* tiledKernels[] = {
+      "generateSpectrum", "generateHalfSpectrum", "prepareFFT", "prepareHalfFFT",
+      "computeFoam",      "resolveHalf",          "blendMaps",  "blendHalfMaps",
+      "downsampleSlopes"};
+  Vision::ID tuningPipeline = 0;
+  WorkgroupSize tuningSize;
 
   // Store the settings for our ocean.
-  bool updateSpectrum = true;
   GeneratorSettings oceanSettings;
   Vision::ID oceanUBO = 0;
 
+  // The hash of the settings that our spectrum was generated with, so that we only regenerate it
+  // when they change.
+  bool spectrumValid = false;
+  uint64_t spectrumHash = 0;
+
+  // We can't read the spectrum back from the GPU, so spectra that weren't in the cache are
+  // evaluated again on the CPU to be saved. We wait for the settings to stop changing first, so
+  // that dragging a slider doesn't save every intermediate spectrum.
+  //
+  // The CPU's approximations only agree with the GPU to about 1e-4 relative, so the saved spectrum
+  // is also uploaded in place of the GPU's. Only the first second after the settings change shows
+  // the GPU's spectrum, and from then on, the ocean is exactly what a warm start from the cache
+  // shows, since nothing else carries over between frames.
+  struct SavedSpectrum
+  {
+    uint64_t hash = 0;
+    std::size_t width = 0;
+    std::size_t height = 0;
+    std::vector<glm::vec4> texels;
+  };
+
+  static constexpr int framesBeforeSave = 60;
+  bool spectrumUnsaved = false;
+  int framesSinceChange = 0;
+  std::future<SavedSpectrum> spectrumSave;
+
   // h, dh/dx, dh/dz, Dx
   Vision::ID heightMap = 0;
 
   // Dz, dDx/dx, dDz/dz, dDx/dz
   Vision::ID displacementMap = 0;
 
-  // A randomly generated image on the CPU.
-  Vision::ID gaussianImage = 0;
+  // The maps that the renderer samples instead of the above when they exist, which are half
+  // precision copies or blends of the last two results.
+  StoragePrecision storagePrecision = StoragePrecision::Float32;
+  Vision::ID sampledHeightMap = 0;
+  Vision::ID sampledDisplacementMap = 0;
+
+  // The previous result of an interpolated ocean. Each simulation swaps these with the maps above,
+  // so that the FFTs overwrite the oldest result rather than copying the latest. They hold garbage
+  // until the ocean has been simulated twice, so we count its results up to that.
+  bool interpolated = false;
+  int numResults = 0;
+  Vision::ID previousHeightMap = 0;
+  Vision::ID previousDisplacementMap = 0;
 
-  // Store our generated spectrum which we propogate each frame.
+  // Store our generated spectrum which we propogate each frame. The half spectrum needs about half
+  // of the memory, and each of its amplitudes is only evaluated and propagated once.
+  bool halfSpectrum = true;
   Vision::ID initialSpectrum = 0;
 
+  // The baked ocean that we play back instead of simulating. The frames before and after the time
+  // are kept in half precision maps of their own, which the sampled maps are blended from. Each
+  // frame stays uploaded while it's in use, so moving on by a frame uploads only the new one.
+  const BakedOcean* bakedOcean = nullptr;
+  std::size_t bakedCascade = 0;
+  static constexpr std::size_t noBakedFrame = SIZE_MAX;
+  Vision::ID bakedHeightMaps[2] = {};
+  Vision::ID bakedDisplacementMaps[2] = {};
+  std::size_t bakedFrames[2] = {noBakedFrame, noBakedFrame};
+
   // Evaluate the jacobian of displacement at each point to determine where the wave curls in on
   // itself. At these point, we accumulate foam into a texture. This foam decays over time
   // exponentially. Since each simulation has its own tiling jacobian, it makes more sense to store
   // this texture in the generator.
-  Vision::ID jacobian = 0;
+  //
+  // The jacobian is kept in the slope map, beside the slopes along x and z and their squared
+  // length, so that the renderer shades each cascade from a single sample. It's always half
+  // precision, with a full chain of mips that is rebuilt whenever the maps change.
+  Vision::ID slopeMap = 0;
 };
 
 } // namespace Waves
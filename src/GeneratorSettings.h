@@ -0,0 +1,59 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <glm/glm.hpp>
+
+namespace Waves
+{
+
+// These settings are uploaded directly to the spectrum shaders, so the layout must match the
+// spectrumSettings uniform block.
+struct GeneratorSettings
+{
+  glm::ivec2 seed = glm::ivec2(12342, 8934); // The seed for random generation.
+
+  float U_10 = 40.0f;         // The speed of the wind.
+  float theta_0 = 25.0f;      // The CCW direction of the wind rel. to +x-axis.
+  float F = 800000.0f;        // The distance to a downwind shore (fetch).
+  float g = 9.8f;             // The acceleration due to gravity.
+  float swell = 0.5f;         // The factor of non-wind based waves.
+  float h = 100.0f;           // The depth of the ocean.
+  float displacement = 0.4f;  // The scalar used in displacing the vertices.
+  float time = 0.0f;          // The time in seconds since the program began.
+  float planeSize = 40.0f;    // The size of the plane in meters that this plane is simulating.
+  float scale = 1.0f;         // The global heightmap scalar.
+  float spread = 0.2f;        // The intensity of waves perp. to wind.
+  int boundWavelength = 0;    // Whether or not we bound the wavelength (1 = bound, 0 = unbound)
+  float wavelengthMin = 0.0f; // The minimum wavelength that is allowed
+  float wavelengthMax = 0.0f; // The maximum wavelength that is allowed
+  float repeatPeriod = 0.0f;  // The period in seconds that the ocean loops over (0 = never loops)
+  float blend = 1.0f;         // How far the sampled maps are between the last two results.
+  float padding[2] = {};      // Rounds the block up to a multiple of 16 bytes.
+};
+
+// Sets up the plane and wavelength bounds of the cascade at an index, like the demo's cascades. The
+// planes grow by prime factors to prevent tiling, and each wavelength is placed on the smallest
+// plane that it fits on for the most detail. Beyond the primes, the planes keep growing by a
+// similar ratio.
+inline void ConfigureCascade(GeneratorSettings& settings, std::size_t index)
+{
+  static const float primeFactors[] = {5.0f, 17.0f, 101.0f, 503.0f};
+  std::size_t numFactors = sizeof(primeFactors) / sizeof(primeFactors[0]);
+
+  float planeSize = primeFactors[std::min(index, numFactors - 1)];
+  float previousSize = index == 0 ? 0.0f : primeFactors[std::min(index - 1, numFactors - 1)];
+  for (std::size_t i = numFactors; i <= index; i++)
+  {
+    previousSize = planeSize;
+    planeSize *= 5.0f;
+  }
+
+  // Enable bound wavelength to prevent frequencies from adding themselves twice.
+  settings.planeSize = planeSize;
+  settings.boundWavelength = 1;
+  settings.wavelengthMax = planeSize / 2.0f;
+  settings.wavelengthMin = previousSize / 2.0f;
+}
+
+} // namespace Waves
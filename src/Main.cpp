@@ -1,8 +1,40 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
 #include "Waves.h"
 
-int main()
+int main(int argc, char** argv)
 {
-  Waves::WaveApp* app = new Waves::WaveApp();
+  // Pass --cascades <count> to choose how many cascades make up the ocean, --playback <file> to
+  // play a baked ocean back instead of simulating one, --trace <file> to profile the first frames
+  // into a Chrome trace, --fixed-step <seconds> to advance every frame by the same time,
+  // --shader-cache off to compile every shader instead of loading them from cache/spirv, and
+  // --tune-workgroups off|all to skip tuning the compute workgroups, or tune all of them again.
+  Waves::WaveAppOptions options;
+  for (int i = 1; i + 1 < argc; i++)
+  {
+    if (std::strcmp(argv[i], "--cascades") == 0)
+      options.numCascades = std::strtoul(argv[++i], nullptr, 10);
+    else if (std::strcmp(argv[i], "--playback") == 0)
+      options.playbackPath = argv[++i];
+    else if (std::strcmp(argv[i], "--trace") == 0)
+      options.tracePath = argv[++i];
+    else if (std::strcmp(argv[i], "--fixed-step") == 0)
+      options.fixedStep = std::strtof(argv[++i], nullptr);
+    else if (std::strcmp(argv[i], "--shader-cache") == 0)
+      options.shaderCache = std::strcmp(argv[++i], "off") != 0;
+    else if (std::strcmp(argv[i], "--tune-workgroups") == 0)
+    {
+      const char* mode = argv[++i];
+      if (std::strcmp(mode, "off") == 0)
+        options.workgroupTuning = Waves::WorkgroupTuning::Off;
+      else if (std::strcmp(mode, "all") == 0)
+        options.workgroupTuning = Waves::WorkgroupTuning::All;
+    }
+  }
+
+  Waves::WaveApp* app = new Waves::WaveApp(options);
   app->Run();
   delete app;
-}
\ No newline at end of file
+}
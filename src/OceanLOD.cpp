@@ -0,0 +1,143 @@
+#include "OceanLOD.h"
+
+#include <utility>
+
+namespace Waves
+{
+
+void OceanLOD::Select(const glm::vec3& cameraPosition, const glm::mat4& viewProjection)
+{
+  patches.clear();
+  nodes.clear();
+
+  Frustum frustum = ExtractFrustum(viewProjection);
+
+  // The root follows the camera in steps of half of its size. That keeps every node on a fixed grid
+  // of its own size, so patches don't swim as we move, and keeps the camera at least a quarter of
+  // the root away from its edges.
+  float halfSize = settings.rootSize * 0.5f;
+  glm::vec2 camera(cameraPosition.x, cameraPosition.z);
+  glm::vec2 center = glm::floor(camera / halfSize + 0.5f) * halfSize;
+
+  Node root;
+  root.origin = center - halfSize;
+  root.size = settings.rootSize;
+  if (IsVisible(frustum, root))
+    nodes.push_back(root);
+
+  // We visit the tree a level at a time, so that if we run out of patches, only the finest levels
+  // lose detail. This counts the patches that we've emitted along with the nodes still to visit.
+  std::size_t numPatches = nodes.size();
+  while (!nodes.empty())
+  {
+    // Splitting replaces each node with up to four children.
+    children.clear();
+    std::size_t numSplit = 0;
+    for (const Node& node : nodes)
+    {
+      if (!CanSplit(cameraPosition, node))
+        continue;
+
+      numSplit++;
+      for (int i = 0; i < 4; i++)
+      {
+        Node child;
+        child.size = node.size * 0.5f;
+        child.origin = node.origin + glm::vec2(i & 1, i >> 1) * child.size;
+        child.level = node.level + 1;
+        if (IsVisible(frustum, child))
+          children.push_back(child);
+      }
+    }
+
+    // A level is only split if all of its nodes that want to be fit. Otherwise a node that was
+    // kept whole would neighbor the children of another while the camera is within its range, so
+    // they wouldn't have morphed into its grid yet, and the seam between them would crack.
+    bool split = numPatches - numSplit + children.size() <= maxOceanPatches;
+    if (split)
+      numPatches += children.size() - numSplit;
+    else
+      children.clear();
+
+    for (const Node& node : nodes)
+    {
+      if (split && CanSplit(cameraPosition, node))
+        continue;
+
+      // The parent was split because the camera was within its range, so the patch finishes
+      // morphing into the parent's grid by the end of that range.
+      OceanPatch patch;
+      patch.origin = node.origin;
+      patch.size = node.size;
+      patch.morphEnd = settings.lodRange * 2.0f * node.size;
+      patches.push_back(patch);
+    }
+
+    std::swap(nodes, children);
+  }
+}
+
+std::size_t OceanLOD::GetNumTriangles() const
+{
+  std::size_t resolution = static_cast<std::size_t>(settings.patchResolution);
+  return patches.size() * 2 * resolution * resolution;
+}
+
+OceanLOD::Frustum OceanLOD::ExtractFrustum(const glm::mat4& viewProjection)
+{
+  // Each plane is a sum of the rows of the matrix (Gribb and Hartmann). We skip the near plane,
+  // whose row depends on the depth range of the API, since it culls almost nothing anyway.
+  auto row = [&viewProjection](int i)
+  {
+    return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i],
+                     viewProjection[3][i]);
+  };
+
+  Frustum frustum;
+  frustum.planes[0] = row(3) + row(0); // Left
+  frustum.planes[1] = row(3) - row(0); // Right
+  frustum.planes[2] = row(3) + row(1); // Bottom
+  frustum.planes[3] = row(3) - row(1); // Top
+  frustum.planes[4] = row(3) - row(2); // Far
+  return frustum;
+}
+
+bool OceanLOD::IsVisible(const Frustum& frustum, const Node& node) const
+{
+  // The waves can move the surface away from the node in any direction, so we grow its bounds by
+  // the most that they move it.
+  float bound = settings.heightBound;
+  glm::vec3 min(node.origin.x - bound, -bound, node.origin.y - bound);
+  glm::vec3 max(node.origin.x + node.size + bound, bound, node.origin.y + node.size + bound);
+
+  // The box is outside if the corner farthest along a plane's normal is still behind it.
+  for (const glm::vec4& plane : frustum.planes)
+  {
+    glm::vec3 corner(plane.x > 0.0f ? max.x : min.x, plane.y > 0.0f ? max.y : min.y,
+                     plane.z > 0.0f ? max.z : min.z);
+    if (plane.x * corner.x + plane.y * corner.y + plane.z * corner.z + plane.w < 0.0f)
+      return false;
+  }
+
+  return true;
+}
+
+bool OceanLOD::CanSplit(const glm::vec3& cameraPosition, const Node& node) const
+{
+  return node.level + 1 < settings.numLevels && ShouldSplit(cameraPosition, node);
+}
+
+bool OceanLOD::ShouldSplit(const glm::vec3& cameraPosition, const Node& node) const
+{
+  // Use the distance to the flat node rather than its bounds, which would split small nodes far
+  // more than their size calls for.
+  glm::vec2 camera(cameraPosition.x, cameraPosition.z);
+  glm::vec2 closest = glm::max(node.origin, glm::min(camera, node.origin + node.size));
+  glm::vec2 offset = camera - closest;
+
+  float range = settings.lodRange * node.size;
+  float distanceSquared = glm::dot(offset, offset) + cameraPosition.y * cameraPosition.y;
+  return distanceSquared < range * range;
+}
+
+} // namespace Waves
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+namespace Waves
+{
+
+// The most patches that can be drawn in one frame. This must match MAX_PATCHES in waveShader.glsl,
+// and keeps the patches within the smallest uniform buffer that every device supports.
+constexpr std::size_t maxOceanPatches = 1024;
+
+struct OceanLODSettings
+{
+  float rootSize = 8192.0f;  // The width of the square around the camera that the ocean covers.
+  int numLevels = 13;        // The number of levels in the quadtree, including the root.
+  int patchResolution = 32;  // The number of quads along the edge of a patch, which is even.
+  float lodRange = 2.0f;     // Nodes are split when the camera is closer than this many widths.
+  float morphRegion = 0.3f;  // The fraction at the end of each level's range used to morph.
+  float heightBound = 20.0f; // The farthest that the waves move the surface, in any direction.
+};
+
+// A square patch of the ocean's grid, laid out like the patches in waveShader.glsl.
+struct OceanPatch
+{
+  glm::vec2 origin; // The corner of the patch with the smallest XZ coordinates.
+  float size = 0.0f;
+  float morphEnd = 0.0f; // The distance at which the patch has fully morphed into its parent.
+};
+
+// Chooses the patches that the ocean is drawn with each frame, using a quadtree around the camera.
+// Every patch has the same number of vertices, and nodes are split while the camera is within
+// lodRange of their widths, so patches shrink as they get closer and the triangles on screen stay
+// at a roughly constant density. Patches outside of the view frustum are skipped entirely. When
+// there are more patches than we can draw, the finest levels are left out whole.
+//
+// To hide the seams between levels, the vertices of each patch morph into the grid of its parent
+// as they approach the end of their level's range, like in Continuous Distance-Dependent LOD
+// (Strugar 2009). The vertex shader computes the morph from morphEnd and morphRegion.
+class OceanLOD
+{
+public:
+  void SetSettings(const OceanLODSettings& lodSettings) { settings = lodSettings; }
+  const OceanLODSettings& GetSettings() const { return settings; }
+
+  // Selects the patches for a camera. The frustum is taken from the view projection matrix.
+  void Select(const glm::vec3& cameraPosition, const glm::mat4& viewProjection);
+
+  // The patches from the last selection, ordered from the coarsest to the finest.
+  std::span<const OceanPatch> GetPatches() const { return patches; }
+
+  // The number of triangles that the last selection draws.
+  std::size_t GetNumTriangles() const;
+
+private:
+  // The planes of the view frustum, with normals that point inside.
+  struct Frustum
+  {
+    glm::vec4 planes[5];
+  };
+
+  struct Node
+  {
+    glm::vec2 origin;
+    float size = 0.0f;
+    int level = 0;
+  };
+
+  static Frustum ExtractFrustum(const glm::mat4& viewProjection);
+  bool IsVisible(const Frustum& frustum, const Node& node) const;
+  bool ShouldSplit(const glm::vec3& cameraPosition, const Node& node) const;
+
+  // Whether a node should be split and there's a finer level for its children.
+  bool CanSplit(const glm::vec3& cameraPosition, const Node& node) const;
+
+private:
+  OceanLODSettings settings;
+  std::vector<OceanPatch> patches;
+
+  // The nodes of the level being visited and of the next one, which are kept between selections.
+  std::vector<Node> nodes;
+  std::vector<Node> children;
+};
+
+} // namespace Waves
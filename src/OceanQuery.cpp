@@ -0,0 +1,194 @@
+#include "OceanQuery.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include "Simd.h"
+
+namespace Waves
+{
+
+namespace
+{
+
+using Simd::Float;
+using Simd::Int;
+
+// The texels and weights of a bilinear sample in each lane, which can be reused for any channel of
+// either map since they share a layout.
+struct BilinearSample
+{
+  Int indices[4]; // The offsets of the four texels in floats, in the order 00, 10, 01, 11.
+  Float fx, fy;   // The weights of the second texel along each axis.
+};
+
+// Mirrors sampling with linear filtering and repeat wrapping, where texel centers lie on the half
+// texels.
+BilinearSample SetupSample(const OceanCascade& cascade, Float x, Float z)
+{
+  float size = static_cast<float>(cascade.textureSize);
+  float texelsPerMeter = size / cascade.planeSize;
+  Float tx = x * texelsPerMeter - 0.5f;
+  Float ty = z * texelsPerMeter - 0.5f;
+
+  // Wrap into [0, size) first, which works for sizes that aren't powers of two, and for negative
+  // texels. Rounding may land a tiny negative texel on the size itself, which then samples the
+  // first texel with full weight, as it should.
+  float texelsToImages = 1.0f / size;
+  tx = tx - Simd::Floor(tx * texelsToImages) * size;
+  ty = ty - Simd::Floor(ty * texelsToImages) * size;
+  Float x0 = Simd::Min(Simd::Floor(tx), size - 1.0f);
+  Float y0 = Simd::Min(Simd::Floor(ty), size - 1.0f);
+
+  BilinearSample sample;
+  sample.fx = tx - x0;
+  sample.fy = ty - y0;
+
+  // Only the texel after the last one wraps around.
+  Float x1 = x0 + 1.0f;
+  Float y1 = y0 + 1.0f;
+  Int ix0 = Simd::ToInt(x0);
+  Int iy0 = Simd::ToInt(y0);
+  Int ix1 = Simd::ToInt(Simd::Select(x1 >= size, 0.0f, x1));
+  Int iy1 = Simd::ToInt(Simd::Select(y1 >= size, 0.0f, y1));
+
+  Int rowStride = static_cast<int32_t>(cascade.textureSize * 4);
+  Int row0 = iy0 * rowStride;
+  Int row1 = iy1 * rowStride;
+  ix0 = ix0 * 4;
+  ix1 = ix1 * 4;
+
+  sample.indices[0] = row0 + ix0;
+  sample.indices[1] = row0 + ix1;
+  sample.indices[2] = row1 + ix0;
+  sample.indices[3] = row1 + ix1;
+  return sample;
+}
+
+Float Sample(const glm::vec4* map, const BilinearSample& sample, int channel)
+{
+  const float* base = &map->x + channel;
+  Float top = Simd::Lerp(Simd::Gather(base, sample.indices[0]),
+                         Simd::Gather(base, sample.indices[1]), sample.fx);
+  Float bottom = Simd::Lerp(Simd::Gather(base, sample.indices[2]),
+                            Simd::Gather(base, sample.indices[3]), sample.fx);
+  return Simd::Lerp(top, bottom, sample.fy);
+}
+
+// The horizontal offset that every cascade adds to a point, following waveVertex.
+void HorizontalOffset(std::span<const OceanCascade> cascades, Float x, Float z, Float& offsetX,
+                      Float& offsetZ)
+{
+  offsetX = 0.0f;
+  offsetZ = 0.0f;
+  for (const OceanCascade& cascade : cascades)
+  {
+    BilinearSample sample = SetupSample(cascade, x + offsetX, z + offsetZ);
+    offsetX += cascade.displacementScale * Sample(cascade.heightMap, sample, 3);
+    offsetZ += cascade.displacementScale * Sample(cascade.displacementMap, sample, 0);
+  }
+}
+
+} // namespace
+
+OceanQuery::OceanQuery(ThreadPool* pool) : threadPool(pool) {}
+
+void OceanQuery::SetCascades(std::span<const OceanCascade> oceanCascades)
+{
+  for (const OceanCascade& cascade : oceanCascades)
+    assert(cascade.textureSize > 0);
+
+  cascades.assign(oceanCascades.begin(), oceanCascades.end());
+}
+
+void OceanQuery::Query(std::span<const glm::vec2> positions, std::span<OceanSample> samples) const
+{
+  assert(samples.size() >= positions.size());
+
+  // Small chunks would spend more time synchronizing than sampling.
+  constexpr std::size_t minChunkSize = 1024;
+  if (threadPool && positions.size() > minChunkSize)
+  {
+    threadPool->ParallelFor(positions.size(), [&](std::size_t begin, std::size_t end)
+                            { QueryRange(&positions[begin], &samples[begin], end - begin); },
+                            minChunkSize);
+  }
+  else
+  {
+    QueryRange(positions.data(), samples.data(), positions.size());
+  }
+}
+
+void OceanQuery::QueryRange(const glm::vec2* positions, OceanSample* samples,
+                            std::size_t count) const
+{
+  constexpr std::size_t width = Simd::width;
+  for (std::size_t first = 0; first < count; first += width)
+  {
+    // Transpose the points into lanes. The last pack repeats its final point to fill every lane.
+    std::size_t numLanes = std::min(width, count - first);
+    float xs[width], zs[width];
+    for (std::size_t lane = 0; lane < width; lane++)
+    {
+      const glm::vec2& position = positions[first + std::min(lane, numLanes - 1)];
+      xs[lane] = position.x;
+      zs[lane] = position.y;
+    }
+
+    Float queryX = Simd::Load(xs);
+    Float queryZ = Simd::Load(zs);
+
+    // Find the point of the surface that moves to the query position. If the offset varied slowly
+    // enough, this would be exact after one iteration, and it quickly converges otherwise.
+    Float x = queryX, z = queryZ;
+    Float offsetX, offsetZ;
+    for (int i = 0; i < iterations; i++)
+    {
+      HorizontalOffset(cascades, x, z, offsetX, offsetZ);
+      x = queryX - offsetX;
+      z = queryZ - offsetZ;
+    }
+
+    // Displace that point through every cascade, accumulating the height and slopes like the
+    // wave shaders do. Each cascade's slopes are taken over its own displaced surface, like the
+    // slope maps that waveFragment adds up.
+    offsetX = 0.0f;
+    offsetZ = 0.0f;
+    Float height = 0.0f;
+    Float slopeX = 0.0f, slopeZ = 0.0f;
+    for (const OceanCascade& cascade : cascades)
+    {
+      BilinearSample sample = SetupSample(cascade, x + offsetX, z + offsetZ);
+      Float scale = cascade.displacementScale;
+
+      height += Sample(cascade.heightMap, sample, 0);
+      offsetX += scale * Sample(cascade.heightMap, sample, 3);
+      offsetZ += scale * Sample(cascade.displacementMap, sample, 0);
+
+      Float dDxdx = scale * Sample(cascade.displacementMap, sample, 1);
+      Float dDzdz = scale * Sample(cascade.displacementMap, sample, 2);
+      slopeX += Sample(cascade.heightMap, sample, 1) / (Float(1.0f) + dDxdx);
+      slopeZ += Sample(cascade.heightMap, sample, 2) / (Float(1.0f) + dDzdz);
+    }
+
+    Float inverseLength = Float(1.0f) / Simd::Sqrt(slopeX * slopeX + slopeZ * slopeZ + 1.0f);
+
+    float results[6][width];
+    Simd::Store(results[0], height);
+    Simd::Store(results[1], offsetX);
+    Simd::Store(results[2], offsetZ);
+    Simd::Store(results[3], -slopeX * inverseLength);
+    Simd::Store(results[4], inverseLength);
+    Simd::Store(results[5], -slopeZ * inverseLength);
+
+    for (std::size_t lane = 0; lane < numLanes; lane++)
+    {
+      OceanSample& sample = samples[first + lane];
+      sample.height = results[0][lane];
+      sample.displacement = glm::vec2(results[1][lane], results[2][lane]);
+      sample.normal = glm::vec3(results[3][lane], results[4][lane], results[5][lane]);
+    }
+  }
+}
+
+} // namespace Waves
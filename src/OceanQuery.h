@@ -0,0 +1,67 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <span>
+#include <vector>
+
+#include "ThreadPool.h"
+
+namespace Waves
+{
+
+// One of the simulations that make up the ocean surface. The maps are laid out like the textures
+// that the generators write, with textureSize * textureSize texels, and tile every planeSize
+// meters.
+struct OceanCascade
+{
+  const glm::vec4* heightMap = nullptr;       // h, dh/dx, dh/dz, Dx
+  const glm::vec4* displacementMap = nullptr; // Dz, dDx/dx, dDz/dz, dDx/dz
+  std::size_t textureSize = 0;
+  float planeSize = 1.0f;
+  float displacementScale = 1.0f;
+};
+
+// The state of the ocean surface above a point.
+struct OceanSample
+{
+  float height = 0.0f;    // The height of the surface.
+  glm::vec2 displacement; // The horizontal distance that the surface at this point moved.
+  glm::vec3 normal;       // The normal of the surface.
+};
+
+// Answers questions about the ocean's surface on the CPU, so that physics and gameplay don't need
+// to read back from the GPU. The cascades are combined exactly like waveVertex combines them: each
+// one is sampled with bilinear filtering and repeat wrapping, at the position that the previous
+// cascades displaced the point to. Since the surface moves horizontally, the point of the surface
+// that ends up above a query position isn't the point at that position, so we find it with a few
+// fixed-point iterations first.
+//
+// Points are processed several at a time using the vector units, and batches are split across the
+// thread pool.
+class OceanQuery
+{
+public:
+  OceanQuery(ThreadPool* threadPool = nullptr);
+
+  // The cascades that make up the surface, in the order that waveVertex samples them. The maps
+  // must stay alive.
+  void SetCascades(std::span<const OceanCascade> oceanCascades);
+
+  // The number of fixed-point iterations used to undo the horizontal displacement. Each one
+  // roughly multiplies the error by the steepness of the waves.
+  void SetIterations(int count) { iterations = count; }
+  int GetIterations() const { return iterations; }
+
+  // Samples the surface above each world space XZ position.
+  void Query(std::span<const glm::vec2> positions, std::span<OceanSample> samples) const;
+
+private:
+  void QueryRange(const glm::vec2* positions, OceanSample* samples, std::size_t count) const;
+
+private:
+  ThreadPool* threadPool = nullptr;
+  std::vector<OceanCascade> cascades;
+  int iterations = 4;
+};
+
+} // namespace Waves
@@ -0,0 +1,169 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace Waves
+{
+
+Profiler& Profiler::Get()
+{
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::Profiler()
+{
+  stages.emplace_back();
+}
+
+void Profiler::BeginFrame()
+{
+  enabled = requestEnabled;
+  if (!enabled)
+    return;
+
+  if (pendingCapture > 0)
+  {
+    framesToCapture = pendingCapture;
+    pendingCapture = 0;
+    traceStart = Clock::now();
+    traceEvents.clear();
+  }
+}
+
+void Profiler::EndFrame()
+{
+  if (!enabled)
+    return;
+
+  // Every stage gets a sample each frame, even if it didn't run, so the averages are per frame.
+  for (Stage& stage : stages)
+  {
+    stage.history[historyIndex] = static_cast<float>(stage.frameTime);
+    stage.frameTime = 0.0;
+  }
+
+  historyIndex = (historyIndex + 1) % historySize;
+  numFrames++;
+
+  if (framesToCapture > 0 && --framesToCapture == 0)
+    WriteTrace();
+}
+
+void Profiler::BeginScope(const char* name)
+{
+  std::size_t parent = openScopes.empty() ? 0 : openScopes.back().stage;
+
+  OpenScope scope;
+  scope.stage = FindStage(parent, name);
+  scope.start = Clock::now();
+  openScopes.push_back(scope);
+}
+
+void Profiler::EndScope()
+{
+  Clock::time_point end = Clock::now();
+  OpenScope scope = openScopes.back();
+  openScopes.pop_back();
+
+  Stage& stage = stages[scope.stage];
+  stage.frameTime += std::chrono::duration<double, std::milli>(end - scope.start).count();
+
+  if (framesToCapture > 0)
+  {
+    TraceEvent event;
+    event.name = stage.name;
+    event.start = std::chrono::duration<double, std::micro>(scope.start - traceStart).count();
+    event.duration = std::chrono::duration<double, std::micro>(end - scope.start).count();
+    traceEvents.push_back(event);
+  }
+}
+
+void Profiler::CaptureTrace(const std::string& path, std::size_t numFrames)
+{
+  tracePath = path;
+  pendingCapture = std::max<std::size_t>(numFrames, 1);
+  requestEnabled = true;
+}
+
+std::span<const StageStatistics> Profiler::GetStatistics()
+{
+  statistics.clear();
+  for (std::size_t child : stages[0].children)
+    AppendStatistics(child);
+
+  return statistics;
+}
+
+std::size_t Profiler::FindStage(std::size_t parent, const char* name)
+{
+  // Stages are identified by their names within their parents, so the same scope in different
+  // places is timed separately. There are only a few children for each stage.
+  for (std::size_t child : stages[parent].children)
+  {
+    if (stages[child].name == name || std::strcmp(stages[child].name, name) == 0)
+      return child;
+  }
+
+  Stage stage;
+  stage.name = name;
+  stage.depth = parent == 0 ? 0 : stages[parent].depth + 1;
+  stages.push_back(stage);
+
+  std::size_t index = stages.size() - 1;
+  stages[parent].children.push_back(index);
+  return index;
+}
+
+void Profiler::AppendStatistics(std::size_t index)
+{
+  const Stage& stage = stages[index];
+  std::size_t numSamples = std::min(numFrames, historySize);
+
+  StageStatistics stats;
+  stats.name = stage.name;
+  stats.depth = stage.depth;
+  for (std::size_t i = 0; i < numSamples; i++)
+  {
+    stats.average += stage.history[i];
+    stats.max = std::max(stats.max, stage.history[i]);
+  }
+
+  if (numSamples > 0)
+    stats.average /= static_cast<float>(numSamples);
+
+  statistics.push_back(stats);
+  for (std::size_t child : stage.children)
+    AppendStatistics(child);
+}
+
+void Profiler::WriteTrace()
+{
+  // Each scope is a complete event, and the viewer nests them by their times.
+  std::ofstream file(tracePath);
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  char buffer[256];
+  for (std::size_t i = 0; i < traceEvents.size(); i++)
+  {
+    const TraceEvent& event = traceEvents[i];
+    std::snprintf(buffer, sizeof(buffer),
+                  "{\"name\": \"%s\", \"cat\": \"waves\", \"ph\": \"X\", \"ts\": %.3f, "
+                  "\"dur\": %.3f, \"pid\": 1, \"tid\": 1}",
+                  event.name, event.start, event.duration);
+    file << "  " << buffer << (i + 1 < traceEvents.size() ? ",\n" : "\n");
+  }
+  file << "]}\n";
+
+  if (!file)
+    std::cerr << "Failed to write trace " << tracePath << std::endl;
+  else
+    std::cerr << "Wrote trace " << tracePath << std::endl;
+
+  traceEvents.clear();
+}
+
+} // namespace Waves
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <chrono>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Waves
+{
+
+// The timing of one stage of the frame, averaged over the last few frames.
+struct StageStatistics
+{
+  std::string_view name;
+  int depth = 0;         // The number of stages that this one is nested within.
+  float average = 0.0f;  // In milliseconds per frame.
+  float max = 0.0f;      // In milliseconds per frame.
+};
+
+// Times the stages of each frame with nested scopes, keeping rolling statistics for every stage and
+// optionally recording a few frames as a Chrome trace (chrome://tracing or ui.perfetto.dev).
+//
+// Vision doesn't expose GPU timestamp queries, so stages are timed on the CPU. For the stages that
+// only encode GPU work, that's the time spent encoding it rather than the time the GPU spends.
+//
+// Scopes must be opened and closed on the main thread, between BeginFrame and EndFrame. While the
+// profiler is disabled, a scope only checks a flag.
+class Profiler
+{
+public:
+  static Profiler& Get();
+
+  // Enabling or disabling takes effect from the next frame, so scopes are never left unbalanced.
+  void SetEnabled(bool enable) { requestEnabled = enable; }
+  static bool IsEnabled() { return enabled; }
+
+  void BeginFrame();
+  void EndFrame();
+
+  // The name must outlive the profiler, which string literals do.
+  void BeginScope(const char* name);
+  void EndScope();
+
+  // Records the next frames, and writes them to a Chrome trace_event JSON file once they're done.
+  // Enables the profiler if it isn't already.
+  void CaptureTrace(const std::string& path, std::size_t numFrames);
+  bool IsCapturing() const { return framesToCapture > 0 || pendingCapture > 0; }
+
+  // The statistics of every stage that has run, with each stage followed by the stages within it.
+  std::span<const StageStatistics> GetStatistics();
+
+  // The number of frames that the statistics are gathered over.
+  static constexpr std::size_t historySize = 120;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Stage
+  {
+    const char* name = nullptr;
+    int depth = 0;
+    std::vector<std::size_t> children;
+
+    // The time spent in this stage during the current frame, and during the last few frames.
+    double frameTime = 0.0;
+    float history[historySize] = {};
+  };
+
+  struct OpenScope
+  {
+    std::size_t stage = 0;
+    Clock::time_point start;
+  };
+
+  struct TraceEvent
+  {
+    const char* name = nullptr;
+    double start = 0.0;    // In microseconds since the capture began.
+    double duration = 0.0; // In microseconds.
+  };
+
+  Profiler();
+
+  std::size_t FindStage(std::size_t parent, const char* name);
+  void AppendStatistics(std::size_t stage);
+  void WriteTrace();
+
+private:
+  static inline bool enabled = false;
+  bool requestEnabled = false;
+
+  // The first stage is the root that every other stage is nested within.
+  std::vector<Stage> stages;
+  std::vector<OpenScope> openScopes;
+  std::size_t historyIndex = 0;
+  std::size_t numFrames = 0;
+
+  std::vector<StageStatistics> statistics;
+
+  // A capture waits for the next frame to begin, so that it only holds whole frames.
+  std::string tracePath;
+  std::size_t pendingCapture = 0;
+  std::size_t framesToCapture = 0;
+  Clock::time_point traceStart;
+  std::vector<TraceEvent> traceEvents;
+};
+
+// Times the enclosing block as a stage of the frame.
+class ProfileScope
+{
+public:
+  explicit ProfileScope(const char* name) : active(Profiler::IsEnabled())
+  {
+    if (active)
+      Profiler::Get().BeginScope(name);
+  }
+
+  ~ProfileScope()
+  {
+    if (active)
+      Profiler::Get().EndScope();
+  }
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+  bool active;
+};
+
+} // namespace Waves
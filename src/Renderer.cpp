@@ -1,27 +1,37 @@
 #include "Renderer.h"
 
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+
 #include "core/Input.h"
 
-#include "renderer/MeshGenerator.h"
-#include "renderer/shader/ShaderCompiler.h"
+#include "Profiler.h"
+#include "ShaderCache.h"
 
 namespace Waves
 {
 
-WaveRenderer::WaveRenderer(Vision::RenderDevice* device, Vision::Renderer* render, float w, float h)
-  : renderDevice(device), renderer(render), width(w), height(h)
+namespace
+{
+
+// Every pipeline of the renderer is built from the shaders in this file.
+constexpr const char* shaderPath = "resources/waveShader.glsl";
+
+} // namespace
+
+WaveRenderer::WaveRenderer(Vision::RenderDevice* device, Vision::Renderer* render,
+                           ResourcePool* resourcePool, float w, float h)
+  : renderDevice(device), renderer(render), width(w), height(h), pool(resourcePool)
 {
   camera = new Vision::PerspectiveCamera(width, height, 1.0f, 1500.0f);
   camera->SetPosition({0.0f, 5.0f, 0.0f});
   camera->SetRotation({-5.0f, -135.0f, 0.0f});
 
-  planeMesh = Vision::MeshGenerator::CreatePlaneMesh(40.0f, 40.0f, 1024, 1024, true);
-  cubeMesh = Vision::MeshGenerator::CreateCubeMesh(1.0f);
-  quadMesh = Vision::MeshGenerator::CreatePlaneMesh(2.0f, 2.0f, 1, 1);
-
   GeneratePasses();
   GeneratePipelines();
   GenerateBuffers();
+  GeneratePatchIndices();
 }
 
 WaveRenderer::~WaveRenderer()
@@ -29,18 +39,14 @@ WaveRenderer::~WaveRenderer()
   // Destroy all resources
   renderDevice->DestroyPipeline(wavePS);
   renderDevice->DestroyPipeline(wireframePS);
-  renderDevice->DestroyPipeline(skyboxPS);
   renderDevice->DestroyPipeline(postPS);
   renderDevice->DestroyBuffer(wavesBuffer);
-  renderDevice->DestroyFramebuffer(framebuffer);
-  renderDevice->DestroyFramebuffer(skyboxBuffer);
+  renderDevice->DestroyBuffer(patchIndices);
+  renderDevice->DestroyBuffer(patchBuffer);
+  pool->ReleaseFramebuffer(framebuffer);
   renderDevice->DestroyRenderPass(wavePass);
-  renderDevice->DestroyRenderPass(skyboxPass);
   renderDevice->DestroyRenderPass(postPass);
 
-  delete planeMesh;
-  delete cubeMesh;
-  delete quadMesh;
   delete camera;
 }
 
@@ -51,66 +57,92 @@ void WaveRenderer::UpdateCamera(float timestep)
 
 void WaveRenderer::Render(std::vector<Generator*>& generators)
 {
-  // This method requires exactly three simulated oceans to work.
-  assert(generators.size() == 3);
+  // Each simulated ocean is one cascade of the surface.
+  assert(!generators.empty() && generators.size() <= maxCascades);
+
+  ProfileScope scope("render");
+  if (renderScale != framebufferScale)
+    GenerateFramebuffer();
+
+  RenderWaves(generators);
+  RenderPost();
+}
+
+void WaveRenderer::RenderWaves(std::vector<Generator*>& generators)
+{
+  ProfileScope scope("wave");
 
   // First, we perform our pass that renders to the framebuffer
   renderDevice->BeginRenderPass(wavePass);
   renderer->Begin(camera);
 
-  // Let the GPU know how to access the proper textures
-  for (int i = 0; i < generators.size(); i++)
+  // Let the GPU know how to access the proper textures. Each kind of map has maxCascades slots, of
+  // which the shaders only sample the first numCascades.
+  wavesBufferData.numCascades = static_cast<int>(generators.size());
+  for (std::size_t i = 0; i < generators.size(); i++)
   {
     // Set the necessary textures.
     renderDevice->BindTexture2D(generators[i]->GetHeightMap(), i);
-    renderDevice->BindTexture2D(generators[i]->GetDisplacementMap(), i + 3);
-    renderDevice->BindTexture2D(generators[i]->GetJacobianMap(), i + 6);
+    renderDevice->BindTexture2D(generators[i]->GetDisplacementMap(), i + maxCascades);
+    renderDevice->BindTexture2D(generators[i]->GetSlopeMap(), i + 2 * maxCascades);
 
     // Update our ocean buffer data.
-    wavesBufferData.planeSize[i] = generators[i]->GetOceanSettings().planeSize;
-    wavesBufferData.displacementScale[i] = generators[i]->GetOceanSettings().displacement;
+    wavesBufferData.cascades[i].planeSize = generators[i]->GetOceanSettings().planeSize;
+    wavesBufferData.cascades[i].displacementScale = generators[i]->GetOceanSettings().displacement;
   }
 
   // Set the camera clipping planes.
   wavesBufferData.cameraNear = camera->GetNear();
   wavesBufferData.cameraFar = camera->GetFar();
 
-  // Set and bind our UBOs.
-  renderDevice->SetBufferData(wavesBuffer, &wavesBufferData, sizeof(WaveRenderData));
-  renderDevice->BindBuffer(wavesBuffer, 1);
-
-  // Choose the correct pipeline based on whether or not we want to use wireframe mode.
-  if (useWireframe)
-    renderer->DrawMesh(planeMesh, wireframePS);
-  else
-    renderer->DrawMesh(planeMesh, wavePS);
+  // Choose the patches around the camera. The patch indices have to be regenerated whenever their
+  // resolution changes.
+  const OceanLODSettings& lodSettings = oceanLOD.GetSettings();
+  if (lodSettings.patchResolution != patchResolution)
+    GeneratePatchIndices();
 
-  // Render the skybox so that when we mix to create fog, we don't mix with the clear color.
-  renderer->DrawMesh(cubeMesh, skyboxPS);
+  {
+    ProfileScope lodScope("selectPatches");
+    oceanLOD.Select(camera->GetPosition(), camera->GetViewProjection());
+  }
 
-  // Now, we switch framebuffers and render the skybox again to a different framebuffer.
-  renderDevice->EndRenderPass();
-  renderDevice->BeginRenderPass(skyboxPass);
+  std::span<const OceanPatch> patches = oceanLOD.GetPatches();
+  wavesBufferData.gridResolution = static_cast<float>(patchResolution);
+  wavesBufferData.morphStart = 1.0f - lodSettings.morphRegion;
 
+  // Set and bind our UBOs.
+  renderDevice->SetBufferData(wavesBuffer, &wavesBufferData, sizeof(WaveRenderData));
   renderDevice->BindBuffer(wavesBuffer, 1);
-  renderer->DrawMesh(cubeMesh, skyboxPS);
+  renderDevice->SetBufferData(patchBuffer, patches.data(), patches.size() * sizeof(OceanPatch));
+  renderDevice->BindBuffer(patchBuffer, 2);
+
+  // Draw every patch in a single instanced draw, choosing the correct pipeline based on whether or
+  // not we want to use wireframe mode.
+  ID oceanPS = useWireframe ? wireframePS : wavePS;
+  if (!patches.empty())
+    DrawGenerated(oceanPS, numPatchIndices, patchIndices, patches.size());
 
   renderer->End();
   renderDevice->EndRenderPass();
+}
 
-  // Now, we perform our pass to the screen using our quad.
+void WaveRenderer::RenderPost()
+{
+  ProfileScope scope("post");
+
+  // Now, we perform our pass to the screen using a triangle that covers it. The sky is evaluated
+  // there for every pixel, so it never has to be drawn into the framebuffer.
   renderDevice->BeginRenderPass(postPass);
 
-  // Submit our framebuffer textures.
-  renderDevice->BindTexture2D(fbColor, 9);
-  renderDevice->BindTexture2D(fbDepth, 10);
-  renderDevice->BindTexture2D(sbColor, 11);
+  // Submit our framebuffer textures after the slots of the cascades.
+  renderDevice->BindTexture2D(fbColor, 3 * maxCascades);
+  renderDevice->BindTexture2D(fbDepth, 3 * maxCascades + 1);
 
-  // Perform a pass without a camera to allow us to render the quad.
-  renderer->Begin(nullptr);
+  // The triangle doesn't use the camera, but the sky needs its matrices to find the view rays.
+  renderer->Begin(camera);
 
   renderDevice->BindBuffer(wavesBuffer, 1);
-  renderer->DrawMesh(quadMesh, postPS);
+  DrawGenerated(postPS, 3);
   renderer->End();
 
   // Now, we are done!
@@ -120,19 +152,35 @@ void WaveRenderer::Render(std::vector<Generator*>& generators)
 void WaveRenderer::Resize(float w, float h)
 {
   camera->SetWindowSize(w, h);
-  renderDevice->ResizeFramebuffer(framebuffer, w, h);
-  renderDevice->ResizeFramebuffer(skyboxBuffer, w, h);
   width = w;
   height = h;
+
+  // The size changes continuously while the window is dragged, so the framebuffer is resized in
+  // place rather than swapped.
+  pool->ResizeFramebuffer(framebuffer, GetScaledSize(width), GetScaledSize(height));
+}
+
+void WaveRenderer::SetRenderScale(float scale)
+{
+  renderScale = std::clamp(scale, minRenderScale, 1.0f);
+}
+
+std::size_t WaveRenderer::GetScaledSize(float size) const
+{
+  return std::max<std::size_t>(static_cast<std::size_t>(size * framebufferScale), 1);
 }
 
 void WaveRenderer::LoadShaders()
 {
+  // The pipelines are only recreated when the shader has changed.
+  if (!ShaderCache::Get().HasChanged(shaderPath, true))
+    return;
+
   if (wavePS)
   {
     renderDevice->DestroyPipeline(wavePS);
     renderDevice->DestroyPipeline(wireframePS);
-    renderDevice->DestroyPipeline(skyboxPS);
+    renderDevice->DestroyPipeline(postPS);
   }
 
   GeneratePipelines();
@@ -140,55 +188,57 @@ void WaveRenderer::LoadShaders()
 
 void WaveRenderer::GeneratePasses()
 {
-  // Create our framebuffer so that we can render to it.
+  // Create our framebuffer and the pass that renders to it.
+  GenerateFramebuffer();
+
+  // Now we create the pass that renders to the screen buffer.
+  Vision::RenderPassDesc desc;
+  desc.LoadOp = Vision::LoadOp::Clear;
+  desc.StoreOp = Vision::StoreOp::Store;
+  desc.Framebuffer = 0;
+  postPass = renderDevice->CreateRenderPass(desc);
+}
+
+void WaveRenderer::GenerateFramebuffer()
+{
+  // The old framebuffer goes back to the pool, so switching back to its scale reuses it.
+  if (framebuffer)
+  {
+    pool->ReleaseFramebuffer(framebuffer);
+    renderDevice->DestroyRenderPass(wavePass);
+  }
+
+  framebufferScale = renderScale;
   Vision::FramebufferDesc fbDesc;
-  fbDesc.Width = width;
-  fbDesc.Height = height;
+  fbDesc.Width = GetScaledSize(width);
+  fbDesc.Height = GetScaledSize(height);
   fbDesc.ColorFormat = Vision::PixelType::BGRA8;
   fbDesc.DepthType = Vision::PixelType::Depth32Float;
-  framebuffer = renderDevice->CreateFramebuffer(fbDesc);
+  framebuffer = pool->AcquireFramebuffer(fbDesc);
   fbColor = renderDevice->GetFramebufferColorTex(framebuffer);
   fbDepth = renderDevice->GetFramebufferDepthTex(framebuffer);
 
-  // Render the skybox to its own framebuffer and merge.
-  skyboxBuffer = renderDevice->CreateFramebuffer(fbDesc);
-  sbColor = renderDevice->GetFramebufferColorTex(skyboxBuffer);
-
   // Then we create the pass that renders to our framebuffer.
   Vision::RenderPassDesc desc;
   desc.LoadOp = Vision::LoadOp::Clear;
   desc.StoreOp = Vision::StoreOp::Store;
   desc.Framebuffer = framebuffer;
   wavePass = renderDevice->CreateRenderPass(desc);
-
-  // Here we create our buffer for the skybox
-  desc.Framebuffer = skyboxBuffer;
-  skyboxPass = renderDevice->CreateRenderPass(desc);
-
-  // Now we create the pass that renders to the screen buffer.
-  desc.Framebuffer = 0;
-  postPass = renderDevice->CreateRenderPass(desc);
 }
 
 void WaveRenderer::GeneratePipelines()
 {
-  // Create the shaders by loading from disk and compiling
-  Vision::ShaderCompiler compiler;
-  std::unordered_map<std::string, Vision::ShaderSPIRV> waveShaders =
-      compiler.CompileFileToMap("resources/waveShader.glsl", true);
+  // Create the shaders by loading from disk and compiling, or from the cache when they haven't
+  // changed.
+  std::unordered_map<std::string, Vision::ShaderSPIRV> waveShaders;
+  for (Vision::ShaderSPIRV& shader : ShaderCache::Get().CompileFile(shaderPath, true))
+    waveShaders[shader.Name] = std::move(shader);
 
   // Create our wave pipeline state
   {
     Vision::RenderPipelineDesc psDesc;
     psDesc.VertexShader = waveShaders["waveVertex"];
     psDesc.PixelShader = waveShaders["waveFragment"];
-    psDesc.Layouts = {
-        Vision::BufferLayout({{Vision::ShaderDataType::Float3, "Position"},
-                              {Vision::ShaderDataType::Float3, "Normal"},
-                              {Vision::ShaderDataType::Float4, "Color"},
-                              {Vision::ShaderDataType::Float2, "UV"}}
-        )
-    };
     wavePS = renderDevice->CreateRenderPipeline(psDesc);
 
     // Create a second pipeline state for rendering the mesh of our water.
@@ -196,40 +246,11 @@ void WaveRenderer::GeneratePipelines()
     wireframePS = renderDevice->CreateRenderPipeline(psDesc);
   }
 
-  // Create our skybox pipelines state
-  {
-    Vision::RenderPipelineDesc psDesc;
-    psDesc.VertexShader = waveShaders["skyVertex"];
-    psDesc.PixelShader = waveShaders["skyFragment"];
-    psDesc.Layouts = {
-        Vision::BufferLayout({{Vision::ShaderDataType::Float3, "Position"},
-                              {Vision::ShaderDataType::Float3, "Normal"},
-                              {Vision::ShaderDataType::Float4, "Color"},
-                              {Vision::ShaderDataType::Float2, "UV"}}
-        )
-    };
-
-    // We set the depth of all fragments to 1, so only pixels that weren't
-    // previously rendered to will be written by the depth map, but we do in
-    // fact want to discard the initial pixels with a depth of 1.
-    psDesc.DepthFunc = Vision::DepthFunc::LessEqual;
-
-    skyboxPS = renderDevice->CreateRenderPipeline(psDesc);
-  }
-
   // Create our post processing pipeline
   {
     Vision::RenderPipelineDesc psDesc;
     psDesc.VertexShader = waveShaders["postVertex"];
     psDesc.PixelShader = waveShaders["postFragment"];
-    psDesc.Layouts = {
-        Vision::BufferLayout({{Vision::ShaderDataType::Float3, "Position"},
-                              {Vision::ShaderDataType::Float3, "Normal"},
-                              {Vision::ShaderDataType::Float4, "Color"},
-                              {Vision::ShaderDataType::Float2, "UV"}}
-        )
-    };
-
     postPS = renderDevice->CreateRenderPipeline(psDesc);
   }
 }
@@ -243,6 +264,59 @@ void WaveRenderer::GenerateBuffers()
   bufferDesc.Data = &wavesBufferData;
   bufferDesc.DebugName = "Wave Renderer Buffer";
   wavesBuffer = renderDevice->CreateBuffer(bufferDesc);
+
+  // The patches that the LOD system chooses, which are updated every frame.
+  bufferDesc.Size = maxOceanPatches * sizeof(OceanPatch);
+  bufferDesc.Data = nullptr;
+  bufferDesc.DebugName = "Ocean Patch Buffer";
+  patchBuffer = renderDevice->CreateBuffer(bufferDesc);
+}
+
+void WaveRenderer::GeneratePatchIndices()
+{
+  if (patchIndices)
+    renderDevice->DestroyBuffer(patchIndices);
+
+  // Every patch shares these indices. Each one is the ID of a vertex in the grid, which the vertex
+  // shader turns back into its position within the patch.
+  patchResolution = oceanLOD.GetSettings().patchResolution;
+  int numEdgeVertices = patchResolution + 1;
+  assert(numEdgeVertices * numEdgeVertices <= UINT16_MAX);
+
+  // Two triangles for each quad, facing up.
+  std::vector<uint16_t> indices;
+  for (int y = 0; y < patchResolution; y++)
+  {
+    for (int x = 0; x < patchResolution; x++)
+    {
+      uint16_t corner = static_cast<uint16_t>(y * numEdgeVertices + x);
+      uint16_t above = static_cast<uint16_t>(corner + numEdgeVertices);
+      uint16_t right = static_cast<uint16_t>(corner + 1);
+      indices.insert(indices.end(), {corner, above, right, right, above, uint16_t(above + 1)});
+    }
+  }
+
+  Vision::BufferDesc desc;
+  desc.Type = Vision::BufferType::Index;
+  desc.Usage = Vision::BufferUsage::Static;
+  desc.Size = indices.size() * sizeof(uint16_t);
+  desc.Data = indices.data();
+  desc.DebugName = "Ocean Patch Indices";
+  patchIndices = renderDevice->CreateBuffer(desc);
+  numPatchIndices = indices.size();
+}
+
+void WaveRenderer::DrawGenerated(ID pipeline, std::size_t numVertices, ID indexBuffer,
+                                 std::size_t numInstances)
+{
+  Vision::DrawCommand command;
+  command.IndexBuffer = indexBuffer;
+  command.IndexType = Vision::IndexType::U16;
+  command.Type = Vision::PrimitiveType::Triangle;
+  command.NumVertices = numVertices;
+  command.NumInstances = numInstances;
+  command.Pipeline = pipeline;
+  renderDevice->Submit(command);
 }
 
 } // namespace Waves
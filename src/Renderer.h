@@ -7,16 +7,29 @@
 #include "renderer/Renderer2D.h"
 
 #include "Generator.h"
+#include "OceanLOD.h"
+#include "ResourcePool.h"
 
 namespace Waves
 {
 
+// The most cascades that the wave shaders can combine. This must match MAX_CASCADES in
+// waveShader.glsl.
+constexpr std::size_t maxCascades = 4;
+
+// The parameters of one cascade, padded to the stride of a std140 array.
+struct CascadeRenderData
+{
+  float planeSize = 0.0f;         // The size of the plane that this cascade simulates
+  float displacementScale = 0.0f; // The displacement scale of this cascade
+  float padding[2] = {};
+};
+
 // Wave Uniform Buffer Data Structure
 struct WaveRenderData
 {
   // Simulation Data
-  glm::vec4 planeSize = glm::vec4(0.0f); // The size of the three planes that make up our water
-  glm::vec4 displacementScale = glm::vec4(0.0f); // The displacement scale for each plane.
+  CascadeRenderData cascades[maxCascades]; // The planes that make up our water
 
   // Rendering Data
   glm::vec4 waveColor = glm::vec4(0.0f, 0.33f, 0.47f, 1.0f); // The color of the wave
@@ -29,6 +42,10 @@ struct WaveRenderData
   float fogBegin = 30.0f;                                    // Where the fog begins
   float cameraNear = 20.0f;                                  // The near camera clipping plane
   float cameraFar = 50.0f;                                   // The far camera clipping plane
+  int numCascades = 0;                                       // The number of cascades in use
+  float gridResolution = 0.0f;                               // The quads along a patch's edge
+  float morphStart = 0.0f;                                   // Where patches begin to morph
+  float padding = 0.0f;                                      // Ensure 16-byte alignment
 };
 
 class WaveRenderer
@@ -36,18 +53,25 @@ class WaveRenderer
   using ID = Vision::ID;
 
 public:
-  WaveRenderer(Vision::RenderDevice* renderDevice, Vision::Renderer* renderer, float width,
-               float height);
+  // The framebuffer that the waves are drawn into comes from the pool.
+  WaveRenderer(Vision::RenderDevice* renderDevice, Vision::Renderer* renderer, ResourcePool* pool,
+               float width, float height);
   ~WaveRenderer();
 
   void UpdateCamera(float timestep);
 
-  // Requires that the generators is an array of three valid FFT oceans
+  // Renders the ocean that the generators make up, which must be between one and maxCascades FFT
+  // oceans. Each one is a cascade, in order of increasing plane size.
   void Render(std::vector<Generator*>& generators);
-  static std::size_t GetNumRequiredGenerators() { return 3; }
 
   void Resize(float width, float height);
 
+  // The waves are drawn at this fraction of the window's resolution, and upscaled to the window by
+  // the post pass. The framebuffer is swapped for one of the new size at the next render.
+  static constexpr float minRenderScale = 0.25f;
+  void SetRenderScale(float scale);
+  float GetRenderScale() const { return renderScale; }
+
   void UseWireframe(bool wireframe = true) { useWireframe = wireframe; }
   void ToggleWireframe() { useWireframe = !useWireframe; }
   bool UsesWireframe() const { return useWireframe; }
@@ -56,10 +80,26 @@ public:
 
   WaveRenderData& GetWaveRenderData() { return wavesBufferData; }
 
+  // The LOD system that chooses the patches of the ocean each frame.
+  OceanLOD& GetOceanLOD() { return oceanLOD; }
+
 private:
+  // The passes that make up Render.
+  void RenderWaves(std::vector<Generator*>& generators);
+  void RenderPost();
+
   void GeneratePasses();
+  void GenerateFramebuffer();
+
+  // The size of the framebuffer along a side of the window of the given size.
+  std::size_t GetScaledSize(float size) const;
   void GeneratePipelines();
   void GenerateBuffers();
+  void GeneratePatchIndices();
+
+  // Draws vertices that the vertex shader generates from their IDs, without any vertex buffers.
+  void DrawGenerated(ID pipeline, std::size_t numVertices, ID indexBuffer = 0,
+                     std::size_t numInstances = 1);
 
 private:
   // General Rendering Data
@@ -67,20 +107,23 @@ private:
   Vision::Renderer* renderer = nullptr;
   float width = 0.0f, height = 0.0f;
   Vision::PerspectiveCamera* camera = nullptr;
-  ID wavePass = 0, skyboxPass = 0, postPass = 0;
+  ID wavePass = 0, postPass = 0;
 
-  // Rendering Framebuffer (used for post processing)
+  // Rendering Framebuffer (used for post processing), and the scale that it was acquired at.
+  ResourcePool* pool = nullptr;
   ID framebuffer = 0, fbColor = 0, fbDepth = 0;
-  ID skyboxBuffer = 0, sbColor = 0;
+  float renderScale = 1.0f, framebufferScale = 1.0f;
 
-  // Meshes
-  Vision::Mesh* planeMesh = nullptr; // surface of water
-  Vision::Mesh* cubeMesh = nullptr;  // skybox and light visualization
-  Vision::Mesh* quadMesh = nullptr;  // quad that covers screen for rendering fb
+  // The surface of the water is drawn as an instance of the same patch for each patch that the LOD
+  // system chooses. Its vertices are generated in the shader, so only the indices are stored.
+  OceanLOD oceanLOD;
+  ID patchIndices = 0, patchBuffer = 0;
+  std::size_t numPatchIndices = 0;
+  int patchResolution = 0; // The resolution that the patch indices were generated with
 
   // Pipelines and Shaders
   bool useWireframe = false;
-  ID wavePS = 0, wireframePS = 0, skyboxPS = 0, postPS = 0;
+  ID wavePS = 0, wireframePS = 0, postPS = 0;
 
   // Wave Uniform Buffer
   WaveRenderData wavesBufferData;
@@ -0,0 +1,240 @@
+#include "ResourcePool.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace Waves
+{
+
+ResourcePool::ResourcePool(Vision::RenderDevice* renderDevice) : device(renderDevice) {}
+
+ResourcePool::~ResourcePool()
+{
+  assert(inUse.empty());
+
+  // By now the device has nothing left in flight that could use them.
+  for (const FreeResource& resource : freeResources)
+    Destroy(resource.key.kind, resource.id);
+  for (const FreeResource& pipeline : releasedPipelines)
+    Destroy(Kind::ComputePipeline, pipeline.id);
+}
+
+Vision::ID ResourcePool::AcquireTexture2D(const Vision::Texture2DDesc& desc)
+{
+  Key key = MakeKey(desc);
+  Vision::ID texture = Reuse(key);
+  if (!texture)
+  {
+    texture = device->CreateTexture2D(desc);
+    numCreated++;
+  }
+  else if (desc.Data)
+  {
+    device->SetTexture2DDataRaw(texture, desc.Data);
+  }
+
+  inUse[{Kind::Texture2D, texture}] = key;
+  return texture;
+}
+
+void ResourcePool::ReleaseTexture2D(Vision::ID texture)
+{
+  Release(Kind::Texture2D, texture);
+}
+
+Vision::ID ResourcePool::AcquireBuffer(const Vision::BufferDesc& desc)
+{
+  Key key = MakeKey(desc);
+  Vision::ID buffer = Reuse(key);
+  if (!buffer)
+  {
+    buffer = device->CreateBuffer(desc);
+    numCreated++;
+  }
+  else if (desc.Data)
+  {
+    device->SetBufferData(buffer, desc.Data, desc.Size);
+  }
+
+  inUse[{Kind::Buffer, buffer}] = key;
+  return buffer;
+}
+
+void ResourcePool::ReleaseBuffer(Vision::ID buffer)
+{
+  Release(Kind::Buffer, buffer);
+}
+
+Vision::ID ResourcePool::AcquireFramebuffer(const Vision::FramebufferDesc& desc)
+{
+  Key key = MakeKey(desc);
+  Vision::ID framebuffer = Reuse(key);
+  if (!framebuffer)
+  {
+    framebuffer = device->CreateFramebuffer(desc);
+    numCreated++;
+  }
+
+  inUse[{Kind::Framebuffer, framebuffer}] = key;
+  return framebuffer;
+}
+
+void ResourcePool::ReleaseFramebuffer(Vision::ID framebuffer)
+{
+  Release(Kind::Framebuffer, framebuffer);
+}
+
+void ResourcePool::ResizeFramebuffer(Vision::ID framebuffer, std::size_t width,
+                                     std::size_t height)
+{
+  auto resource = inUse.find({Kind::Framebuffer, framebuffer});
+  assert(resource != inUse.end());
+
+  // The framebuffer goes back into the pool under its new size.
+  resource->second.width = width;
+  resource->second.height = height;
+  device->ResizeFramebuffer(framebuffer, static_cast<float>(width), static_cast<float>(height));
+}
+
+void ResourcePool::ReleaseComputePipeline(Vision::ID pipeline)
+{
+  if (pipeline)
+    releasedPipelines.push_back({{Kind::ComputePipeline}, pipeline, frame});
+}
+
+void ResourcePool::EndFrame()
+{
+  frame++;
+
+  auto expired = [this](const FreeResource& resource)
+  { return frame - resource.releasedFrame > maxIdleFrames; };
+
+  for (const FreeResource& resource : freeResources)
+  {
+    if (expired(resource))
+      Destroy(resource.key.kind, resource.id);
+  }
+
+  std::erase_if(freeResources, expired);
+
+  auto idle = [this](const FreeResource& pipeline) { return !IsInFlight(pipeline); };
+  for (const FreeResource& pipeline : releasedPipelines)
+  {
+    if (idle(pipeline))
+      Destroy(Kind::ComputePipeline, pipeline.id);
+  }
+
+  std::erase_if(releasedPipelines, idle);
+}
+
+void ResourcePool::Trim()
+{
+  auto idle = [this](const FreeResource& resource) { return !IsInFlight(resource); };
+  for (const FreeResource& resource : freeResources)
+  {
+    if (idle(resource))
+      Destroy(resource.key.kind, resource.id);
+  }
+
+  std::erase_if(freeResources, idle);
+}
+
+ResourcePool::Statistics ResourcePool::GetStatistics() const
+{
+  Statistics stats;
+  stats.numCreated = numCreated;
+  stats.numReused = numReused;
+  stats.numDestroyed = numDestroyed;
+  stats.numInUse = inUse.size();
+  stats.numFree = freeResources.size();
+  return stats;
+}
+
+ResourcePool::Key ResourcePool::MakeKey(const Vision::Texture2DDesc& desc)
+{
+  Key key;
+  key.kind = Kind::Texture2D;
+  key.width = desc.Width;
+  key.height = desc.Height;
+  key.mipLevels = desc.MipLevels;
+  key.format = static_cast<int>(desc.PixelType);
+  key.minFilter = static_cast<int>(desc.MinFilter);
+  key.magFilter = static_cast<int>(desc.MagFilter);
+  key.mipFilter = static_cast<int>(desc.MipFilter);
+  key.addressModeS = static_cast<int>(desc.AddressModeS);
+  key.addressModeT = static_cast<int>(desc.AddressModeT);
+  key.writeOnly = desc.WriteOnly;
+  return key;
+}
+
+ResourcePool::Key ResourcePool::MakeKey(const Vision::BufferDesc& desc)
+{
+  Key key;
+  key.kind = Kind::Buffer;
+  key.width = desc.Size;
+  key.format = static_cast<int>(desc.Type);
+  key.usage = static_cast<int>(desc.Usage);
+  return key;
+}
+
+ResourcePool::Key ResourcePool::MakeKey(const Vision::FramebufferDesc& desc)
+{
+  Key key;
+  key.kind = Kind::Framebuffer;
+  key.width = desc.Width;
+  key.height = desc.Height;
+  key.format = static_cast<int>(desc.ColorFormat);
+  key.depthFormat = static_cast<int>(desc.DepthType);
+  return key;
+}
+
+Vision::ID ResourcePool::Reuse(const Key& key)
+{
+  auto matches = [this, &key](const FreeResource& resource)
+  { return resource.key == key && !IsInFlight(resource); };
+  auto resource = std::find_if(freeResources.rbegin(), freeResources.rend(), matches);
+  if (resource == freeResources.rend())
+    return 0;
+
+  Vision::ID id = resource->id;
+  freeResources.erase(std::next(resource).base());
+  numReused++;
+  return id;
+}
+
+void ResourcePool::Release(Kind kind, Vision::ID id)
+{
+  if (!id)
+    return;
+
+  auto resource = inUse.find({kind, id});
+  assert(resource != inUse.end());
+  if (resource == inUse.end())
+    return;
+
+  freeResources.push_back({resource->second, id, frame});
+  inUse.erase(resource);
+}
+
+void ResourcePool::Destroy(Kind kind, Vision::ID id)
+{
+  switch (kind)
+  {
+    case Kind::Texture2D:
+      device->DestroyTexture2D(id);
+      break;
+    case Kind::Buffer:
+      device->DestroyBuffer(id);
+      break;
+    case Kind::Framebuffer:
+      device->DestroyFramebuffer(id);
+      break;
+    case Kind::ComputePipeline:
+      device->DestroyComputePipeline(id);
+      break;
+  }
+
+  numDestroyed++;
+}
+
+} // namespace Waves
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "renderer/RenderDevice.h"
+
+namespace Waves
+{
+
+// Keeps GPU textures, buffers, and framebuffers that are no longer in use, so that later requests
+// for the same format and size reuse them instead of creating new ones. Switching a cascade's
+// resolution or the render scale back and forth then settles into swapping the same resources,
+// without any allocations or the hitches that come with them.
+//
+// Released resources are only destroyed once they've gone unused for a while, which also means
+// that a resource is never destroyed while the frames that used it may still be in flight. For the
+// same reason, they aren't handed out again until numFramesInFlight frames have ended, so that a
+// resource is never written by one user while the GPU may still be reading it for another. Compute
+// pipelines aren't reused, but they're released here too, to be destroyed once those frames end.
+//
+// Resources that are acquired with data have it uploaded whether they're new or reused. Otherwise
+// a reused resource still holds whatever was last written to it, so it must be written before it's
+// read. Resources are matched on everything in their descriptions except for the data and the
+// debug name.
+class ResourcePool
+{
+public:
+  // The frames that the GPU may still be working on when the CPU ends another.
+  static constexpr std::size_t numFramesInFlight = 3;
+
+  ResourcePool(Vision::RenderDevice* device);
+
+  // Destroys every resource in the pool. Every acquired resource must have been released first.
+  ~ResourcePool();
+
+  Vision::ID AcquireTexture2D(const Vision::Texture2DDesc& desc);
+  void ReleaseTexture2D(Vision::ID texture);
+
+  Vision::ID AcquireBuffer(const Vision::BufferDesc& desc);
+  void ReleaseBuffer(Vision::ID buffer);
+
+  Vision::ID AcquireFramebuffer(const Vision::FramebufferDesc& desc);
+  void ReleaseFramebuffer(Vision::ID framebuffer);
+
+  // Resizes an acquired framebuffer in place, which is cheaper than swapping it for another when
+  // the size changes continuously, like while the window is dragged.
+  void ResizeFramebuffer(Vision::ID framebuffer, std::size_t width, std::size_t height);
+
+  // Destroys a compute pipeline once the frames that may still use it have ended.
+  void ReleaseComputePipeline(Vision::ID pipeline);
+
+  // Destroys the resources that have gone unused for more than the given number of frames, and the
+  // pipelines that are no longer in flight.
+  void EndFrame();
+  void SetMaxIdleFrames(std::size_t frames)
+  {
+    maxIdleFrames = std::max(frames, numFramesInFlight);
+  }
+
+  // Destroys every resource that isn't in use, and isn't in flight anymore.
+  void Trim();
+
+  // Totals since the pool was created, and the resources that exist right now.
+  struct Statistics
+  {
+    std::size_t numCreated = 0;
+    std::size_t numReused = 0;
+    std::size_t numDestroyed = 0;
+    std::size_t numInUse = 0;
+    std::size_t numFree = 0;
+  };
+  Statistics GetStatistics() const;
+
+private:
+  enum class Kind
+  {
+    Texture2D,
+    Buffer,
+    Framebuffer,
+    ComputePipeline
+  };
+
+  // Everything that has to match for a resource to be reused, flattened so that every kind can
+  // share one comparison.
+  struct Key
+  {
+    Kind kind = Kind::Texture2D;
+    std::size_t width = 0; // Or the size of a buffer.
+    std::size_t height = 0;
+    std::size_t mipLevels = 0;
+    int format = 0; // The pixel type, or the type of a buffer.
+    int depthFormat = 0;
+    int usage = 0;
+    int minFilter = 0, magFilter = 0, mipFilter = 0;
+    int addressModeS = 0, addressModeT = 0;
+    bool writeOnly = false;
+
+    auto operator<=>(const Key&) const = default;
+  };
+
+  struct FreeResource
+  {
+    Key key;
+    Vision::ID id = 0;
+    std::size_t releasedFrame = 0;
+  };
+
+  static Key MakeKey(const Vision::Texture2DDesc& desc);
+  static Key MakeKey(const Vision::BufferDesc& desc);
+  static Key MakeKey(const Vision::FramebufferDesc& desc);
+
+  // Takes a free resource that matches the key, returning zero if there isn't one. Resources that
+  // may still be in flight are skipped.
+  Vision::ID Reuse(const Key& key);
+  bool IsInFlight(const FreeResource& resource) const
+  {
+    return frame - resource.releasedFrame < numFramesInFlight;
+  }
+
+  void Release(Kind kind, Vision::ID id);
+  void Destroy(Kind kind, Vision::ID id);
+
+private:
+  Vision::RenderDevice* device = nullptr;
+
+  // The resources in use, and the keys that they were acquired with. IDs are only unique within a
+  // kind, so the kind is part of the key.
+  std::map<std::pair<Kind, Vision::ID>, Key> inUse;
+
+  // The resources in the pool, oldest first. There are only ever a few dozen, so we just search
+  // them, newest first so that surplus resources of the same kind are left to expire.
+  std::vector<FreeResource> freeResources;
+
+  // The pipelines that are waiting for their frames to end.
+  std::vector<FreeResource> releasedPipelines;
+
+  // About five seconds at 60 FPS.
+  std::size_t maxIdleFrames = 300;
+  std::size_t frame = 0;
+
+  std::size_t numCreated = 0;
+  std::size_t numReused = 0;
+  std::size_t numDestroyed = 0;
+};
+
+} // namespace Waves
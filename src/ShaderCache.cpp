@@ -0,0 +1,196 @@
+#include "ShaderCache.h"
+
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string_view>
+
+#include "AtomicFile.h"
+
+namespace Waves
+{
+
+namespace
+{
+
+// Bump the version whenever the layout of the file changes, or the compiler is updated in a way
+// that changes its output.
+constexpr FileHeader shaderHeader = {0x56505357, 1}; // "WSPV"
+
+// Follows the header, and is followed by the shaders.
+struct ShaderKey
+{
+  uint64_t hash = 0;
+  uint32_t numShaders = 0;
+  uint32_t padding = 0;
+};
+
+// Each shader follows the key as its stage, the length of its name, the name, the number of
+// words of SPIR-V, then the words.
+struct ShaderRecord
+{
+  uint32_t stage = 0;
+  uint32_t nameLength = 0;
+  uint32_t numWords = 0;
+};
+
+// FNV-1a, which is plenty to tell versions of a file apart.
+uint64_t HashSource(const std::string& source, bool flip)
+{
+  uint64_t hash = 0xcbf29ce484222325ull;
+  auto add = [&hash](unsigned char byte)
+  {
+    hash ^= byte;
+    hash *= 0x100000001b3ull;
+  };
+
+  for (char c : source)
+    add(static_cast<unsigned char>(c));
+  add(flip ? 1 : 0);
+  return hash;
+}
+
+bool ReadSource(const std::string& path, std::string& source)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+
+  std::stringstream contents;
+  contents << file.rdbuf();
+  source = contents.str();
+  return true;
+}
+
+std::filesystem::path GetShaderPath(uint64_t hash, const std::string& path)
+{
+  char name[32];
+  std::snprintf(name, sizeof(name), "_%016llx.spv", static_cast<unsigned long long>(hash));
+  std::string stem = std::filesystem::path(path).stem().string();
+  return std::filesystem::path("cache/spirv") / (stem + name);
+}
+
+} // namespace
+
+ShaderCache& ShaderCache::Get()
+{
+  static ShaderCache cache;
+  return cache;
+}
+
+std::vector<Vision::ShaderSPIRV> ShaderCache::CompileFile(const std::string& path, bool flip)
+{
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point start = Clock::now();
+
+  std::string source;
+  if (!ReadSource(path, source))
+  {
+    std::cerr << "Failed to open shader " << path << std::endl;
+    return {};
+  }
+
+  uint64_t hash = HashSource(source, flip);
+  Entry& entry = entries[GetKey(path, flip)];
+  if (entry.hash == hash && !entry.shaders.empty())
+  {
+    statistics.numReused++;
+  }
+  else if (diskCacheEnabled && Load(hash, path, entry.shaders))
+  {
+    statistics.numLoaded++;
+  }
+  else
+  {
+    // The compiler reads the file itself, so it could in theory see a newer version than we
+    // hashed. That only costs a recompile the next time that the file is used.
+    Vision::ShaderCompiler compiler;
+    entry.shaders = compiler.CompileFile(path, flip);
+    statistics.numCompiled++;
+
+    if (diskCacheEnabled && !entry.shaders.empty())
+      Save(hash, path, entry.shaders);
+  }
+
+  entry.hash = hash;
+  statistics.time += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  return entry.shaders;
+}
+
+bool ShaderCache::HasChanged(const std::string& path, bool flip) const
+{
+  auto entry = entries.find(GetKey(path, flip));
+  if (entry == entries.end())
+    return true;
+
+  std::string source;
+  return !ReadSource(path, source) || HashSource(source, flip) != entry->second.hash;
+}
+
+std::string ShaderCache::GetKey(const std::string& path, bool flip)
+{
+  return path + (flip ? ":flipped" : "");
+}
+
+bool ShaderCache::Load(uint64_t hash, const std::string& path,
+                       std::vector<Vision::ShaderSPIRV>& shaders)
+{
+  std::string payload;
+  if (!ReadFileChecked(GetShaderPath(hash, path), shaderHeader, payload))
+    return false;
+
+  // The hash is in the name, but we check it again in case of a collision in the file name.
+  std::string_view contents = payload;
+  ShaderKey key;
+  if (!ConsumeBytes(contents, &key) || key.hash != hash)
+    return false;
+
+  // A truncated file is treated like a missing one, and gets replaced once it's compiled again.
+  std::vector<Vision::ShaderSPIRV> loaded(key.numShaders);
+  for (Vision::ShaderSPIRV& shader : loaded)
+  {
+    ShaderRecord record;
+    if (!ConsumeBytes(contents, &record) || contents.size() < record.nameLength)
+      return false;
+
+    shader.Stage = static_cast<Vision::ShaderStage>(record.stage);
+    shader.Name.assign(contents.substr(0, record.nameLength));
+    contents.remove_prefix(record.nameLength);
+
+    if (contents.size() / sizeof(uint32_t) < record.numWords)
+      return false;
+    shader.SPIRV.resize(record.numWords);
+    ConsumeBytes(contents, shader.SPIRV.data(), record.numWords);
+  }
+
+  shaders = std::move(loaded);
+  return true;
+}
+
+void ShaderCache::Save(uint64_t hash, const std::string& path,
+                       const std::vector<Vision::ShaderSPIRV>& shaders)
+{
+  ShaderKey key;
+  key.hash = hash;
+  key.numShaders = static_cast<uint32_t>(shaders.size());
+  std::string payload;
+  AppendBytes(payload, &key);
+
+  for (const Vision::ShaderSPIRV& shader : shaders)
+  {
+    ShaderRecord record;
+    record.stage = static_cast<uint32_t>(shader.Stage);
+    record.nameLength = static_cast<uint32_t>(shader.Name.size());
+    record.numWords = static_cast<uint32_t>(shader.SPIRV.size());
+    AppendBytes(payload, &record);
+    AppendBytes(payload, shader.Name.data(), shader.Name.size());
+    AppendBytes(payload, shader.SPIRV.data(), shader.SPIRV.size());
+  }
+
+  WriteFileAtomic(GetShaderPath(hash, path), shaderHeader, payload);
+}
+
+} // namespace Waves
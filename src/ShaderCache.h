@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "renderer/shader/ShaderCompiler.h"
+
+namespace Waves
+{
+
+// Compiling GLSL to SPIR-V takes most of our startup, so the compiled shaders are kept on disk
+// under cache/spirv, keyed by a hash of the source and the compile options. Shader variants have
+// their defines written into their source, so different defines hash differently too. Our shaders
+// don't #include anything, so the source is all that they depend on.
+//
+// The last results of each file are also kept in memory, so that a hot reload can tell which files
+// changed and only recompile those.
+//
+// The cache is only used from the main thread, where the pipelines are created.
+class ShaderCache
+{
+public:
+  static ShaderCache& Get();
+
+  // Returns the shaders compiled from a file, loading them from the cache when there's a valid
+  // entry for its current source and compiling them otherwise. Returns nothing if the file can't
+  // be read.
+  std::vector<Vision::ShaderSPIRV> CompileFile(const std::string& path, bool flip = false);
+
+  // Whether the source of a file differs from the last time that it was compiled with these
+  // options, or it hasn't been compiled yet.
+  bool HasChanged(const std::string& path, bool flip = false) const;
+
+  // Without the disk cache every file is compiled the first time that it's used, which is how we
+  // measure what the cache saves. Files that haven't changed still aren't recompiled on reload.
+  void SetDiskCacheEnabled(bool enable) { diskCacheEnabled = enable; }
+  bool IsDiskCacheEnabled() const { return diskCacheEnabled; }
+
+  // Totals since the cache was created, with the time covering reading, hashing, loading, and
+  // compiling the shaders, in milliseconds.
+  struct Statistics
+  {
+    std::size_t numCompiled = 0;
+    std::size_t numLoaded = 0; // From disk.
+    std::size_t numReused = 0; // From memory, for files that hadn't changed.
+    double time = 0.0;
+  };
+  const Statistics& GetStatistics() const { return statistics; }
+
+private:
+  ShaderCache() = default;
+
+  struct Entry
+  {
+    uint64_t hash = 0;
+    std::vector<Vision::ShaderSPIRV> shaders;
+  };
+
+  static std::string GetKey(const std::string& path, bool flip);
+
+  bool Load(uint64_t hash, const std::string& path, std::vector<Vision::ShaderSPIRV>& shaders);
+  void Save(uint64_t hash, const std::string& path,
+            const std::vector<Vision::ShaderSPIRV>& shaders);
+
+private:
+  // The last results of each file, keyed by its path and options.
+  std::unordered_map<std::string, Entry> entries;
+
+  bool diskCacheEnabled = true;
+  Statistics statistics;
+};
+
+} // namespace Waves
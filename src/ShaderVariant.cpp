@@ -0,0 +1,67 @@
+#include "ShaderVariant.h"
+
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace Waves
+{
+
+std::string WriteShaderVariant(const std::string& path, const std::string& variantName,
+                               const std::vector<ShaderDefine>& defines)
+{
+  std::ifstream input(path);
+  if (!input)
+  {
+    std::cerr << "Failed to open shader " << path << std::endl;
+    return path;
+  }
+
+  // Replace the value of each define that we're overriding, and keep every other line as it is.
+  std::vector<bool> replaced(defines.size(), false);
+  std::stringstream source;
+  std::string line;
+  while (std::getline(input, line))
+  {
+    for (std::size_t i = 0; i < defines.size(); i++)
+    {
+      std::string prefix = "#define " + defines[i].name + " ";
+      if (line.compare(0, prefix.size(), prefix) == 0)
+      {
+        line = prefix + defines[i].value;
+        replaced[i] = true;
+      }
+    }
+
+    source << line << '\n';
+  }
+
+  for (std::size_t i = 0; i < defines.size(); i++)
+  {
+    if (!replaced[i])
+      std::cerr << "Shader " << path << " has no define " << defines[i].name << std::endl;
+    assert(replaced[i]);
+  }
+
+  // Keep the original extension, since the compiler may care about it.
+  std::filesystem::path sourcePath(path);
+  std::filesystem::path directory = "cache/shaders";
+  std::filesystem::path variantPath = directory / (sourcePath.stem().string() + "_" + variantName +
+                                                   sourcePath.extension().string());
+
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  std::ofstream output(variantPath);
+  if (error || !output)
+  {
+    std::cerr << "Failed to write shader variant " << variantPath.string() << std::endl;
+    return path;
+  }
+
+  output << source.str();
+  return variantPath.string();
+}
+
+} // namespace Waves
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace Waves
+{
+
+// A value to give to one of the #defines in a shader.
+struct ShaderDefine
+{
+  std::string name;
+  std::string value;
+};
+
+// The ShaderCompiler only compiles files, so to specialize a shader we write a copy of it with the
+// given #defines replaced, and return the path of that copy. Each define must already exist in the
+// source, so that the original file still compiles on its own with sensible defaults. The copies
+// are written to cache/shaders and named after the variant, so each one is only kept once.
+std::string WriteShaderVariant(const std::string& path, const std::string& variantName,
+                               const std::vector<ShaderDefine>& defines);
+
+} // namespace Waves
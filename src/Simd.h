@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace Waves::Simd
+{
+
+// A thin wrapper over the widest vector registers that we were compiled for, so that the CPU
+// simulation can process several independent values at once without writing every algorithm
+// twice. Each lane holds one value, and every operation is performed lane by lane. Builds without
+// AVX2, which is the default, use a single lane, which the compiler turns into plain scalar code.
+// The width is fixed when compiling, so an AVX2 build only runs on CPUs that support AVX2 and FMA.
+
+#if defined(__AVX2__)
+
+constexpr std::size_t width = 8;
+
+struct Float
+{
+  __m256 v;
+
+  Float() : v(_mm256_setzero_ps()) {}
+  Float(__m256 value) : v(value) {}
+  Float(float value) : v(_mm256_set1_ps(value)) {}
+};
+
+struct Int
+{
+  __m256i v;
+
+  Int() : v(_mm256_setzero_si256()) {}
+  Int(__m256i value) : v(value) {}
+  Int(int32_t value) : v(_mm256_set1_epi32(value)) {}
+};
+
+// The result of a comparison, which holds whether it was true in each lane.
+struct Mask
+{
+  __m256 v;
+
+  Mask(__m256 value) : v(value) {}
+};
+
+inline Float operator+(Float a, Float b) { return _mm256_add_ps(a.v, b.v); }
+inline Float operator-(Float a, Float b) { return _mm256_sub_ps(a.v, b.v); }
+inline Float operator*(Float a, Float b) { return _mm256_mul_ps(a.v, b.v); }
+inline Float operator/(Float a, Float b) { return _mm256_div_ps(a.v, b.v); }
+inline Float operator-(Float a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+
+// Integers wrap around on overflow, like unsigned integers in C++ and GLSL.
+inline Int operator+(Int a, Int b) { return _mm256_add_epi32(a.v, b.v); }
+inline Int operator-(Int a, Int b) { return _mm256_sub_epi32(a.v, b.v); }
+inline Int operator*(Int a, Int b) { return _mm256_mullo_epi32(a.v, b.v); }
+inline Int operator&(Int a, Int b) { return _mm256_and_si256(a.v, b.v); }
+inline Int operator|(Int a, Int b) { return _mm256_or_si256(a.v, b.v); }
+inline Int operator^(Int a, Int b) { return _mm256_xor_si256(a.v, b.v); }
+inline Int operator<<(Int a, int bits) { return _mm256_slli_epi32(a.v, bits); }
+
+// Shifts in zeros, treating the int as unsigned.
+inline Int operator>>(Int a, int bits) { return _mm256_srli_epi32(a.v, bits); }
+
+// The high 32 bits of the unsigned 64-bit product. AVX2 only multiplies the even lanes, so the odd
+// lanes are shifted down, multiplied separately, and blended back in.
+inline Int MulHi(Int a, Int b)
+{
+  __m256i even = _mm256_srli_epi64(_mm256_mul_epu32(a.v, b.v), 32);
+  __m256i odd = _mm256_mul_epu32(_mm256_srli_epi64(a.v, 32), _mm256_srli_epi64(b.v, 32));
+  return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+inline Mask operator<(Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline Mask operator<=(Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline Mask operator>(Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline Mask operator>=(Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline Mask operator==(Float a, Float b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+inline Mask operator==(Int a, Int b)
+{
+  return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v));
+}
+
+inline Mask operator|(Mask a, Mask b) { return _mm256_or_ps(a.v, b.v); }
+
+// Picks a in the lanes where the mask is true, and b in the others.
+inline Float Select(Mask mask, Float a, Float b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+
+inline Float Load(const float* values) { return _mm256_loadu_ps(values); }
+inline void Store(float* values, Float a) { _mm256_storeu_ps(values, a.v); }
+
+inline Float Min(Float a, Float b) { return _mm256_min_ps(a.v, b.v); }
+inline Float Max(Float a, Float b) { return _mm256_max_ps(a.v, b.v); }
+inline Float Abs(Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+inline Float Floor(Float a) { return _mm256_floor_ps(a.v); }
+inline Float Sqrt(Float a) { return _mm256_sqrt_ps(a.v); }
+
+// Rounds to the nearest integer, with ties going to the even integer.
+inline Float Round(Float a)
+{
+  return _mm256_round_ps(a.v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+
+// Converts a float with an integral value to an int.
+inline Int ToInt(Float a) { return _mm256_cvttps_epi32(a.v); }
+inline Float ToFloat(Int a) { return _mm256_cvtepi32_ps(a.v); }
+
+// Reinterprets the bits of each lane.
+inline Int AsInt(Float a) { return _mm256_castps_si256(a.v); }
+inline Float AsFloat(Int a) { return _mm256_castsi256_ps(a.v); }
+
+// Loads base[index] for the index in each lane.
+inline Float Gather(const float* base, Int index) { return _mm256_i32gather_ps(base, index.v, 4); }
+
+#else
+
+constexpr std::size_t width = 1;
+
+struct Float
+{
+  float v = 0.0f;
+
+  Float() = default;
+  Float(float value) : v(value) {}
+};
+
+struct Int
+{
+  int32_t v = 0;
+
+  Int() = default;
+  Int(int32_t value) : v(value) {}
+};
+
+struct Mask
+{
+  bool v = false;
+
+  Mask(bool value) : v(value) {}
+};
+
+inline Float operator+(Float a, Float b) { return a.v + b.v; }
+inline Float operator-(Float a, Float b) { return a.v - b.v; }
+inline Float operator*(Float a, Float b) { return a.v * b.v; }
+inline Float operator/(Float a, Float b) { return a.v / b.v; }
+inline Float operator-(Float a) { return -a.v; }
+
+// Signed overflow is undefined, so the arithmetic is done on unsigned ints.
+inline uint32_t AsUnsigned(Int a) { return static_cast<uint32_t>(a.v); }
+inline Int operator+(Int a, Int b) { return static_cast<int32_t>(AsUnsigned(a) + AsUnsigned(b)); }
+inline Int operator-(Int a, Int b) { return static_cast<int32_t>(AsUnsigned(a) - AsUnsigned(b)); }
+inline Int operator*(Int a, Int b) { return static_cast<int32_t>(AsUnsigned(a) * AsUnsigned(b)); }
+inline Int operator&(Int a, Int b) { return a.v & b.v; }
+inline Int operator|(Int a, Int b) { return a.v | b.v; }
+inline Int operator^(Int a, Int b) { return a.v ^ b.v; }
+inline Int operator<<(Int a, int bits) { return static_cast<int32_t>(AsUnsigned(a) << bits); }
+inline Int operator>>(Int a, int bits) { return static_cast<int32_t>(AsUnsigned(a) >> bits); }
+inline Int MulHi(Int a, Int b)
+{
+  uint64_t product = static_cast<uint64_t>(AsUnsigned(a)) * AsUnsigned(b);
+  return static_cast<int32_t>(product >> 32);
+}
+
+inline Mask operator<(Float a, Float b) { return a.v < b.v; }
+inline Mask operator<=(Float a, Float b) { return a.v <= b.v; }
+inline Mask operator>(Float a, Float b) { return a.v > b.v; }
+inline Mask operator>=(Float a, Float b) { return a.v >= b.v; }
+inline Mask operator==(Float a, Float b) { return a.v == b.v; }
+inline Mask operator==(Int a, Int b) { return a.v == b.v; }
+
+inline Mask operator|(Mask a, Mask b) { return a.v || b.v; }
+
+inline Float Select(Mask mask, Float a, Float b) { return mask.v ? a : b; }
+
+inline Float Load(const float* values) { return *values; }
+inline void Store(float* values, Float a) { *values = a.v; }
+
+inline Float Min(Float a, Float b) { return std::min(a.v, b.v); }
+inline Float Max(Float a, Float b) { return std::max(a.v, b.v); }
+inline Float Abs(Float a) { return std::abs(a.v); }
+inline Float Floor(Float a) { return std::floor(a.v); }
+inline Float Sqrt(Float a) { return std::sqrt(a.v); }
+inline Float Round(Float a) { return std::nearbyint(a.v); }
+
+inline Int ToInt(Float a) { return static_cast<int32_t>(a.v); }
+inline Float ToFloat(Int a) { return static_cast<float>(a.v); }
+
+inline Int AsInt(Float a) { return std::bit_cast<int32_t>(a.v); }
+inline Float AsFloat(Int a) { return std::bit_cast<float>(a.v); }
+
+inline Float Gather(const float* base, Int index) { return base[index.v]; }
+
+#endif
+
+inline Float& operator+=(Float& a, Float b) { return a = a + b; }
+inline Float& operator-=(Float& a, Float b) { return a = a - b; }
+inline Float& operator*=(Float& a, Float b) { return a = a * b; }
+
+// Linear interpolation between a and b by t in each lane.
+inline Float Lerp(Float a, Float b, Float t) { return a + (b - a) * t; }
+
+inline Float Clamp(Float a, Float low, Float high) { return Min(Max(a, low), high); }
+
+// The transcendental functions below are the polynomial approximations from the Cephes library.
+// They're accurate to a few ulps over the ranges that we use them for, and are written with the
+// operations above so that they're vectorized on every target. Denormals and infinite inputs
+// aren't handled.
+
+// e^x. Results that would be denormal are flushed to zero, and large inputs are clamped instead of
+// overflowing to infinity.
+inline Float Exp(Float x)
+{
+  Float clamped = Min(x, 88.0f);
+
+  // Split x into n * ln(2) + r, where r is small enough for the polynomial, using two parts of
+  // ln(2) so that the reduction doesn't lose precision.
+  Float n = Round(clamped * 1.44269504088896341f);
+  Float r = clamped - n * 0.693359375f + n * 2.12194440e-4f;
+
+  Float p = 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  p = p * r * r + r + 1.0f;
+
+  // Multiply by 2^n by building its exponent bits directly.
+  Float result = p * AsFloat((ToInt(n) + 127) << 23);
+  return Select(x < -87.0f, 0.0f, result);
+}
+
+// The natural logarithm of x. Zero returns negative infinity, and x must not be negative.
+inline Float Log(Float x)
+{
+  // Split x into m * 2^e, where m is in [sqrt(0.5), sqrt(2)).
+  Int bits = AsInt(x);
+  Float e = ToFloat((bits >> 23) - 126);
+  Float m = AsFloat((bits & 0x007FFFFF) | 0x3F000000);
+
+  Mask small = m < 0.707106781186547524f;
+  e = Select(small, e - 1.0f, e);
+  m = Select(small, m + m, m) - 1.0f;
+
+  Float z = m * m;
+  Float y = 7.0376836292e-2f;
+  y = y * m - 1.1514610310e-1f;
+  y = y * m + 1.1676998740e-1f;
+  y = y * m - 1.2420140846e-1f;
+  y = y * m + 1.4249322787e-1f;
+  y = y * m - 1.6668057665e-1f;
+  y = y * m + 2.0000714765e-1f;
+  y = y * m - 2.4999993993e-1f;
+  y = y * m + 3.3333331174e-1f;
+  y = y * m * z;
+
+  y = y - e * 2.12194440e-4f - z * 0.5f;
+  Float result = m + y + e * 0.693359375f;
+  return Select(x <= 0.0f, -HUGE_VALF, result);
+}
+
+// x^y for x >= 0. Zero to any power returns zero, which is only correct for positive powers.
+inline Float Pow(Float x, Float y)
+{
+  return Select(x <= 0.0f, 0.0f, Exp(y * Log(x)));
+}
+
+// The hyperbolic tangent of x, which switches to a polynomial near zero where the exponential
+// form would cancel.
+inline Float Tanh(Float x)
+{
+  Float z = x * x;
+  Float p = -5.70498872745e-3f;
+  p = p * z + 2.06390887954e-2f;
+  p = p * z - 5.37397155531e-2f;
+  p = p * z + 1.33314422036e-1f;
+  p = p * z - 3.33332819422e-1f;
+  p = p * z * x + x;
+
+  Float a = Abs(x);
+  Float large = Float(1.0f) - Float(2.0f) / (Exp(a + a) + 1.0f);
+  large = Select(x < 0.0f, -large, large);
+  return Select(a < 0.625f, p, large);
+}
+
+// The hyperbolic cosine of x. Since Exp clamps, large inputs stay finite.
+inline Float Cosh(Float x)
+{
+  Float e = Exp(Abs(x));
+  return (e + Float(1.0f) / e) * 0.5f;
+}
+
+// The sine and cosine of x, which should be within a few thousand radians of zero.
+inline void SinCos(Float x, Float& sine, Float& cosine)
+{
+  // Split x into q * pi / 2 + r, where r is in [-pi / 4, pi / 4], with three parts of pi / 2.
+  Float q = Round(x * 0.636619772367581343f);
+  Float r = x - q * 1.5703125f - q * 4.837512969970703125e-4f - q * 7.54978995489188216e-8f;
+  Float z = r * r;
+
+  Float s = -1.9515295891e-4f;
+  s = s * z + 8.3321608736e-3f;
+  s = s * z - 1.6666654611e-1f;
+  s = s * z * r + r;
+
+  Float c = 2.443315711809948e-5f;
+  c = c * z - 1.388731625493765e-3f;
+  c = c * z + 4.166664568298827e-2f;
+  c = c * z * z - z * 0.5f + 1.0f;
+
+  // Rotate the result into the right quadrant.
+  Int quadrant = ToInt(q) & 3;
+  Mask swap = (quadrant & 1) == 1;
+  Float swappedSine = Select(swap, c, s);
+  Float swappedCosine = Select(swap, s, c);
+  sine = Select((quadrant & 2) == 2, -swappedSine, swappedSine);
+  cosine = Select(((quadrant + 1) & 2) == 2, -swappedCosine, swappedCosine);
+}
+
+} // namespace Waves::Simd
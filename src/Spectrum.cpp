@@ -0,0 +1,383 @@
+#include "Spectrum.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "Simd.h"
+
+namespace Waves
+{
+
+namespace
+{
+
+// Refer to spectrum.compute for an explanation of the math.
+constexpr float pi = 3.14159265358f;
+constexpr float sigma = 0.072f; // surface tension of water 72 milliNewtons/meter
+constexpr float rho = 1000.0f;  // density of water in kg/m^3
+
+float DispersionDerivative(const GeneratorSettings& s, float k)
+{
+  float phi = Dispersion(s, k);
+  float sech = 1.0f / std::cosh(s.h * k);
+
+  float numerator = s.h * (sigma / rho * k * k * k + s.g * k) * sech * sech + phi * phi;
+  return numerator / (2.0f * phi);
+}
+
+float JonswapSpectrum(const GeneratorSettings& s, float omega, float omega_p)
+{
+  float alpha = 0.076f * std::pow(s.U_10 * s.U_10 / (s.F * s.g), 0.22f);
+  float gamma = 3.3f;
+  float sigma = omega > omega_p ? 0.09f : 0.07f;
+
+  float omegaDiff = std::abs(omega - omega_p);
+  float omegaRatio = omega_p / omega;
+  float r = std::exp(-omegaDiff * omegaDiff / (2.0f * sigma * sigma * omega_p * omega_p));
+  float S = alpha * s.g * s.g / std::pow(omega, 5.0f) *
+            std::exp(-1.25f * std::pow(omegaRatio, 4.0f)) * std::pow(gamma, r);
+
+  float w_h = std::min(omega * std::sqrt(s.h / s.g), 2.0f);
+  float t = glm::clamp(w_h / 2.2f, 0.0f, 1.0f);
+  float kitaigorodskii_depth_attenuation = t * t * (3.0f - 2.0f * t);
+  return S * kitaigorodskii_depth_attenuation;
+}
+
+float LonguetHigginsNormalization(float s)
+{
+  float a = std::sqrt(s);
+  return (s < 0.4f) ? (0.5f / pi) + s * (0.220636f + s * (-0.109f + s * 0.090f))
+                    : (1.0f / std::sqrt(pi)) * (a * 0.5f + (1.0f / a) * 0.0625f);
+}
+
+float LonguetHigginsFunction(float s, float theta)
+{
+  return LonguetHigginsNormalization(s) * std::pow(std::abs(std::cos(theta * 0.5f)), 2.0f * s);
+}
+
+float HasselmannDirectionalSpread(const GeneratorSettings& settings, float w, float w_p,
+                                  float theta)
+{
+  float p = w / w_p;
+  float exponent = -2.33f - 1.45f * (settings.U_10 * w_p / settings.g - 1.17f);
+  float s = (w <= w_p) ? 6.97f * std::pow(std::abs(p), 4.06f)
+                       : 9.77f * std::pow(std::abs(p), exponent); // Shaping parameter
+  float s_xi = 16.0f * std::tanh(w_p / w) * settings.swell * settings.swell;
+  return LonguetHigginsFunction(s + s_xi, theta);
+}
+
+// The constants of the Philox2x32-10 counter-based generator, from Salmon et al. - Parallel Random
+// Numbers: As Easy as 1, 2, 3.
+constexpr uint32_t philoxMultiplier = 0xD256D193U;
+constexpr uint32_t philoxWeyl = 0x9E3779B9U;
+constexpr int philoxRounds = 10;
+
+// The output only depends on the counter and the key, so any texel's numbers can be drawn on their
+// own, in any order and on any thread.
+glm::uvec2 Philox(glm::uvec2 counter, uint32_t key)
+{
+  for (int i = 0; i < philoxRounds; i++)
+  {
+    uint64_t product = static_cast<uint64_t>(philoxMultiplier) * counter.x;
+    counter = glm::uvec2(static_cast<uint32_t>(product >> 32) ^ key ^ counter.y,
+                         static_cast<uint32_t>(product));
+    key += philoxWeyl;
+  }
+  return counter;
+}
+
+// Two uniform numbers for a texel, like RandomUniforms in spectrum.compute. The first is in (0, 1]
+// so that its log is finite, and the second is in [0, 1).
+glm::vec2 RandomUniforms(const GeneratorSettings& s, uint32_t x, uint32_t y)
+{
+  glm::uvec2 counter = glm::uvec2(x | (y << 16), static_cast<uint32_t>(s.seed.y));
+  glm::uvec2 bits = Philox(counter, static_cast<uint32_t>(s.seed.x));
+  return glm::vec2(static_cast<float>(bits.x >> 8) + 1.0f, static_cast<float>(bits.y >> 8)) /
+         16777216.0f;
+}
+
+glm::vec2 Gaussian(glm::vec2 x)
+{
+  float r = std::sqrt(-2.0f * std::log(x.x));
+  float theta = 2.0f * pi * x.y;
+  return glm::vec2(r * std::cos(theta), r * std::sin(theta));
+}
+
+} // namespace
+
+float Dispersion(const GeneratorSettings& s, float k)
+{
+  float kh = k * s.h;
+  float tanhKH = kh >= 2.0f * pi ? 1.0f : std::tanh(kh);
+  float omegaSquared = (s.g * k + sigma / rho * k * k * k) * tanhKH;
+  return std::sqrt(omegaSquared);
+}
+
+float QuantizedDispersion(const GeneratorSettings& s, float k)
+{
+  float omega = Dispersion(s, k);
+  if (s.repeatPeriod <= 0.0f)
+    return omega;
+
+  float omega_0 = 2.0f * pi / s.repeatPeriod;
+  return std::floor(omega / omega_0) * omega_0;
+}
+
+glm::vec2 GetSpectrumAmplitude(const GeneratorSettings& s, glm::vec2 thread, glm::vec2 dimensions)
+{
+  float dk = 2.0f * pi / s.planeSize;
+  glm::vec2 kVec = (thread - dimensions / 2.0f) * dk;
+  float k = glm::length(kVec);
+  float theta = std::atan2(kVec.y, kVec.x) - s.theta_0;
+
+  if (k == 0.0f)
+    return glm::vec2(0.0f);
+
+  float omega = Dispersion(s, k);
+  float omega_p = 22.0f * std::pow(s.g * s.g / (s.U_10 * s.F), 0.333f);
+
+  float Sj = JonswapSpectrum(s, omega, omega_p);
+  float d = ((1.0f - s.spread) * HasselmannDirectionalSpread(s, omega, omega_p, theta) +
+             s.spread / (2.0f * pi));
+
+  float chain = DispersionDerivative(s, k) / k * dk * dk;
+
+  glm::vec2 noise =
+      Gaussian(RandomUniforms(s, static_cast<uint32_t>(thread.x), static_cast<uint32_t>(thread.y)));
+  return 0.1f * s.scale * noise * std::sqrt(2.0f * Sj * d * chain);
+}
+
+namespace
+{
+
+using Simd::Float;
+using Simd::Int;
+using Simd::Mask;
+
+// The parts of the spectrum that only depend on the settings, computed once for every texel.
+struct SpectrumConstants
+{
+  float dk;
+  float halfDimension;
+  float omega_p;
+  float alpha;
+  float spreadExponent; // The Hasselmann shaping exponent above the peak frequency.
+  float swellFactor;
+  float windX, windZ;   // The direction that theta is measured from.
+};
+
+SpectrumConstants GetSpectrumConstants(const GeneratorSettings& s, std::size_t textureSize)
+{
+  SpectrumConstants c;
+  c.dk = 2.0f * pi / s.planeSize;
+  c.halfDimension = static_cast<float>(textureSize) / 2.0f;
+  c.omega_p = 22.0f * std::pow(s.g * s.g / (s.U_10 * s.F), 0.333f);
+  c.alpha = 0.076f * std::pow(s.U_10 * s.U_10 / (s.F * s.g), 0.22f);
+  c.spreadExponent = -2.33f - 1.45f * (s.U_10 * c.omega_p / s.g - 1.17f);
+  c.swellFactor = 16.0f * s.swell * s.swell;
+  c.windX = std::cos(s.theta_0);
+  c.windZ = std::sin(s.theta_0);
+  return c;
+}
+
+// GetSpectrumAmplitude for Simd::width texels at once, using fast approximations of the
+// transcendental functions. The random numbers use exactly the same integer math as RandomUniforms,
+// so a seed produces the same ocean as on the GPU.
+void GetSpectrumAmplitudes(const GeneratorSettings& s, const SpectrumConstants& c, Float threadX,
+                           Float threadY, Float& real, Float& imaginary)
+{
+  // With a single lane, the approximations are slower than the standard library, so we fall back
+  // to the exact evaluation.
+  if constexpr (Simd::width == 1)
+  {
+    float x[Simd::width], y[Simd::width];
+    Simd::Store(x, threadX);
+    Simd::Store(y, threadY);
+
+    glm::vec2 dimensions = glm::vec2(2.0f * c.halfDimension);
+    glm::vec2 amplitude = GetSpectrumAmplitude(s, glm::vec2(x[0], y[0]), dimensions);
+    real = amplitude.x;
+    imaginary = amplitude.y;
+    return;
+  }
+
+  Float kx = (threadX - c.halfDimension) * c.dk;
+  Float kz = (threadY - c.halfDimension) * c.dk;
+  Float k = Simd::Sqrt(kx * kx + kz * kz);
+
+  // The wave with no wave number has no amplitude, but we keep its lanes finite until the end.
+  Mask still = k == 0.0f;
+  k = Simd::Select(still, 1.0f, k);
+
+  // Dispersion
+  Float kh = k * s.h;
+  Float tanhKH = Simd::Select(kh >= 2.0f * pi, 1.0f, Simd::Tanh(kh));
+  Float gravityCapillary = k * s.g + k * k * k * (sigma / rho);
+  Float omega = Simd::Sqrt(gravityCapillary * tanhKH);
+
+  // JonswapSpectrum
+  Float jonswapSigma = Simd::Select(omega > c.omega_p, 0.09f, 0.07f);
+  Float omegaDiff = omega - c.omega_p;
+  Float omegaRatio = Float(c.omega_p) / omega;
+  Float omegaRatio2 = omegaRatio * omegaRatio;
+  Float omega2 = omega * omega;
+  Float r = Simd::Exp(-omegaDiff * omegaDiff /
+                      (jonswapSigma * jonswapSigma * (2.0f * c.omega_p * c.omega_p)));
+  Float S = Float(c.alpha * s.g * s.g) / (omega2 * omega2 * omega) *
+            Simd::Exp(omegaRatio2 * omegaRatio2 * -1.25f) * Simd::Exp(r * std::log(3.3f));
+
+  Float w_h = Simd::Min(omega * std::sqrt(s.h / s.g), 2.0f);
+  Float t = Simd::Clamp(w_h / 2.2f, 0.0f, 1.0f);
+  S = S * t * t * (Float(3.0f) - t * 2.0f);
+
+  // HasselmannDirectionalSpread, where both branches share one Pow.
+  Mask belowPeak = omega <= c.omega_p;
+  Float p = omega / c.omega_p;
+  Float shape = Simd::Select(belowPeak, 6.97f, 9.77f) *
+                Simd::Pow(p, Simd::Select(belowPeak, 4.06f, c.spreadExponent));
+  shape = shape + Simd::Tanh(omegaRatio) * c.swellFactor;
+
+  // LonguetHigginsFunction. Rather than finding theta with an arctangent, we use the half-angle
+  // vector between the wave and the wind, whose length is 2|cos(theta / 2)|. This way,
+  // |cos(theta / 2)|^(2s) = (|k / |k| + wind|^2 / 4)^s, which stays accurate for waves that run
+  // against the wind, unlike the form with 1 + cos(theta).
+  Float a = Simd::Sqrt(shape);
+  Float polynomial = shape * 0.090f - 0.109f;
+  polynomial = Float(0.5f / pi) + shape * (shape * polynomial + 0.220636f);
+  Float asymptote = (a * 0.5f + Float(0.0625f) / a) * (1.0f / std::sqrt(pi));
+  Float normalization = Simd::Select(shape < 0.4f, polynomial, asymptote);
+  Float halfX = kx / k + c.windX;
+  Float halfZ = kz / k + c.windZ;
+  Float halfCos2 = (halfX * halfX + halfZ * halfZ) * 0.25f;
+  Float d = normalization * Simd::Pow(halfCos2, shape) * (1.0f - s.spread) +
+            s.spread / (2.0f * pi);
+
+  // DispersionDerivative
+  Float sech = Float(1.0f) / Simd::Cosh(k * s.h);
+  Float derivative = (gravityCapillary * sech * sech * s.h + omega2) / (omega * 2.0f);
+  Float chain = derivative / k * (c.dk * c.dk);
+
+  // RandomUniforms. The key is the same in every lane, so only the counters are vectors.
+  Int counterX = Simd::ToInt(threadX) | (Simd::ToInt(threadY) << 16);
+  Int counterY = s.seed.y;
+  uint32_t key = static_cast<uint32_t>(s.seed.x);
+  Int multiplier = static_cast<int32_t>(philoxMultiplier);
+  for (int i = 0; i < philoxRounds; i++)
+  {
+    Int low = counterX * multiplier;
+    counterX = Simd::MulHi(counterX, multiplier) ^ static_cast<int32_t>(key) ^ counterY;
+    counterY = low;
+    key += philoxWeyl;
+  }
+  Float uniformX = (Simd::ToFloat(counterX >> 8) + 1.0f) / 16777216.0f;
+  Float uniformY = Simd::ToFloat(counterY >> 8) / 16777216.0f;
+
+  // Gaussian
+  Float radius = Simd::Sqrt(Simd::Log(uniformX) * -2.0f);
+  Float sine, cosine;
+  Simd::SinCos(uniformY * (2.0f * pi), sine, cosine);
+
+  Float amplitude = Simd::Sqrt(S * d * chain * 2.0f) * (0.1f * s.scale) * radius;
+  real = Simd::Select(still, 0.0f, amplitude * cosine);
+  imaginary = Simd::Select(still, 0.0f, amplitude * sine);
+}
+
+// Fills the rows of a spectrum with the given width. Each texel stores the wave and the conjugate
+// of its opposite, which is all that either layout needs. The texels of a row are evaluated
+// Simd::width at a time, and the rows are spread across the thread pool.
+void FillSpectrum(const GeneratorSettings& settings, std::size_t textureSize, std::size_t width,
+                  std::size_t height, glm::vec4* spectrum, ThreadPool* threadPool)
+{
+  constexpr std::size_t lanes = Simd::width;
+  SpectrumConstants constants = GetSpectrumConstants(settings, textureSize);
+  float dimension = static_cast<float>(textureSize);
+
+  float laneOffsets[lanes];
+  for (std::size_t lane = 0; lane < lanes; lane++)
+    laneOffsets[lane] = static_cast<float>(lane);
+  Float offsets = Simd::Load(laneOffsets);
+
+  auto rows = [&](std::size_t begin, std::size_t end)
+  {
+    for (std::size_t y = begin; y < end; y++)
+    {
+      Float threadY = static_cast<float>(y);
+      for (std::size_t x = 0; x < width; x += lanes)
+      {
+        // We store the signal for this wave, as well as the conjugate of the wave in the opposite
+        // direction to maintain the complex conjugate property.
+        Float threadX = offsets + static_cast<float>(x);
+        Float real, imaginary, oppReal, oppImaginary;
+        GetSpectrumAmplitudes(settings, constants, threadX, threadY, real, imaginary);
+        GetSpectrumAmplitudes(settings, constants, Float(dimension) - threadX,
+                              Float(dimension) - threadY, oppReal, oppImaginary);
+
+        float results[4][lanes];
+        Simd::Store(results[0], real);
+        Simd::Store(results[1], imaginary);
+        Simd::Store(results[2], oppReal);
+        Simd::Store(results[3], -oppImaginary);
+
+        // The last pack of a row may run past its end.
+        std::size_t numLanes = std::min(lanes, width - x);
+        for (std::size_t lane = 0; lane < numLanes; lane++)
+        {
+          spectrum[y * width + x + lane] = glm::vec4(results[0][lane], results[1][lane],
+                                                     results[2][lane], results[3][lane]);
+        }
+      }
+    }
+  };
+
+  if (threadPool)
+    threadPool->ParallelFor(height, rows);
+  else
+    rows(0, height);
+}
+
+} // namespace
+
+void GenerateInitialSpectrum(const GeneratorSettings& settings, std::size_t textureSize,
+                             glm::vec4* spectrum, ThreadPool* threadPool)
+{
+  FillSpectrum(settings, textureSize, textureSize, textureSize, spectrum, threadPool);
+}
+
+void GenerateHalfSpectrum(const GeneratorSettings& settings, std::size_t textureSize,
+                          glm::vec4* spectrum, ThreadPool* threadPool)
+{
+  FillSpectrum(settings, textureSize, GetHalfSpectrumWidth(textureSize),
+               GetHalfSpectrumHeight(textureSize), spectrum, threadPool);
+}
+
+float GetMaxAngularFrequency(const GeneratorSettings& settings, std::size_t textureSize)
+{
+  float dk = 2.0f * pi / settings.planeSize;
+  float k = std::sqrt(2.0f) * dk * static_cast<float>(textureSize / 2);
+  return Dispersion(settings, k);
+}
+
+uint64_t HashSpectrumSettings(const GeneratorSettings& settings)
+{
+  GeneratorSettings hashed = settings;
+  hashed.time = 0.0f;
+  hashed.displacement = 0.0f;
+  hashed.repeatPeriod = 0.0f;
+  hashed.blend = 0.0f;
+
+  // FNV-1a over the raw bytes. The settings are all four bytes wide, so there is no padding.
+  unsigned char bytes[sizeof(GeneratorSettings)];
+  std::memcpy(bytes, &hashed, sizeof(GeneratorSettings));
+
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char byte : bytes)
+  {
+    hash ^= byte;
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+} // namespace Waves
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+
+#include "GeneratorSettings.h"
+#include "ThreadPool.h"
+
+namespace Waves
+{
+
+// The CPU evaluation of the spectrum that spectrum.compute generates. These mirror the functions in
+// the shader as closely as possible, so that the CPU and GPU paths produce the same oceans.
+//
+// GetSpectrumAmplitude evaluates one texel exactly. The functions that fill whole spectra evaluate
+// several texels at once with the vector units instead, using fast approximations of exp, log, and
+// friends that agree with it to about 1e-4 relative. Their random numbers are bit for bit the same,
+// so a seed always produces the same ocean.
+
+// The angular frequency of a wave with the given wave number.
+float Dispersion(const GeneratorSettings& settings, float k);
+
+// The angular frequency that a wave is propagated with, rounded down to a multiple of the frequency
+// of the repeat period so that the ocean loops. Without a repeat period, this is the dispersion.
+float QuantizedDispersion(const GeneratorSettings& settings, float k);
+
+// The complex amplitude of the wave at a texel of the initial spectrum.
+glm::vec2 GetSpectrumAmplitude(const GeneratorSettings& settings, glm::vec2 thread,
+                               glm::vec2 dimensions);
+
+// Fills an image of textureSize * textureSize texels with the initial spectrum, laid out like the
+// output of the generateSpectrum kernel. The thread pool is optional.
+void GenerateInitialSpectrum(const GeneratorSettings& settings, std::size_t textureSize,
+                             glm::vec4* spectrum, ThreadPool* threadPool = nullptr);
+
+// The half spectrum exploits the Hermitian symmetry of the spectrum. Each texel already pairs a
+// wave with its opposite, so only the rows [0, N / 2] are needed. The opposite of the first column
+// lies just outside of the full image, so the half spectrum also has one extra column.
+inline std::size_t GetHalfSpectrumWidth(std::size_t textureSize) { return textureSize + 1; }
+inline std::size_t GetHalfSpectrumHeight(std::size_t textureSize) { return textureSize / 2 + 1; }
+
+// Fills the half spectrum, laid out like the output of the generateHalfSpectrum kernel. The texels
+// that it keeps are the same as in the full spectrum, but each amplitude is only evaluated once.
+void GenerateHalfSpectrum(const GeneratorSettings& settings, std::size_t textureSize,
+                          glm::vec4* spectrum, ThreadPool* threadPool = nullptr);
+
+// The angular frequency of the fastest wave in a spectrum of textureSize * textureSize texels,
+// which is the shortest one, in its corners.
+float GetMaxAngularFrequency(const GeneratorSettings& settings, std::size_t textureSize);
+
+// Hashes every setting that the initial spectrum depends on. Time, displacement, the repeat period,
+// and the blend are excluded, since they're only used once the spectrum exists, so the hash only
+// changes when the spectrum must be regenerated.
+uint64_t HashSpectrumSettings(const GeneratorSettings& settings);
+
+} // namespace Waves
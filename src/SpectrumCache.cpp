@@ -0,0 +1,68 @@
+#include "SpectrumCache.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#include "AtomicFile.h"
+
+namespace Waves
+{
+
+namespace
+{
+
+// Bump the version whenever the spectrum math or the layout of the file changes.
+constexpr FileHeader spectrumHeader = {0x43505357, 3}; // "WSPC"
+
+// Follows the header, and is followed by the texels.
+struct SpectrumKey
+{
+  uint64_t settingsHash = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+
+  bool operator==(const SpectrumKey&) const = default;
+};
+
+std::filesystem::path GetSpectrumPath(uint64_t settingsHash, std::size_t width, std::size_t height)
+{
+  char name[64];
+  std::snprintf(name, sizeof(name), "%016llx_%zux%zu.spectrum",
+                static_cast<unsigned long long>(settingsHash), width, height);
+  return std::filesystem::path("cache/spectra") / name;
+}
+
+} // namespace
+
+bool LoadSpectrum(uint64_t settingsHash, std::size_t width, std::size_t height,
+                  std::vector<glm::vec4>& spectrum)
+{
+  std::string payload;
+  if (!ReadFileChecked(GetSpectrumPath(settingsHash, width, height), spectrumHeader, payload))
+    return false;
+
+  // The hash is in the name, but we check it again in case of a collision in the file name.
+  std::string_view contents = payload;
+  SpectrumKey key;
+  SpectrumKey expected = {settingsHash, static_cast<uint32_t>(width),
+                          static_cast<uint32_t>(height)};
+  if (!ConsumeBytes(contents, &key) || key != expected ||
+      contents.size() != width * height * sizeof(glm::vec4))
+    return false;
+
+  spectrum.resize(width * height);
+  return ConsumeBytes(contents, spectrum.data(), spectrum.size());
+}
+
+void SaveSpectrum(uint64_t settingsHash, std::size_t width, std::size_t height,
+                  const std::vector<glm::vec4>& spectrum)
+{
+  SpectrumKey key = {settingsHash, static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+  std::string payload;
+  AppendBytes(payload, &key);
+  AppendBytes(payload, spectrum.data(), spectrum.size());
+  WriteFileAtomic(GetSpectrumPath(settingsHash, width, height), spectrumHeader, payload);
+}
+
+} // namespace Waves
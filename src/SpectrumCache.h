@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace Waves
+{
+
+// Initial spectra are expensive to generate and only depend on the settings and the resolution, so
+// we keep them on disk under cache/spectra, keyed by HashSpectrumSettings and the dimensions of the
+// spectrum, which differ between the full and half layouts. Each file starts with a small header,
+// so that files from older versions are ignored.
+
+// Reads the cached spectrum for these settings into spectrum, which is resized to fit. Returns
+// false if there is no valid cache file.
+bool LoadSpectrum(uint64_t settingsHash, std::size_t width, std::size_t height,
+                  std::vector<glm::vec4>& spectrum);
+
+// Writes a spectrum of width * height texels to the cache, replacing any existing file.
+void SaveSpectrum(uint64_t settingsHash, std::size_t width, std::size_t height,
+                  const std::vector<glm::vec4>& spectrum);
+
+} // namespace Waves
@@ -0,0 +1,59 @@
+#include "TaskGraph.h"
+
+#include <algorithm>
+
+namespace Waves
+{
+
+TaskGraph::TaskID TaskGraph::AddTask(std::function<void()> func,
+                                     std::initializer_list<TaskID> dependencies)
+{
+  std::span<const TaskID> span(dependencies.begin(), dependencies.size());
+  return AddTask(std::move(func), span);
+}
+
+TaskGraph::TaskID TaskGraph::AddTask(std::function<void()> func,
+                                     std::span<const TaskID> dependencies)
+{
+  TaskID id = tasks.size();
+  Task& task = tasks.emplace_back();
+  task.func = std::move(func);
+  task.numDependencies = dependencies.size();
+
+  for (TaskID dependency : dependencies)
+    tasks[dependency].successors.push_back(id);
+
+  return id;
+}
+
+TaskGraph::TaskID TaskGraph::AddParallelFor(std::size_t count, std::size_t chunkSize,
+                                            std::function<void(std::size_t, std::size_t)> func,
+                                            std::initializer_list<TaskID> dependencies)
+{
+  // Rather than have every chunk depend on every dependency, which grows with the product of their
+  // counts, several dependencies are joined into one task first.
+  std::span<const TaskID> chunkDependencies(dependencies.begin(), dependencies.size());
+  TaskID start = 0;
+  if (dependencies.size() > 1)
+  {
+    start = AddTask({}, chunkDependencies);
+    chunkDependencies = {&start, 1};
+  }
+
+  chunkSize = std::max<std::size_t>(chunkSize, 1);
+  std::vector<TaskID> chunks;
+  for (std::size_t begin = 0; begin < count; begin += chunkSize)
+  {
+    std::size_t end = std::min(begin + chunkSize, count);
+    chunks.push_back(AddTask([func, begin, end]() { func(begin, end); }, chunkDependencies));
+  }
+
+  // Likewise, the chunks are joined into one task for later tasks to depend on. An empty range
+  // still has to wait on its dependencies.
+  if (chunks.empty())
+    return AddTask({}, chunkDependencies);
+
+  return AddTask({}, chunks);
+}
+
+} // namespace Waves
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <span>
+#include <vector>
+
+namespace Waves
+{
+
+// A set of tasks with dependencies between them, which ThreadPool::Run executes. Tasks that don't
+// depend on each other run in any order, so independent chains of work interleave across the
+// threads rather than waiting on each other at every step.
+//
+// A graph can be run any number of times, and is usually built once for a frame's work.
+class TaskGraph
+{
+public:
+  using TaskID = std::size_t;
+
+  // Adds a task that runs once every task that it depends on has finished.
+  TaskID AddTask(std::function<void()> func, std::initializer_list<TaskID> dependencies = {});
+
+  // Adds a task for each chunk of chunkSize items in [0, count), which calls func(begin, end) once
+  // the dependencies have finished. Returns a task that finishes after every chunk, so that later
+  // tasks can depend on all of them at once.
+  TaskID AddParallelFor(std::size_t count, std::size_t chunkSize,
+                        std::function<void(std::size_t, std::size_t)> func,
+                        std::initializer_list<TaskID> dependencies = {});
+
+  void Clear() { tasks.clear(); }
+  std::size_t GetNumTasks() const { return tasks.size(); }
+
+private:
+  friend class ThreadPool;
+
+  TaskID AddTask(std::function<void()> func, std::span<const TaskID> dependencies);
+
+private:
+  struct Task
+  {
+    std::function<void()> func; // Empty for tasks that only join others.
+    std::vector<TaskID> successors;
+    std::size_t numDependencies = 0;
+  };
+
+  std::vector<Task> tasks;
+};
+
+} // namespace Waves
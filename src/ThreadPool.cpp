@@ -0,0 +1,280 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+
+#include "TaskGraph.h"
+
+namespace Waves
+{
+
+ThreadPool::ThreadPool(std::size_t numThreads)
+{
+  if (numThreads == 0)
+    numThreads = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // The thread which calls ParallelFor does work too, so we need one less worker.
+  for (std::size_t i = 1; i < numThreads; i++)
+    workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    stopping = true;
+  }
+  jobSignal.notify_all();
+
+  for (auto& worker : workers)
+    worker.join();
+}
+
+void ThreadPool::ParallelFor(std::size_t count,
+                             const std::function<void(std::size_t, std::size_t)>& func,
+                             std::size_t minChunkSize)
+{
+  if (count == 0)
+    return;
+
+  // Oversubscribe the chunks a bit so that uneven work still balances across threads.
+  std::size_t numThreads = GetNumThreads();
+  std::size_t chunkSize = std::max((count + numThreads * 4 - 1) / (numThreads * 4), minChunkSize);
+  std::size_t numChunks = (count + chunkSize - 1) / chunkSize;
+
+  // There is no point waking any workers if there is only one piece of work.
+  if (numChunks == 1 || workers.empty())
+  {
+    func(0, count);
+    return;
+  }
+
+  // This state is shared with the helper jobs, which may outlive this call if they are picked up
+  // after all of the chunks are already done.
+  struct Range
+  {
+    std::atomic<std::size_t> nextChunk = 0;
+    std::size_t remaining = 0;
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+
+  auto range = std::make_shared<Range>();
+  range->remaining = numChunks;
+
+  auto runChunks = [range, &func, count, chunkSize, numChunks]()
+  {
+    std::size_t completed = 0;
+    for (std::size_t chunk = range->nextChunk++; chunk < numChunks; chunk = range->nextChunk++)
+    {
+      std::size_t begin = chunk * chunkSize;
+      func(begin, std::min(begin + chunkSize, count));
+      completed++;
+    }
+
+    if (completed == 0)
+      return;
+
+    std::lock_guard<std::mutex> lock(range->mutex);
+    range->remaining -= completed;
+    if (range->remaining == 0)
+      range->done.notify_all();
+  };
+
+  // Only the jobs that will find work need to touch func, which lives on our stack. Any job that is
+  // late sees that nextChunk is exhausted and returns without calling it.
+  std::size_t numHelpers = std::min(workers.size(), numChunks - 1);
+  {
+    std::lock_guard<std::mutex> lock(jobMutex);
+    for (std::size_t i = 0; i < numHelpers; i++)
+      jobs.push(runChunks);
+  }
+  jobSignal.notify_all();
+
+  runChunks();
+
+  std::unique_lock<std::mutex> lock(range->mutex);
+  range->done.wait(lock, [&range]() { return range->remaining == 0; });
+}
+
+void ThreadPool::Run(TaskGraph& graph)
+{
+  using TaskID = TaskGraph::TaskID;
+
+  std::size_t numTasks = graph.tasks.size();
+  if (numTasks == 0)
+    return;
+
+  // The ready tasks of each thread. The tasks are much longer than the time spent holding a lock,
+  // so a mutex on each queue is plenty.
+  struct TaskQueue
+  {
+    std::mutex mutex;
+    std::deque<TaskID> tasks;
+  };
+
+  // Like in ParallelFor, this is shared with helper jobs that may be picked up late. Those only
+  // touch the graph once they've taken a task, and no tasks are left once remaining reaches zero.
+  struct Execution
+  {
+    TaskGraph* graph = nullptr;
+    std::size_t numThreads = 0;
+    std::unique_ptr<TaskQueue[]> queues;
+    std::unique_ptr<std::atomic<std::size_t>[]> dependencies;
+    std::atomic<std::size_t> remaining = 0;
+    std::atomic<std::size_t> nextThread = 1;
+
+    // Threads that find no tasks sleep until there are some, or until the graph is done.
+    std::atomic<std::size_t> numQueued = 0;
+    std::atomic<std::size_t> numSleeping = 0;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    void Push(std::size_t thread, TaskID task)
+    {
+      {
+        std::lock_guard<std::mutex> lock(queues[thread].mutex);
+        queues[thread].tasks.push_back(task);
+      }
+      numQueued++;
+    }
+
+    void Wake()
+    {
+      if (numSleeping == 0)
+        return;
+
+      // Taking the lock orders this with a sleeper checking whether there's anything to do.
+      {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+      }
+      wake.notify_all();
+    }
+
+    // Takes the newest task from our own queue, or else the oldest task from another thread's.
+    bool Take(std::size_t thread, TaskID& task)
+    {
+      for (std::size_t i = 0; i < numThreads; i++)
+      {
+        TaskQueue& queue = queues[(thread + i) % numThreads];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+          continue;
+
+        if (i == 0)
+        {
+          task = queue.tasks.back();
+          queue.tasks.pop_back();
+        }
+        else
+        {
+          task = queue.tasks.front();
+          queue.tasks.pop_front();
+        }
+
+        numQueued--;
+        return true;
+      }
+
+      return false;
+    }
+
+    void Execute(std::size_t thread, TaskID id)
+    {
+      TaskGraph::Task& task = graph->tasks[id];
+      if (task.func)
+        task.func();
+
+      std::size_t numReady = 0;
+      for (TaskID successor : task.successors)
+      {
+        if (--dependencies[successor] == 0)
+        {
+          Push(thread, successor);
+          numReady++;
+        }
+      }
+
+      if (--remaining == 0 || numReady > 0)
+        Wake();
+    }
+
+    void Work(std::size_t thread)
+    {
+      while (remaining > 0)
+      {
+        TaskID task;
+        if (Take(thread, task))
+        {
+          Execute(thread, task);
+          continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        numSleeping++;
+        wake.wait(lock, [this]() { return numQueued > 0 || remaining == 0; });
+        numSleeping--;
+      }
+    }
+  };
+
+  auto execution = std::make_shared<Execution>();
+  execution->graph = &graph;
+  execution->numThreads = GetNumThreads();
+  execution->queues = std::make_unique<TaskQueue[]>(execution->numThreads);
+  execution->dependencies = std::make_unique<std::atomic<std::size_t>[]>(numTasks);
+  execution->remaining = numTasks;
+
+  // The tasks without dependencies are dealt out to every thread to start with.
+  std::size_t numRoots = 0;
+  for (TaskID task = 0; task < numTasks; task++)
+  {
+    execution->dependencies[task] = graph.tasks[task].numDependencies;
+    if (graph.tasks[task].numDependencies == 0)
+      execution->Push(numRoots++ % execution->numThreads, task);
+  }
+
+  std::size_t numHelpers = std::min(workers.size(), numTasks - 1);
+  if (numHelpers > 0)
+  {
+    {
+      std::lock_guard<std::mutex> lock(jobMutex);
+      for (std::size_t i = 0; i < numHelpers; i++)
+      {
+        jobs.push([execution]()
+        {
+          std::size_t thread = execution->nextThread++;
+          if (thread < execution->numThreads)
+            execution->Work(thread);
+        });
+      }
+    }
+    jobSignal.notify_all();
+  }
+
+  execution->Work(0);
+}
+
+void ThreadPool::WorkerLoop()
+{
+  while (true)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(jobMutex);
+      jobSignal.wait(lock, [this]() { return stopping || !jobs.empty(); });
+
+      if (stopping && jobs.empty())
+        return;
+
+      job = std::move(jobs.front());
+      jobs.pop();
+    }
+
+    job();
+  }
+}
+
+} // namespace Waves
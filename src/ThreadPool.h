@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Waves
+{
+
+class TaskGraph;
+
+// A fixed set of worker threads used by the CPU simulation path. Work is handed out as ranges which
+// are split into chunks and spread across the workers, and the calling thread helps until all of
+// the chunks are done. This means that nested calls cannot deadlock, they just run serially.
+class ThreadPool
+{
+public:
+  // Spawns the worker threads. A count of zero uses one thread per hardware thread.
+  ThreadPool(std::size_t numThreads = 0);
+
+  // Joins all of the worker threads.
+  ~ThreadPool();
+
+  // Calls func(begin, end) over disjoint chunks covering [0, count) and blocks until every chunk
+  // has been processed. Chunks will never be smaller than minChunkSize.
+  void ParallelFor(std::size_t count, const std::function<void(std::size_t, std::size_t)>& func,
+                   std::size_t minChunkSize = 1);
+
+  // Runs every task of a graph once its dependencies have finished, and blocks until they all have.
+  // Each thread keeps its own queue of ready tasks, running the newest first so that a task's
+  // successors run while its results are still in the cache. Threads that run out of tasks steal
+  // the oldest tasks from the others, which spreads independent chains of work across the threads.
+  // Like ParallelFor, the calling thread takes part, so nested calls just run serially.
+  void Run(TaskGraph& graph);
+
+  // The number of threads that execute work, including the thread that calls ParallelFor.
+  std::size_t GetNumThreads() const { return workers.size() + 1; }
+
+private:
+  void WorkerLoop();
+
+private:
+  std::vector<std::thread> workers;
+
+  // Jobs are type-erased so that the queue does not need to know about ParallelFor's state.
+  std::queue<std::function<void()>> jobs;
+  std::mutex jobMutex;
+  std::condition_variable jobSignal;
+  bool stopping = false;
+};
+
+} // namespace Waves
@@ -6,54 +6,253 @@
 
 #include <imgui.h>
 
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
 #include "core/Input.h"
 
+#include "ButterflyTable.h"
+#include "Profiler.h"
+#include "ShaderCache.h"
+#include "Spectrum.h"
+#include "WorkgroupTuner.h"
+
 namespace Waves
 {
 
-WaveApp::WaveApp()
+namespace
+{
+
+// The relative cost of simulating a cascade, which is dominated by its FFTs.
+float GetSimulationCost(std::size_t resolution)
+{
+  float size = static_cast<float>(resolution);
+  return size * size * std::log2(size);
+}
+
+} // namespace
+
+WaveApp::WaveApp(const WaveAppOptions& options)
 {
-  waveRenderer = new WaveRenderer(renderDevice, renderer, GetDisplayWidth(), GetDisplayHeight());
-  fftCalculator = new FFTCalculator(renderDevice, textureResolution);
+  ShaderCache::Get().SetDiskCacheEnabled(options.shaderCache);
 
-  // Create our three different tiles of ocean of varying sizes.
-  for (int i = 0; i < waveRenderer->GetNumRequiredGenerators(); i++)
+  // The pipelines are compiled with the tuned workgroups, so they're loaded first.
+  tuneWorkgroups = options.workgroupTuning != WorkgroupTuning::Off;
+  WorkgroupTuner::Get().Load();
+  if (options.workgroupTuning == WorkgroupTuning::All)
+    WorkgroupTuner::Get().Forget();
+
+  resourcePool = new ResourcePool(renderDevice);
+  waveRenderer = new WaveRenderer(renderDevice, renderer, resourcePool, GetDisplayWidth(),
+                                  GetDisplayHeight());
+
+  // A baked ocean decides the number of cascades and the sizes of their textures.
+  std::size_t numCascades = std::clamp<std::size_t>(options.numCascades, 1, maxCascades);
+  if (!options.playbackPath.empty())
   {
-    // Create our generator and configure
-    Generator* generator = new Generator(renderDevice, fftCalculator);
-    GeneratorSettings& settings = generator->GetOceanSettings();
+    bool opened = bakedOcean.Open(options.playbackPath);
+    for (std::size_t i = 0; opened && i < bakedOcean.GetNumCascades(); i++)
+      opened = IsGPUFFTSizeSupported(bakedOcean.GetCascade(i).textureSize);
+
+    if (!opened || bakedOcean.GetNumCascades() > maxCascades)
+    {
+      std::cerr << "Failed to play back " << options.playbackPath << ", simulating instead"
+                << std::endl;
+      bakedOcean.Close();
+    }
+    else
+    {
+      numCascades = bakedOcean.GetNumCascades();
+    }
+  }
 
-    // Set the size of the plane based on increasing prime sizes to prevent tiling.
-    static float primeFactors[] = {5.0, 17.0, 101.0};
-    settings.planeSize = primeFactors[i];
+  // The smallest plane holds the shortest waves, so it needs the most detail, while the larger
+  // planes only hold long swells that need fewer texels.
+  for (std::size_t i = 0; i < numCascades; i++)
+  {
+    if (bakedOcean.IsOpen())
+      cascadeResolutions.push_back(bakedOcean.GetCascade(i).textureSize);
+    else
+      cascadeResolutions.push_back(std::max<std::size_t>(512 >> i, 64));
+  }
 
-    // Enable bound wavelength to prevent frequencies from adding themselves twice.
-    settings.boundWavelength = 1;
+  // Create our tiles of ocean of varying sizes.
+  for (std::size_t i = 0; i < numCascades; i++)
+  {
+    // Create our generator and configure it, with planes of increasing prime sizes to prevent
+    // tiling.
+    FFTCalculator* fftCalculator = GetFFTCalculator(cascadeResolutions[i]);
+    Generator* generator = new Generator(renderDevice, resourcePool, fftCalculator);
+    ConfigureCascade(generator->GetOceanSettings(), i);
 
-    // Each wavelength should be on the smallest plane that it fits on for the most detail.
-    settings.wavelengthMax = settings.planeSize / 2.0;
-    settings.wavelengthMin = (i == 0) ? 0.0 : primeFactors[i - 1] / 2.0;
+    if (bakedOcean.IsOpen())
+      generator->SetPlayback(&bakedOcean, i);
 
     // Add our generator to the array.
     generators.push_back(generator);
   }
 
+  // The larger cascades only hold slower swells, so they're simulated less often and blended in
+  // between. Baked oceans have no simulation to save, so they update every frame.
+  scheduler.SetNumCascades(numCascades);
+  scheduler.SetFixedStep(options.fixedStep);
+  for (std::size_t i = 0; i < numCascades; i++)
+  {
+    scheduler.SetCost(i, GetSimulationCost(cascadeResolutions[i]));
+    if (!bakedOcean.IsOpen())
+      scheduler.SetInterval(i, std::size_t(1) << i);
+  }
+
   // Create our RenderPass
   Vision::RenderPassDesc rpDesc;
   rpDesc.Framebuffer = 0;
   rpDesc.LoadOp = Vision::LoadOp::Load;
   rpDesc.StoreOp = Vision::StoreOp::Store;
   renderPass = renderDevice->CreateRenderPass(rpDesc);
+
+  if (!options.tracePath.empty())
+    Profiler::Get().CaptureTrace(options.tracePath, traceFrames);
+
+  // The first start tunes every resolution that's in use, and later ones only what's missing.
+  if (tuneWorkgroups)
+  {
+    for (std::size_t resolution : cascadeResolutions)
+      StartTuning(resolution);
+  }
+
+  // Report how long the shaders took to start up, so that starts with and without the cache can be
+  // compared.
+  const ShaderCache::Statistics& shaderStats = ShaderCache::Get().GetStatistics();
+  std::cout << "Shaders ready in " << shaderStats.time << "ms (" << shaderStats.numCompiled
+            << " compiled, " << shaderStats.numLoaded << " loaded from the cache)" << std::endl;
 }
 
 WaveApp::~WaveApp()
 {
   renderDevice->DestroyRenderPass(renderPass);
 
-  delete fftCalculator;
+  // Tuning that hasn't finished is abandoned, along with the sizes that it hasn't saved yet.
+  WorkgroupTuner::Get().Stop(resourcePool);
+  for (auto* generator : tuningGenerators)
+    delete generator;
+
   delete waveRenderer;
   for (auto* generator : generators)
     delete generator;
+  for (auto* fftCalculator : fftCalculators)
+    delete fftCalculator;
+
+  // Everything has been returned to the pool by now.
+  delete resourcePool;
+}
+
+FFTCalculator* WaveApp::GetFFTCalculator(std::size_t resolution)
+{
+  for (auto* fftCalculator : fftCalculators)
+  {
+    if (fftCalculator->GetTextureResolution() == resolution)
+      return fftCalculator;
+  }
+
+  // New calculators use the same algorithm as the others.
+  FFTCalculator* fftCalculator = new FFTCalculator(renderDevice, resourcePool, resolution);
+  if (!fftCalculators.empty())
+    fftCalculator->SetMode(fftCalculators[0]->GetMode());
+
+  fftCalculators.push_back(fftCalculator);
+  return fftCalculator;
+}
+
+void WaveApp::SetCascadeResolution(std::size_t cascade, std::size_t resolution)
+{
+  assert(IsGPUFFTSizeSupported(resolution));
+  if (bakedOcean.IsOpen())
+    return;
+
+  cascadeResolutions[cascade] = resolution;
+}
+
+void WaveApp::ApplyCascadeResolutions()
+{
+  bool changed = false;
+  for (std::size_t i = 0; i < generators.size(); i++)
+  {
+    if (generators[i]->GetFFTCalculator()->GetTextureResolution() == cascadeResolutions[i])
+      continue;
+
+    // The cascade's results are for the old resolution, so it's simulated again from now.
+    generators[i]->SetFFTCalculator(GetFFTCalculator(cascadeResolutions[i]));
+    scheduler.Restart(i);
+    scheduler.SetCost(i, GetSimulationCost(cascadeResolutions[i]));
+    changed = true;
+
+    if (tuneWorkgroups)
+      StartTuning(cascadeResolutions[i]);
+  }
+
+  if (changed)
+    DeleteUnusedFFTCalculators();
+}
+
+void WaveApp::DeleteUnusedFFTCalculators()
+{
+  // Calculators that no cascade or tuning generator uses any more return their resources to the
+  // pool.
+  auto uses = [](const std::vector<Generator*>& users, FFTCalculator* fftCalculator)
+  {
+    return std::any_of(users.begin(), users.end(), [fftCalculator](Generator* generator)
+                       { return generator->GetFFTCalculator() == fftCalculator; });
+  };
+
+  std::erase_if(fftCalculators, [&](FFTCalculator* fftCalculator)
+  {
+    bool used = uses(generators, fftCalculator) || uses(tuningGenerators, fftCalculator);
+    if (!used)
+      delete fftCalculator;
+    return !used;
+  });
+}
+
+void WaveApp::StartTuning(std::size_t resolution)
+{
+  WorkgroupTuner& tuner = WorkgroupTuner::Get();
+  for (auto* generator : tuningGenerators)
+  {
+    if (generator->GetFFTCalculator()->GetTextureResolution() == resolution)
+      return;
+  }
+
+  // The jobs switch the generator's settings and overwrite its textures, so it can't be one of the
+  // cascades.
+  std::size_t numJobs = tuner.GetNumJobs();
+  Generator* generator = new Generator(renderDevice, resourcePool, GetFFTCalculator(resolution));
+  generator->AddTuningJobs(tuner);
+  if (tuner.GetNumJobs() == numJobs)
+  {
+    delete generator;
+    DeleteUnusedFFTCalculators();
+    return;
+  }
+
+  tuningGenerators.push_back(generator);
+}
+
+void WaveApp::FinishTuning()
+{
+  for (auto* generator : tuningGenerators)
+    delete generator;
+  tuningGenerators.clear();
+  DeleteUnusedFFTCalculators();
+
+  // Only the pipelines whose workgroups changed are recompiled.
+  for (auto* fftCalculator : fftCalculators)
+    fftCalculator->LoadShaders(true);
+  for (auto* generator : generators)
+    generator->LoadShaders(true);
 }
 
 void WaveApp::OnUpdate(float timestep)
@@ -70,8 +269,12 @@ void WaveApp::OnUpdate(float timestep)
   // Press R to reload shaders
   if (Vision::Input::KeyPress(SDL_SCANCODE_R))
   {
-    // We only need to reload one shader since the generators share a pipeline state.
-    generators[0]->LoadShaders(true);
+    // Generators and calculators of the same size share their pipelines, and shaders that haven't
+    // changed since they were last compiled are skipped.
+    for (auto* fftCalculator : fftCalculators)
+      fftCalculator->LoadShaders(true);
+    for (auto* generator : generators)
+      generator->LoadShaders(true);
     waveRenderer->LoadShaders();
   }
 
@@ -80,30 +283,61 @@ void WaveApp::OnUpdate(float timestep)
   if (!ShouldRender())
     return;
 
+  Profiler::Get().BeginFrame();
+  RenderFrame(timestep);
+  Profiler::Get().EndFrame();
+}
+
+void WaveApp::RenderFrame(float timestep)
+{
+  ProfileScope scope("frame");
+
+  // Resolutions only change between frames, so that no commands refer to the old resources. The
+  // same goes for the pipelines that are recompiled once tuning is done.
+  ApplyCascadeResolutions();
+  if (!tuningGenerators.empty() && !WorkgroupTuner::Get().IsTuning())
+    FinishTuning();
+
   // Begin recording commands
   renderDevice->BeginCommandBuffer();
 
+  // While the workgroups are being tuned, each frame times a candidate before the ocean.
+  WorkgroupTuner::Get().EncodeFrame(renderDevice, resourcePool);
+
   if (Vision::Input::KeyDown(SDL_SCANCODE_Q))
     timestep = 0.0f;
 
-  // First, we do the waves pass
-  for (auto* generator : generators)
-    generator->CalculateOcean(timestep, updateSpectrum);
-
-  // If we have updated our ocean spectrum, we don't need to again until it's changed.
-  // updateSpectrum = false;
+  // First, we do the waves pass. All of our oceans share one compute pass and batch their FFTs.
+  // Each generator regenerates its spectrum only when its settings have changed, and is only
+  // simulated on the frames that the scheduler chose for it. Their fastest waves follow the
+  // settings, and limit how far apart the frames may be.
+  for (std::size_t i = 0; i < generators.size(); i++)
+  {
+    float frequency = GetMaxAngularFrequency(generators[i]->GetOceanSettings(),
+                                             cascadeResolutions[i]);
+    scheduler.SetMaxFrequency(i, frequency);
+  }
+  Generator::CalculateOceans(generators, scheduler.Advance(timestep));
 
   // Then we do our the render pass
   waveRenderer->Render(generators);
 
   // Then we do our UI pass.
-  renderDevice->BeginRenderPass(renderPass);
-  DrawUI();
-  renderDevice->EndRenderPass();
+  {
+    ProfileScope uiScope("ui");
+    renderDevice->BeginRenderPass(renderPass);
+    DrawUI();
+    renderDevice->EndRenderPass();
+  }
 
   // And present to the the screen
+  ProfileScope submitScope("submit");
   renderDevice->SchedulePresentation();
   renderDevice->SubmitCommandBuffer();
+
+  // The pool only reuses or destroys resources, pipelines included, once the frames that used them
+  // have finished on the GPU.
+  resourcePool->EndFrame();
 }
 
 void WaveApp::DrawUI()
@@ -152,6 +386,88 @@ void WaveApp::DrawUI()
       ImGui::Text("FPS: %.1f", (1000.0f / weightedFrameTime));
       ImGui::Text("Frame Time: %.1fms", weightedFrameTime);
 
+      // The shaders are compiled at startup and whenever they're reloaded with R.
+      const ShaderCache::Statistics& shaderStats = ShaderCache::Get().GetStatistics();
+      ImGui::Text("Shaders: %.1fms (%zu compiled, %zu cached, %zu unchanged)", shaderStats.time,
+                  shaderStats.numCompiled, shaderStats.numLoaded, shaderStats.numReused);
+
+      // Tuning takes about a second for each kernel and resolution, during which frames are slow.
+      WorkgroupTuner& tuner = WorkgroupTuner::Get();
+      if (tuner.IsTuning())
+      {
+        ImGui::Text("Tuning workgroups: %zu of %zu kernels", tuner.GetNumJobsDone(),
+                    tuner.GetNumJobs());
+      }
+      else if (ImGui::Button("Retune Workgroups"))
+      {
+        tuner.Forget();
+        for (std::size_t resolution : cascadeResolutions)
+          StartTuning(resolution);
+      }
+
+      // Resolution and render scale changes should mostly reuse resources rather than create them.
+      ResourcePool::Statistics poolStats = resourcePool->GetStatistics();
+      ImGui::Text("Resources: %zu in use, %zu pooled (%zu created, %zu reused, %zu destroyed)",
+                  poolStats.numInUse, poolStats.numFree, poolStats.numCreated,
+                  poolStats.numReused, poolStats.numDestroyed);
+
+      // Time each stage of the frame. Stages that only encode GPU work show the time spent
+      // encoding it, since there are no GPU timers.
+      bool profile = Profiler::IsEnabled();
+      if (ImGui::Checkbox("Profile Stages", &profile))
+        Profiler::Get().SetEnabled(profile);
+
+      if (profile)
+      {
+        for (const StageStatistics& stats : Profiler::Get().GetStatistics())
+        {
+          ImGui::Text("%*s%.*s: %.3fms (max %.3fms)", 2 * stats.depth, "",
+                      static_cast<int>(stats.name.size()), stats.name.data(), stats.average,
+                      stats.max);
+        }
+
+        // Record a few seconds of frames for chrome://tracing or ui.perfetto.dev.
+        if (Profiler::Get().IsCapturing())
+          ImGui::Text("Capturing trace...");
+        else if (ImGui::Button("Save Trace"))
+          Profiler::Get().CaptureTrace("waves_trace.json", traceFrames);
+      }
+
+      // Allow switching FFT algorithms at runtime so that we can compare them.
+      static const char* fftModes[] = {"Multi-pass", "Stockham (single pass)"};
+      int fftMode = static_cast<int>(fftCalculators[0]->GetMode());
+      if (ImGui::Combo("FFT Algorithm", &fftMode, fftModes, IM_ARRAYSIZE(fftModes)))
+      {
+        for (auto* fftCalculator : fftCalculators)
+          fftCalculator->SetMode(static_cast<FFTMode>(fftMode));
+      }
+
+      // Both spectrum layouts produce the same oceans, so this is only for comparison.
+      static bool halfSpectrum = generators[0]->UsesHalfSpectrum();
+      if (ImGui::Checkbox("Half Spectrum", &halfSpectrum))
+      {
+        for (auto* generator : generators)
+          generator->SetHalfSpectrum(halfSpectrum);
+      }
+
+      // Half precision maps are cheaper to sample, and move the surface by under a millimeter.
+      static bool halfPrecision =
+          generators[0]->GetStoragePrecision() == StoragePrecision::Float16;
+      if (ImGui::Checkbox("Half Precision Maps", &halfPrecision))
+      {
+        for (auto* generator : generators)
+        {
+          generator->SetStoragePrecision(halfPrecision ? StoragePrecision::Float16
+                                                       : StoragePrecision::Float32);
+        }
+      }
+
+      if (bakedOcean.IsOpen())
+      {
+        ImGui::Text("Playing back %zu frames looping every %.1fs", bakedOcean.GetNumFrames(),
+                    bakedOcean.GetRepeatPeriod());
+      }
+
       bool first = true;
       for (auto& generator : generators)
       {
@@ -166,17 +482,54 @@ void WaveApp::DrawUI()
     // Simulation Settings
     if (ImGui::CollapsingHeader("Simulation"))
     {
+      // A fixed step makes every run of the same frames simulate the same oceans.
+      ImGui::Text("Simulated: %zu of %zu cascades this frame", scheduler.GetNumSimulated(),
+                  scheduler.GetNumCascades());
+      bool fixedStep = scheduler.GetFixedStep() > 0.0f;
+      if (ImGui::Checkbox("Fixed Step (60 Hz)", &fixedStep))
+        scheduler.SetFixedStep(fixedStep ? 1.0f / 60.0f : 0.0f);
+      ImGui::SameLine();
+      if (ImGui::Button("Restart"))
+        scheduler.Reset();
+
       int i = 0;
-      static const char* text[] = {"Sim 1", "Sim 2", "Sim 3"};
+      bool settingsChanged = false;
       for (auto& generator : generators)
       {
+        char text[16];
+        std::snprintf(text, sizeof(text), "Sim %d", i + 1);
+
         ImGui::PushID(i);
-        ImGui::TreePush(text[i]);
-        if (ImGui::CollapsingHeader(text[i]))
+        ImGui::TreePush(text);
+        if (ImGui::CollapsingHeader(text))
         {
           GeneratorSettings& settings = generator->GetOceanSettings();
 
-          bool us = updateSpectrum;
+          // Cascades that are simulated less often are blended between their last two results.
+          static const char* intervals[] = {"Every Frame", "Every 2 Frames", "Every 4 Frames",
+                                            "Every 8 Frames"};
+          int interval = std::countr_zero(scheduler.GetInterval(i));
+          if (!bakedOcean.IsOpen() &&
+              ImGui::Combo("Updates", &interval, intervals, IM_ARRAYSIZE(intervals)))
+          {
+            scheduler.SetInterval(i, std::size_t(1) << interval);
+          }
+
+          // The resolution switches at the start of the next frame, reusing pooled textures.
+          // Sizes between the powers of two trade some FFT speed for finer steps in detail.
+          static const std::size_t resolutions[] = {64, 128, 256, 384, 512, 640, 768, 1024};
+          static const char* resolutionNames[] = {"64",  "128", "256", "384",
+                                                  "512", "640", "768", "1024"};
+          int resolution = static_cast<int>(
+              std::find(std::begin(resolutions), std::end(resolutions), cascadeResolutions[i]) -
+              std::begin(resolutions));
+          if (!bakedOcean.IsOpen() && ImGui::Combo("Resolution", &resolution, resolutionNames,
+                                                   IM_ARRAYSIZE(resolutionNames)))
+          {
+            SetCascadeResolution(i, resolutions[resolution]);
+          }
+
+          bool us = settingsChanged;
           us |= ImGui::DragFloat("Wind Speed", &settings.U_10, 0.25f, 1.0f, 100.0f, "%.2f");
           us |= ImGui::DragFloat("Wind Angle", &settings.theta_0, 0.5f, -180.0f, 180.0f, "%.1f");
           us |= ImGui::DragFloat("Gravity", &settings.g, 0.05f, 1.0f, 20.0f, "%.2f");
@@ -186,17 +539,21 @@ void WaveApp::DrawUI()
           us |= ImGui::DragFloat("Spread", &settings.spread, 0.01f, 0.0f, 1.0f);
           us |= ImGui::DragFloat("Depth", &settings.h, 0.5f, 15.0f, 500.0f);
           us |= ImGui::DragFloat("Fetch", &settings.F, 1000.0f, 1000.0f, 1000000.0f);
-          us |= ImGui::DragFloat("Size", &settings.planeSize, 0.5f, 1.0f, 200.0f, "%.1f");
-          updateSpectrum = us;
+          us |= ImGui::DragFloat("Size", &settings.planeSize, 0.5f, 1.0f, 1000.0f, "%.1f");
+
+          // The repeat period only changes how the waves move, so it doesn't count as a change.
+          ImGui::DragFloat("Repeat Period", &settings.repeatPeriod, 0.5f, 0.0f, 600.0f, "%.1fs");
+          settingsChanged = us;
         }
         ImGui::TreePop();
         ImGui::PopID();
         i++;
       }
 
-      if (updateSpectrum)
+      // The generators notice the changes themselves, but the bounds must follow the plane sizes.
+      if (settingsChanged)
       {
-        for (int i = 0; i < waveRenderer->GetNumRequiredGenerators(); i++)
+        for (std::size_t i = 0; i < generators.size(); i++)
         {
           GeneratorSettings& settings = generators[i]->GetOceanSettings();
 
@@ -222,6 +579,25 @@ void WaveApp::DrawUI()
       ImGui::DragFloat("Sun Fade", &data.sunFalloffAngle, 0.1f, 0.0f, 40.0f, "%.1f");
       ImGui::DragFloat("Fog Start", &data.fogBegin, 1.0f, 0.0f, 400.0f, "%.0f");
 
+      // The patch resolution has to stay even so that every other vertex can morph away.
+      OceanLOD& oceanLOD = waveRenderer->GetOceanLOD();
+      OceanLODSettings lodSettings = oceanLOD.GetSettings();
+      ImGui::Text("Patches: %zu (%zu triangles)", oceanLOD.GetPatches().size(),
+                  oceanLOD.GetNumTriangles());
+      ImGui::DragFloat("LOD Range", &lodSettings.lodRange, 0.05f, 1.0f, 8.0f, "%.2f");
+      ImGui::DragFloat("LOD Morph", &lodSettings.morphRegion, 0.01f, 0.05f, 0.95f, "%.2f");
+      ImGui::SliderInt("Patch Resolution", &lodSettings.patchResolution, 2, 128);
+      lodSettings.patchResolution &= ~1;
+      oceanLOD.SetSettings(lodSettings);
+
+      // The waves can be drawn at a lower resolution than the window, which the post pass upscales.
+      float renderScale = waveRenderer->GetRenderScale();
+      if (ImGui::SliderFloat("Render Scale", &renderScale, WaveRenderer::minRenderScale, 1.0f,
+                             "%.2f"))
+      {
+        waveRenderer->SetRenderScale(renderScale);
+      }
+
       static bool wireframe = waveRenderer->UsesWireframe();
       if (ImGui::Checkbox("Render Wireframe (T)", &wireframe))
         waveRenderer->UseWireframe(wireframe);
@@ -1,20 +1,62 @@
 #pragma once
 
+#include <string>
 #include <vector>
 
 #include "core/App.h"
 
+#include "BakedOcean.h"
+#include "CascadeScheduler.h"
 #include "FFTCalculator.h"
 #include "Generator.h"
 #include "Renderer.h"
+#include "ResourcePool.h"
 
 namespace Waves
 {
 
+// Whether the workgroups of the compute kernels are tuned at startup, and for resolutions that are
+// switched to later.
+enum class WorkgroupTuning
+{
+  Off,     // Use the sizes that were tuned before, and the defaults for the rest.
+  Untuned, // Tune the kernels that haven't been tuned for the resolutions in use.
+  All      // Tune every kernel again, like after changing GPUs.
+};
+
+// The options that the demo is started with.
+struct WaveAppOptions
+{
+  // The number of cascades that make up the ocean, between one and maxCascades. More cascades add
+  // detail at more scales, at the cost of another simulation and more texture samples per pixel.
+  std::size_t numCascades = 3;
+
+  // Given the path of a baked ocean, the oceans are played back from it instead of simulated, with
+  // as many cascades as it was baked with.
+  std::string playbackPath;
+
+  // Given a path, the first frames are profiled and written to it as a Chrome trace.
+  std::string tracePath;
+
+  // Given a positive step in seconds, every frame advances the ocean by it instead of by the time
+  // that the frame took, so that runs of the same frames are deterministic.
+  float fixedStep = 0.0f;
+
+  // Whether compiled shaders are loaded from and saved to cache/spirv. Turning it off compiles
+  // every shader, which is how we measure a cold start.
+  bool shaderCache = true;
+
+  // The sizes that are tuned are saved to cache/workgroups.bin, so later starts don't tune again.
+  WorkgroupTuning workgroupTuning = WorkgroupTuning::Untuned;
+};
+
+// The number of frames that are recorded in a trace.
+constexpr std::size_t traceFrames = 300;
+
 class WaveApp : public Vision::App
 {
 public:
-  WaveApp();
+  WaveApp(const WaveAppOptions& options = {});
   ~WaveApp();
 
   void OnUpdate(float timestep);
@@ -22,13 +64,53 @@ public:
 
   void DrawUI();
 
+  // Changes the resolution of a cascade, which must be supported by GetFFTRadices. The cascade
+  // switches at the start of the next frame and its simulation starts over, without restarting the
+  // app. Baked oceans keep the resolutions that they were baked with.
+  void SetCascadeResolution(std::size_t cascade, std::size_t resolution);
+
+private:
+  // Records and submits the commands for one frame.
+  void RenderFrame(float timestep);
+
+  // Returns the calculator for a resolution, creating it the first time that it's needed.
+  FFTCalculator* GetFFTCalculator(std::size_t resolution);
+
+  // Moves the cascades whose resolutions were changed to their new calculators, and deletes the
+  // calculators that are no longer used.
+  void ApplyCascadeResolutions();
+  void DeleteUnusedFFTCalculators();
+
+  // Tunes the kernels that haven't been tuned for a resolution over the next frames, on a
+  // generator of its own. Once every job is done, the generators are deleted and the pipelines
+  // are recompiled with the new sizes.
+  void StartTuning(std::size_t resolution);
+  void FinishTuning();
+
 private:
-  std::size_t textureResolution = 256;
+  // The GPU resources of the generators, calculators, and renderer, which outlives all of them.
+  ResourcePool* resourcePool = nullptr;
+
+  // The resolution of each cascade, which the generators switch to at the start of a frame.
+  std::vector<std::size_t> cascadeResolutions;
+
   WaveRenderer* waveRenderer = nullptr;
-  FFTCalculator* fftCalculator = nullptr;
+
+  // One calculator for each resolution, shared by every cascade of that size so that their FFTs
+  // are batched together.
+  std::vector<FFTCalculator*> fftCalculators;
 
   std::vector<Generator*> generators;
-  bool updateSpectrum = true;
+
+  // The generators that the workgroup tuner is running on, if it's running.
+  bool tuneWorkgroups = true;
+  std::vector<Generator*> tuningGenerators;
+
+  // Chooses which cascades are simulated each frame.
+  CascadeScheduler scheduler;
+
+  // The ocean that we play back when one was given, which the generators stream their frames from.
+  BakedOcean bakedOcean;
 
   Vision::ID renderPass = 0;
 };
@@ -0,0 +1,290 @@
+#include "WorkgroupTuner.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <string_view>
+
+#include "AtomicFile.h"
+#include "ShaderCache.h"
+
+namespace Waves
+{
+
+namespace
+{
+
+// Bump the version whenever the layout of the file changes.
+constexpr FileHeader workgroupHeader = {0x53475757, 1}; // "WWGS"
+constexpr const char* workgroupPath = "cache/workgroups.bin";
+
+// Follows the header.
+struct WorkgroupCount
+{
+  uint32_t numSizes = 0;
+  uint32_t padding = 0;
+};
+
+// Each size follows the count as this record, then the name of its kernel.
+struct WorkgroupRecord
+{
+  uint32_t resolution = 0;
+  uint32_t x = 0;
+  uint32_t y = 0;
+  uint32_t nameLength = 0;
+};
+
+// The sizes that are tried for each kernel, with the default first. Each has at most 256 threads.
+constexpr WorkgroupSize candidates[] = {{8, 8}, {16, 8}, {16, 16}, {32, 4}, {32, 8}, {64, 4}};
+
+// Frame times are noisy, so a candidate has to beat the default by this much to replace it.
+constexpr double minImprovement = 0.03;
+
+// The kernel is dispatched about this many times over its image each frame, which covers enough
+// texels that the GPU bounds the frame, without so many dispatches that encoding them does.
+constexpr std::size_t texelsPerFrame = std::size_t(1) << 24;
+constexpr std::size_t maxDispatchesPerFrame = 256;
+
+// The name of a kernel's define, with its name in capitals, like PREPARE_FFT_TILE for prepareFFT.
+std::string GetDefineName(const char* kernel)
+{
+  std::string name;
+  for (const char* c = kernel; *c; c++)
+  {
+    if (std::isupper(static_cast<unsigned char>(*c)) && c != kernel &&
+        std::islower(static_cast<unsigned char>(c[-1])))
+      name += '_';
+    name += static_cast<char>(std::toupper(static_cast<unsigned char>(*c)));
+  }
+  return name + "_TILE";
+}
+
+std::string GetDefineValue(WorkgroupSize size)
+{
+  return "local_size_x = " + std::to_string(size.x) + ", local_size_y = " + std::to_string(size.y);
+}
+
+} // namespace
+
+WorkgroupTuner& WorkgroupTuner::Get()
+{
+  static WorkgroupTuner tuner;
+  return tuner;
+}
+
+WorkgroupSize WorkgroupTuner::GetSize(const std::string& kernel, std::size_t resolution) const
+{
+  auto size = sizes.find(GetKey(kernel, resolution));
+  return size != sizes.end() ? size->second : defaultSize;
+}
+
+bool WorkgroupTuner::IsTuned(const std::string& kernel, std::size_t resolution) const
+{
+  return sizes.contains(GetKey(kernel, resolution));
+}
+
+std::vector<ShaderDefine> WorkgroupTuner::GetDefines(std::span<const char* const> kernels,
+                                                     std::size_t resolution) const
+{
+  std::vector<ShaderDefine> defines;
+  for (const char* kernel : kernels)
+    defines.push_back({GetDefineName(kernel), GetDefineValue(GetSize(kernel, resolution))});
+  return defines;
+}
+
+std::vector<ShaderDefine> WorkgroupTuner::GetDefines(std::span<const char* const> kernels,
+                                                     WorkgroupSize size)
+{
+  std::vector<ShaderDefine> defines;
+  for (const char* kernel : kernels)
+    defines.push_back({GetDefineName(kernel), GetDefineValue(size)});
+  return defines;
+}
+
+std::string WorkgroupTuner::WriteVariant(const std::string& path,
+                                         std::span<const char* const> kernels,
+                                         std::size_t resolution,
+                                         std::vector<ShaderDefine> defines) const
+{
+  std::vector<ShaderDefine> tileDefines = GetDefines(kernels, resolution);
+  defines.insert(defines.begin(), tileDefines.begin(), tileDefines.end());
+  return WriteShaderVariant(path, std::to_string(resolution), defines);
+}
+
+std::string WorkgroupTuner::WriteCandidateVariant(const std::string& path,
+                                                  std::span<const char* const> kernels,
+                                                  std::size_t resolution, WorkgroupSize size,
+                                                  std::vector<ShaderDefine> defines)
+{
+  std::vector<ShaderDefine> tileDefines = GetDefines(kernels, size);
+  defines.insert(defines.begin(), tileDefines.begin(), tileDefines.end());
+  std::string name = std::to_string(resolution) + "_tune_" + std::to_string(size.x) + "x" +
+                     std::to_string(size.y);
+  return WriteShaderVariant(path, name, defines);
+}
+
+void WorkgroupTuner::Load()
+{
+  std::string payload;
+  if (!ReadFileChecked(workgroupPath, workgroupHeader, payload))
+    return;
+
+  std::string_view contents = payload;
+  WorkgroupCount count;
+  if (!ConsumeBytes(contents, &count))
+    return;
+
+  // A truncated file keeps the sizes before the damage, and the rest are tuned again.
+  for (uint32_t i = 0; i < count.numSizes; i++)
+  {
+    WorkgroupRecord record;
+    if (!ConsumeBytes(contents, &record) || contents.size() < record.nameLength)
+      break;
+
+    std::string kernel(contents.substr(0, record.nameLength));
+    contents.remove_prefix(record.nameLength);
+    sizes[GetKey(kernel, record.resolution)] = {record.x, record.y};
+  }
+}
+
+void WorkgroupTuner::Save() const
+{
+  WorkgroupCount count;
+  count.numSizes = static_cast<uint32_t>(sizes.size());
+  std::string payload;
+  AppendBytes(payload, &count);
+
+  for (const auto& [key, size] : sizes)
+  {
+    // The key is the kernel and the resolution, separated by an @.
+    std::size_t separator = key.rfind('@');
+    WorkgroupRecord record;
+    record.resolution = static_cast<uint32_t>(std::stoul(key.substr(separator + 1)));
+    record.x = static_cast<uint32_t>(size.x);
+    record.y = static_cast<uint32_t>(size.y);
+    record.nameLength = static_cast<uint32_t>(separator);
+    AppendBytes(payload, &record);
+    AppendBytes(payload, key.data(), record.nameLength);
+  }
+
+  WriteFileAtomic(workgroupPath, workgroupHeader, payload);
+}
+
+void WorkgroupTuner::AddJob(TuningJob job)
+{
+  // Kernels that are already queued are only tuned once.
+  for (const TuningJob& queued : jobs)
+  {
+    if (queued.kernel == job.kernel && queued.resolution == job.resolution)
+      return;
+  }
+
+  jobs.push_back(std::move(job));
+}
+
+bool WorkgroupTuner::EncodeFrame(Vision::RenderDevice* device, ResourcePool* pool)
+{
+  if (jobs.empty())
+    return false;
+
+  // Each interval covers the last frame. Only the frames after the warmup are timed, since the
+  // frames before them may still have been running the previous candidate.
+  Clock::time_point now = Clock::now();
+  if (frame > warmupFrames)
+    frameTimes.push_back(std::chrono::duration<double, std::milli>(now - lastFrame).count());
+  lastFrame = now;
+
+  if (frameTimes.size() == timedFrames)
+  {
+    std::nth_element(frameTimes.begin(), frameTimes.begin() + timedFrames / 2, frameTimes.end());
+    candidateTimes.push_back(frameTimes[timedFrames / 2]);
+    frameTimes.clear();
+    frame = 0;
+
+    if (++candidate == std::size(candidates))
+      FinishJob();
+
+    if (jobs.empty())
+    {
+      Save();
+      Stop(pool);
+      return true;
+    }
+  }
+
+  // The variant is written and compiled on the first frame of each candidate, which is never
+  // timed. Kernels of the same shader and resolution share their variants.
+  TuningJob& job = jobs.front();
+  WorkgroupSize size = candidates[candidate];
+  if (frame == 0)
+  {
+    std::string path = job.writeVariant(size);
+    Vision::ID& pipeline = pipelines[path];
+    if (!pipeline)
+    {
+      Vision::ComputePipelineDesc desc;
+      desc.ComputeKernels = ShaderCache::Get().CompileFile(path, true);
+      pipeline = device->CreateComputePipeline(desc);
+    }
+    candidatePipeline = pipeline;
+  }
+
+  std::size_t texels = job.resolution * job.resolution;
+  std::size_t dispatches = std::clamp<std::size_t>(texelsPerFrame / texels, 1,
+                                                   maxDispatchesPerFrame);
+
+  // Each dispatch waits for the last, like they do in a frame.
+  device->BeginComputePass();
+  for (std::size_t i = 0; i < dispatches; i++)
+  {
+    job.encode(candidatePipeline, size);
+    device->ImageBarrier();
+  }
+  device->EndComputePass();
+
+  frame++;
+  return false;
+}
+
+void WorkgroupTuner::Stop(ResourcePool* pool)
+{
+  // The last candidates may still be in flight, so the pool destroys them once they're done.
+  for (const auto& [path, pipeline] : pipelines)
+    pool->ReleaseComputePipeline(pipeline);
+  pipelines.clear();
+  candidatePipeline = 0;
+
+  jobs.clear();
+  numJobsDone = 0;
+  candidate = 0;
+  frame = 0;
+  frameTimes.clear();
+  candidateTimes.clear();
+}
+
+std::string WorkgroupTuner::GetKey(const std::string& kernel, std::size_t resolution)
+{
+  return kernel + "@" + std::to_string(resolution);
+}
+
+void WorkgroupTuner::FinishJob()
+{
+  // The default is listed first, and is only replaced by a clearly faster candidate.
+  std::size_t best = std::min_element(candidateTimes.begin(), candidateTimes.end()) -
+                     candidateTimes.begin();
+  if (candidateTimes[best] > candidateTimes[0] * (1.0 - minImprovement))
+    best = 0;
+
+  const TuningJob& job = jobs.front();
+  sizes[GetKey(job.kernel, job.resolution)] = candidates[best];
+  std::cout << "Tuned " << job.kernel << " at " << job.resolution << " to " << candidates[best].x
+            << "x" << candidates[best].y << " (" << candidateTimes[best] << "ms per frame)"
+            << std::endl;
+
+  jobs.erase(jobs.begin());
+  numJobsDone++;
+  candidate = 0;
+  candidateTimes.clear();
+}
+
+} // namespace Waves
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "renderer/RenderDevice.h"
+
+#include "ResourcePool.h"
+#include "ShaderVariant.h"
+
+namespace Waves
+{
+
+// The number of threads along each axis of a workgroup, for a kernel that runs one thread for each
+// texel of an image.
+struct WorkgroupSize
+{
+  std::size_t x = 8;
+  std::size_t y = 8;
+
+  bool operator==(const WorkgroupSize&) const = default;
+};
+
+// The number of workgroups that cover a side of an image. The last one may overhang the image.
+inline std::size_t GetNumWorkgroups(std::size_t size, std::size_t groupSize)
+{
+  return (size + groupSize - 1) / groupSize;
+}
+
+// A kernel at one resolution, and how to time it.
+struct TuningJob
+{
+  std::string kernel;
+  std::size_t resolution = 0;
+
+  // Writes a variant of the kernel's shader where every tiled kernel has the given size, and
+  // returns its path.
+  std::function<std::string(WorkgroupSize size)> writeVariant;
+
+  // Binds everything that the kernel uses, and dispatches it once from the given pipeline.
+  std::function<void(Vision::ID pipeline, WorkgroupSize size)> encode;
+};
+
+// Chooses the workgroup size of each kernel that covers an image, for each resolution. The sizes
+// are compiled into the shaders, which declare one define for each of these kernels, like
+//
+//   #define PREPARE_FFT_TILE local_size_x = 8, local_size_y = 8
+//
+// so that their variants can replace it. Kernels that haven't been tuned use the default size.
+//
+// Tuning runs over frames, since there are no GPU timers. Each candidate size of a kernel is
+// dispatched enough times each frame that the GPU bounds the frame, and is timed by the intervals
+// between frames once the frames of the previous candidate have finished. The winners are saved to
+// cache/workgroups.bin, which should be deleted or retuned after changing GPUs.
+//
+// The tuner is only used from the main thread.
+class WorkgroupTuner
+{
+public:
+  static WorkgroupTuner& Get();
+
+  // 64 threads fill a wavefront on AMD and two warps elsewhere, and square tiles keep the texels
+  // that a workgroup touches close together.
+  static constexpr WorkgroupSize defaultSize = {8, 8};
+
+  WorkgroupSize GetSize(const std::string& kernel, std::size_t resolution) const;
+  bool IsTuned(const std::string& kernel, std::size_t resolution) const;
+
+  // Writes the variant of a shader for a resolution, with each of the kernels sized as it was
+  // tuned, and returns its path. The other defines, like the resolution itself, are added to them.
+  std::string WriteVariant(const std::string& path, std::span<const char* const> kernels,
+                           std::size_t resolution, std::vector<ShaderDefine> defines = {}) const;
+
+  // Writes the same variant with every kernel sized to a candidate, for a job's writeVariant.
+  static std::string WriteCandidateVariant(const std::string& path,
+                                           std::span<const char* const> kernels,
+                                           std::size_t resolution, WorkgroupSize size,
+                                           std::vector<ShaderDefine> defines = {});
+
+  // Reads the sizes that were tuned by earlier runs. Forgetting them tunes everything again.
+  void Load();
+  void Forget() { sizes.clear(); }
+
+  // Queues a kernel to be tuned over the next frames.
+  void AddJob(TuningJob job);
+  bool IsTuning() const { return !jobs.empty(); }
+  std::size_t GetNumJobsDone() const { return numJobsDone; }
+  std::size_t GetNumJobs() const { return numJobsDone + jobs.size(); }
+
+  // Encodes this frame's dispatches of the kernel being tuned, in a compute pass of their own, and
+  // times the last frame. Once the last job finishes, the sizes are saved and this returns true.
+  bool EncodeFrame(Vision::RenderDevice* device, ResourcePool* pool);
+
+  // Abandons the jobs that are left, like when the objects that they use are about to be deleted.
+  // The sizes that were already tuned are kept.
+  void Stop(ResourcePool* pool);
+
+private:
+  WorkgroupTuner() = default;
+
+  static std::string GetKey(const std::string& kernel, std::size_t resolution);
+
+  // The defines that size each of the kernels for a resolution, or all of them to one size.
+  std::vector<ShaderDefine> GetDefines(std::span<const char* const> kernels,
+                                       std::size_t resolution) const;
+  static std::vector<ShaderDefine> GetDefines(std::span<const char* const> kernels,
+                                              WorkgroupSize size);
+
+  // Picks the best candidate of the current job, and moves on to the next one.
+  void FinishJob();
+
+  void Save() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // The frames that are skipped after switching candidates, which must cover every frame that may
+  // still be in flight, and the frames that are timed after them.
+  static constexpr std::size_t warmupFrames = 4;
+  static constexpr std::size_t timedFrames = 8;
+
+  // The tuned sizes, keyed by kernel and resolution.
+  std::unordered_map<std::string, WorkgroupSize> sizes;
+
+  // The jobs that are left, with the first one being tuned. Each candidate's pipeline is compiled
+  // the first time that it's used, and kept until the tuning is done.
+  std::vector<TuningJob> jobs;
+  std::unordered_map<std::string, Vision::ID> pipelines;
+  Vision::ID candidatePipeline = 0;
+  std::size_t numJobsDone = 0;
+
+  std::size_t candidate = 0;
+  std::size_t frame = 0; // Of the current candidate.
+  Clock::time_point lastFrame;
+  std::vector<double> frameTimes;
+  std::vector<double> candidateTimes; // The median frame time of each candidate.
+};
+
+} // namespace Waves
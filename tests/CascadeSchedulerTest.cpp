@@ -0,0 +1,236 @@
+#include <cmath>
+#include <cstdio>
+#include <span>
+#include <vector>
+
+#include "CascadeScheduler.h"
+
+using namespace Waves;
+
+namespace
+{
+
+int numFailures = 0;
+
+#define CHECK(condition)                                                                           \
+  do                                                                                               \
+  {                                                                                                \
+    if (!(condition))                                                                              \
+    {                                                                                              \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);                    \
+      numFailures++;                                                                               \
+    }                                                                                              \
+  } while (false)
+
+constexpr float frameStep = 1.0f / 60.0f;
+
+// The frames before every cascade has two results, which are simulated back to back.
+constexpr std::size_t numWarmupFrames = 2 * CascadeScheduler::maxInterval;
+
+// What happened to one cascade over a run of frames.
+struct CascadeRun
+{
+  std::vector<std::size_t> simulatedFrames;
+  std::vector<double> resultTimes;
+};
+
+// Advances the scheduler through a number of frames after the warmup, and records when each cascade
+// was simulated, and for what time.
+std::vector<CascadeRun> Run(CascadeScheduler& scheduler, std::size_t numFrames)
+{
+  for (std::size_t frame = 0; frame < numWarmupFrames; frame++)
+    scheduler.Advance(frameStep);
+
+  std::vector<CascadeRun> runs(scheduler.GetNumCascades());
+  for (std::size_t frame = 0; frame < numFrames; frame++)
+  {
+    std::span<const CascadeStep> steps = scheduler.Advance(frameStep);
+    for (std::size_t i = 0; i < steps.size(); i++)
+    {
+      if (!steps[i].simulate)
+        continue;
+
+      runs[i].simulatedFrames.push_back(frame);
+      runs[i].resultTimes.push_back(steps[i].time);
+    }
+  }
+
+  return runs;
+}
+
+// Every cascade is simulated once per interval, so its simulations are exactly an interval apart.
+void TestOncePerInterval()
+{
+  const std::size_t intervals[] = {1, 2, 4, 8, 3, 16};
+  const std::size_t expected[] = {1, 2, 4, 8, 2, 8};
+
+  CascadeScheduler scheduler;
+  scheduler.SetNumCascades(std::size(intervals));
+  for (std::size_t i = 0; i < std::size(intervals); i++)
+    scheduler.SetInterval(i, intervals[i]);
+
+  // Intervals are rounded down to powers of two, up to the longest.
+  for (std::size_t i = 0; i < std::size(intervals); i++)
+    CHECK(scheduler.GetInterval(i) == expected[i]);
+
+  std::size_t numFrames = 8 * CascadeScheduler::maxInterval;
+  std::vector<CascadeRun> runs = Run(scheduler, numFrames);
+  for (std::size_t i = 0; i < runs.size(); i++)
+  {
+    const std::vector<std::size_t>& frames = runs[i].simulatedFrames;
+    CHECK(frames.size() == numFrames / expected[i]);
+    CHECK(!frames.empty() && frames.front() < expected[i]);
+    for (std::size_t j = 1; j < frames.size(); j++)
+      CHECK(frames[j] - frames[j - 1] == expected[i]);
+  }
+
+  // Only cascades with longer intervals are blended.
+  std::span<const CascadeStep> steps = scheduler.GetSteps();
+  CHECK(!steps[0].interpolated && steps[0].blend == 1.0f);
+  for (std::size_t i = 1; i < steps.size(); i++)
+    CHECK(steps[i].interpolated);
+}
+
+// Cascades that share an interval are simulated on different frames, weighted by their costs.
+void TestPhasesSpreadCost()
+{
+  // Four equal cascades every fourth frame make one simulation per frame.
+  CascadeScheduler scheduler;
+  scheduler.SetNumCascades(4);
+  for (std::size_t i = 0; i < 4; i++)
+    scheduler.SetInterval(i, 4);
+
+  for (std::size_t frame = 0; frame < numWarmupFrames; frame++)
+    scheduler.Advance(frameStep);
+  for (std::size_t frame = 0; frame < 4 * CascadeScheduler::maxInterval; frame++)
+  {
+    scheduler.Advance(frameStep);
+    CHECK(scheduler.GetNumSimulated() == 1);
+  }
+
+  // An expensive cascade gets a frame to itself, and the cheap ones share the other.
+  const float costs[] = {1.0f, 3.0f, 1.0f, 1.0f};
+  scheduler.SetNumCascades(4);
+  for (std::size_t i = 0; i < 4; i++)
+  {
+    scheduler.SetInterval(i, 2);
+    scheduler.SetCost(i, costs[i]);
+  }
+
+  for (std::size_t frame = 0; frame < numWarmupFrames; frame++)
+    scheduler.Advance(frameStep);
+  for (std::size_t frame = 0; frame < 4 * CascadeScheduler::maxInterval; frame++)
+  {
+    std::span<const CascadeStep> steps = scheduler.Advance(frameStep);
+
+    float cost = 0.0f;
+    for (std::size_t i = 0; i < steps.size(); i++)
+      cost += steps[i].simulate ? costs[i] : 0.0f;
+    CHECK(cost == 3.0f);
+  }
+}
+
+// Between two results, the blend rises steadily from 0 at the previous result towards 1 at the
+// next, and always matches the time that's drawn.
+void TestBlendBetweenResults()
+{
+  CascadeScheduler scheduler;
+  scheduler.SetNumCascades(1);
+  scheduler.SetInterval(0, 4);
+
+  for (std::size_t frame = 0; frame < numWarmupFrames; frame++)
+    scheduler.Advance(frameStep);
+
+  // The result that's drawn last on each frame, and the one before it.
+  double previousTime = 0.0;
+  double nextTime = 0.0;
+  float lastBlend = 0.0f;
+  std::size_t numResults = 0;
+  for (std::size_t frame = 0; frame < 8 * CascadeScheduler::maxInterval; frame++)
+  {
+    const CascadeStep& step = scheduler.Advance(frameStep)[0];
+    if (step.simulate)
+    {
+      // Each result is drawn from the frame that it's simulated on, so the one before it is
+      // reached exactly as the new blend begins.
+      if (numResults > 0)
+        CHECK(std::abs(nextTime - scheduler.GetTime()) < 1e-6);
+
+      previousTime = nextTime;
+      nextTime = step.time;
+      numResults++;
+      CHECK(step.blend == 0.0f || numResults == 1);
+    }
+    else
+    {
+      CHECK(step.blend > lastBlend);
+    }
+
+    CHECK(step.blend >= 0.0f && step.blend < 1.0f);
+    lastBlend = step.blend;
+
+    if (numResults >= 2)
+    {
+      double drawnTime = previousTime + step.blend * (nextTime - previousTime);
+      CHECK(std::abs(drawnTime - scheduler.GetTime()) < 1e-5);
+    }
+  }
+
+  CHECK(numResults == 2 * CascadeScheduler::maxInterval);
+}
+
+// A cascade whose fastest waves would turn too far between results is simulated more often, and
+// goes back to its own interval once the frames are short again.
+void TestIntervalShrinks()
+{
+  CascadeScheduler scheduler;
+  scheduler.SetNumCascades(1);
+  scheduler.SetInterval(0, 8);
+
+  // At 60 frames per second, results four frames apart turn these waves by 0.5 radians, and eight
+  // frames apart by too much.
+  float frequency = 0.5f / (4.0f * frameStep);
+  scheduler.SetMaxFrequency(0, frequency);
+
+  std::vector<CascadeRun> runs = Run(scheduler, 4 * CascadeScheduler::maxInterval);
+  const std::vector<std::size_t>& frames = runs[0].simulatedFrames;
+  CHECK(frames.size() == CascadeScheduler::maxInterval);
+  for (std::size_t j = 1; j < frames.size(); j++)
+    CHECK(frames[j] - frames[j - 1] == 4);
+
+  const std::vector<double>& times = runs[0].resultTimes;
+  for (std::size_t j = 1; j < times.size(); j++)
+    CHECK(frequency * (times[j] - times[j - 1]) <= CascadeScheduler::maxPhaseStep + 1e-4);
+
+  // Slower waves use the whole interval again.
+  scheduler.SetMaxFrequency(0, frequency / 4.0f);
+  runs = Run(scheduler, 4 * CascadeScheduler::maxInterval);
+  for (std::size_t j = 1; j < runs[0].simulatedFrames.size(); j++)
+    CHECK(runs[0].simulatedFrames[j] - runs[0].simulatedFrames[j - 1] == 8);
+
+  // Longer frames shrink it further, down to every frame.
+  scheduler.SetMaxFrequency(0, frequency);
+  scheduler.SetFixedStep(frameStep * 8.0f);
+  runs = Run(scheduler, 4 * CascadeScheduler::maxInterval);
+  for (std::size_t j = 1; j < runs[0].simulatedFrames.size(); j++)
+    CHECK(runs[0].simulatedFrames[j] - runs[0].simulatedFrames[j - 1] == 1);
+}
+
+} // namespace
+
+int main()
+{
+  TestOncePerInterval();
+  TestPhasesSpreadCost();
+  TestBlendBetweenResults();
+  TestIntervalShrinks();
+
+  if (numFailures > 0)
+  {
+    std::printf("%d checks failed\n", numFailures);
+    return 1;
+  }
+
+  std::printf("All checks passed\n");
+  return 0;
+}
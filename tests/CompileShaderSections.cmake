@@ -0,0 +1,67 @@
+# Compiles each #section of a shader file on its own with glslangValidator, with the common section
+# in front of it like Vision's ShaderCompiler puts it, so that a kernel that doesn't compile fails
+# the tests rather than the demo's startup. The shaders are OpenGL GLSL compiled to SPIR-V, so they
+# are validated the same way.
+#
+# Usage: cmake -DGLSLANG_VALIDATOR=<path> -DSHADER=<file> -DOUTPUT_DIR=<dir>
+#              -P CompileShaderSections.cmake
+
+get_filename_component(shaderName "${SHADER}" NAME)
+file(READ "${SHADER}" remaining)
+file(MAKE_DIRECTORY "${OUTPUT_DIR}")
+
+# The source is kept in quoted strings throughout, since GLSL is full of semicolons, which CMake
+# would otherwise split into lists.
+set(common "")
+set(numSections 0)
+set(failures "")
+string(FIND "${remaining}" "#section " start)
+while (NOT start EQUAL -1)
+  # Each section runs from the line after its header up to the next header.
+  string(SUBSTRING "${remaining}" ${start} -1 remaining)
+  string(FIND "${remaining}" "\n" headerEnd)
+  string(SUBSTRING "${remaining}" 0 ${headerEnd} header)
+  math(EXPR bodyStart "${headerEnd} + 1")
+  string(SUBSTRING "${remaining}" ${bodyStart} -1 remaining)
+
+  string(FIND "${remaining}" "#section " start)
+  string(SUBSTRING "${remaining}" 0 ${start} body)
+
+  if (header MATCHES "^#section common")
+    set(common "${body}")
+  elseif (header MATCHES "type\\(([a-z]+)\\) name\\(([A-Za-z0-9_]+)\\)")
+    set(name "${CMAKE_MATCH_2}")
+    if (CMAKE_MATCH_1 STREQUAL "compute")
+      set(stage "comp")
+    elseif (CMAKE_MATCH_1 STREQUAL "vertex")
+      set(stage "vert")
+    else()
+      set(stage "frag")
+    endif()
+
+    set(path "${OUTPUT_DIR}/${shaderName}.${name}.${stage}")
+    file(WRITE "${path}" "${common}${body}")
+    execute_process(COMMAND "${GLSLANG_VALIDATOR}" -G -o "${path}.spv" "${path}"
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE output)
+    if (NOT result EQUAL 0)
+      message("${shaderName}: ${name} failed to compile:\n${output}")
+      list(APPEND failures "${name}")
+    endif()
+    math(EXPR numSections "${numSections} + 1")
+  else()
+    message(FATAL_ERROR "${shaderName}: unknown section header '${header}'")
+  endif()
+endwhile()
+
+if (numSections EQUAL 0)
+  message(FATAL_ERROR "${shaderName}: no sections to compile")
+endif()
+
+if (failures)
+  string(JOIN ", " failures ${failures})
+  message(FATAL_ERROR "${shaderName}: ${failures} failed to compile")
+endif()
+
+message("${shaderName}: compiled ${numSections} sections")
@@ -0,0 +1,223 @@
+#include <cmath>
+#include <cstdio>
+#include <glm/gtc/matrix_transform.hpp>
+#include <span>
+#include <vector>
+
+#include "OceanLOD.h"
+
+using namespace Waves;
+
+namespace
+{
+
+int numFailures = 0;
+
+#define CHECK(condition)                                                                           \
+  do                                                                                               \
+  {                                                                                                \
+    if (!(condition))                                                                              \
+    {                                                                                              \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);                    \
+      numFailures++;                                                                               \
+    }                                                                                              \
+  } while (false)
+
+// A view projection whose frustum contains everything, since every plane is w >= 0.
+glm::mat4 NoFrustum()
+{
+  glm::mat4 viewProjection(0.0f);
+  viewProjection[3][3] = 1.0f;
+  return viewProjection;
+}
+
+// A camera looking along +x, tilted down a little, like the demo's.
+glm::mat4 CameraFrustum(const glm::vec3& position)
+{
+  glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, 10000.0f);
+  glm::vec3 target = position + glm::vec3(1.0f, -0.2f, 0.0f);
+  return projection * glm::lookAt(position, target, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+// The distance from the camera to the closest point of a rectangle on the water, which is how
+// OceanLOD measures nodes.
+float RectDistance(const glm::vec3& camera, glm::vec2 min, glm::vec2 max)
+{
+  glm::vec2 flat(camera.x, camera.z);
+  glm::vec2 offset = flat - glm::max(min, glm::min(flat, max));
+  return std::sqrt(glm::dot(offset, offset) + camera.y * camera.y);
+}
+
+float SquareDistance(const glm::vec3& camera, glm::vec2 origin, float size)
+{
+  return RectDistance(camera, origin, origin + size);
+}
+
+// The vertex shader only hides the seam between two patches when they're at most a level apart,
+// and the finer one has fully morphed into the grid of the coarser one along their shared edge.
+void CheckSeams(const glm::vec3& camera, std::span<const OceanPatch> patches)
+{
+  std::size_t numCracks = 0;
+  for (const OceanPatch& a : patches)
+  {
+    for (const OceanPatch& b : patches)
+    {
+      // The patch a is the finer of the two.
+      if (a.size >= b.size)
+        continue;
+
+      // The overlap of two neighbors is their shared edge, which is a line rather than a corner.
+      glm::vec2 min = glm::max(a.origin, b.origin);
+      glm::vec2 max = glm::min(a.origin + a.size, b.origin + b.size);
+      glm::vec2 overlap = max - min;
+      bool neighbors = (overlap.x == 0.0f && overlap.y > 0.0f) ||
+                       (overlap.y == 0.0f && overlap.x > 0.0f);
+      if (!neighbors)
+        continue;
+
+      if (b.size > 2.0f * a.size || RectDistance(camera, min, max) < a.morphEnd)
+        numCracks++;
+    }
+  }
+  CHECK(numCracks == 0);
+}
+
+// Without culling, the patches cover the whole root, and every level lies within its range.
+void TestLevelsFollowDistance()
+{
+  OceanLOD lod;
+  OceanLODSettings settings = lod.GetSettings();
+  glm::vec3 camera(1234.5f, 15.0f, -678.25f);
+  lod.Select(camera, NoFrustum());
+  std::span<const OceanPatch> patches = lod.GetPatches();
+
+  CHECK(!patches.empty());
+  CHECK(patches.size() < maxOceanPatches);
+
+  float area = 0.0f;
+  float finestSize = settings.rootSize / float(1 << (settings.numLevels - 1));
+  for (const OceanPatch& patch : patches)
+  {
+    area += patch.size * patch.size;
+
+    // Patches would have been split if the camera were in their range, unless they're the finest.
+    if (patch.size > finestSize)
+      CHECK(SquareDistance(camera, patch.origin, patch.size) >= settings.lodRange * patch.size);
+
+    // Their parents were split, so the camera is within the range of the parent, which is where
+    // the patch finishes morphing into it.
+    if (patch.size < settings.rootSize)
+    {
+      glm::vec2 parent = glm::floor(patch.origin / (2.0f * patch.size)) * (2.0f * patch.size);
+      CHECK(SquareDistance(camera, parent, 2.0f * patch.size) < patch.morphEnd);
+      CHECK(patch.morphEnd == settings.lodRange * 2.0f * patch.size);
+    }
+  }
+  CHECK(area == settings.rootSize * settings.rootSize);
+
+  // The patches are ordered from the coarsest to the finest, with the finest under the camera.
+  for (std::size_t i = 1; i < patches.size(); i++)
+    CHECK(patches[i].size <= patches[i - 1].size);
+  for (const OceanPatch& patch : patches)
+  {
+    glm::vec2 offset = glm::vec2(camera.x, camera.z) - patch.origin;
+    if (offset.x >= 0.0f && offset.y >= 0.0f && offset.x < patch.size && offset.y < patch.size)
+      CHECK(patch.size == patches.back().size);
+  }
+
+  CheckSeams(camera, patches);
+}
+
+// Patches that the camera can't see are left out.
+void TestFrustumRejection()
+{
+  OceanLOD lod;
+  OceanLODSettings settings = lod.GetSettings();
+  glm::vec3 camera(100.0f, 10.0f, 50.0f);
+
+  lod.Select(camera, NoFrustum());
+  std::size_t numUnculled = lod.GetPatches().size();
+
+  lod.Select(camera, CameraFrustum(camera));
+  std::vector<OceanPatch> patches(lod.GetPatches().begin(), lod.GetPatches().end());
+  CHECK(!patches.empty());
+  CHECK(patches.size() < numUnculled);
+
+  // The camera looks along +x. The bounds of patches well behind it, and close enough to its axis,
+  // are behind every side of the frustum, so there are some of those without culling and none with.
+  auto isBehind = [&](const OceanPatch& patch)
+  {
+    float distance = camera.x - (patch.origin.x + patch.size + settings.heightBound);
+    float side = 0.5f * distance;
+    return distance > 100.0f && patch.origin.y - settings.heightBound > camera.z - side &&
+           patch.origin.y + patch.size + settings.heightBound < camera.z + side;
+  };
+
+  std::size_t numBehind = 0;
+  for (const OceanPatch& patch : patches)
+    numBehind += isBehind(patch);
+  CHECK(numBehind == 0);
+
+  lod.Select(camera, NoFrustum());
+  numBehind = 0;
+  for (const OceanPatch& patch : lod.GetPatches())
+    numBehind += isBehind(patch);
+  CHECK(numBehind > 0);
+
+  // Looking straight up, only the patches near the camera can reach into the view.
+  glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 10000.0f);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 500.0f, 0.0f), glm::vec3(0.0f, 600.0f, 0.0f),
+                               glm::vec3(1.0f, 0.0f, 0.0f));
+  lod.Select(glm::vec3(0.0f, 500.0f, 0.0f), projection * view);
+  CHECK(lod.GetPatches().empty());
+
+  CheckSeams(camera, patches);
+}
+
+// When the patches run out, detail is only lost from the finest levels, and never in a way that
+// leaves neighbors more than a level apart.
+void TestBudgetExhaustion()
+{
+  OceanLOD lod;
+  OceanLODSettings settings = lod.GetSettings();
+  settings.lodRange = 12.0f;
+  settings.numLevels = 16;
+  lod.SetSettings(settings);
+
+  for (float height : {2.0f, 40.0f, 300.0f})
+  {
+    for (float offset : {0.0f, 1000.0f, 1717.3f, 3000.0f})
+    {
+      glm::vec3 camera(offset, height, 0.37f * offset);
+      lod.Select(camera, NoFrustum());
+      std::span<const OceanPatch> patches = lod.GetPatches();
+      CHECK(patches.size() <= maxOceanPatches);
+
+      // Without culling, running out of patches doesn't leave holes either.
+      float area = 0.0f;
+      for (const OceanPatch& patch : patches)
+        area += patch.size * patch.size;
+      CHECK(area == settings.rootSize * settings.rootSize);
+
+      CheckSeams(camera, patches);
+    }
+  }
+}
+
+} // namespace
+
+int main()
+{
+  TestLevelsFollowDistance();
+  TestFrustumRejection();
+  TestBudgetExhaustion();
+
+  if (numFailures > 0)
+  {
+    std::printf("%d checks failed\n", numFailures);
+    return 1;
+  }
+
+  std::printf("All checks passed\n");
+  return 0;
+}